@@ -0,0 +1,76 @@
+#include "AgentApi.h"
+
+#include <new>
+
+#include "SharedRegion.hpp"
+
+struct chip8_agent
+{
+    SharedRegion region;
+    chip8_agent_region* state;
+    uint32_t submitted; // request number of the last command
+};
+
+chip8_agent* chip8_agent_open(const char* name)
+{
+    chip8_agent* agent = new (std::nothrow) chip8_agent;
+    if (!agent)
+    {
+        return nullptr;
+    }
+    if (!agent->region.open(name, sizeof(chip8_agent_region)))
+    {
+        delete agent;
+        return nullptr;
+    }
+
+    agent->state = static_cast<chip8_agent_region*>(agent->region.data());
+    const bool ready = SharedRegion::load(&agent->state->magic) == CHIP8_AGENT_MAGIC; // pairs with AgentServer::open
+    if (!ready || agent->state->version != CHIP8_AGENT_VERSION)
+    {
+        delete agent;
+        return nullptr;
+    }
+    agent->submitted = SharedRegion::load(&agent->state->request);
+    return agent;
+}
+
+void chip8_agent_close(chip8_agent* agent)
+{
+    delete agent;
+}
+
+chip8_agent_region* chip8_agent_state(chip8_agent* agent)
+{
+    return agent->state;
+}
+
+void chip8_agent_submit(chip8_agent* agent, uint32_t command, uint32_t frames)
+{
+    agent->state->command = command;
+    agent->state->frames = frames;
+    SharedRegion::publish(&agent->state->request, ++agent->submitted, &agent->state->request_sleepers);
+}
+
+void chip8_agent_wait(chip8_agent* agent)
+{
+    // one command is outstanding at a time, so the response moves on from the previous one
+    SharedRegion::waitWhile(&agent->state->response, agent->submitted - 1, &agent->state->response_sleepers);
+}
+
+void chip8_agent_step(chip8_agent* agent, uint32_t frames)
+{
+    chip8_agent_submit(agent, CHIP8_AGENT_STEP, frames);
+    chip8_agent_wait(agent);
+}
+
+void chip8_agent_reset(chip8_agent* agent)
+{
+    chip8_agent_submit(agent, CHIP8_AGENT_RESET, 0);
+    chip8_agent_wait(agent);
+}
+
+void chip8_agent_quit(chip8_agent* agent)
+{
+    chip8_agent_submit(agent, CHIP8_AGENT_QUIT, 0);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/* C interface to an emulator started with --serve NAME. The server maps a POSIX shared
+   memory object named NAME holding one chip8_agent_region; the agent maps the same object,
+   writes its action into keypad, submits a step and, once the step is done, reads the
+   observation straight out of the region. Linux only: both sides wait on the request and
+   response words with futexes. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_AGENT_MAGIC 0x38504843u /* "CHP8" */
+#define CHIP8_AGENT_VERSION 1u
+
+enum chip8_agent_command
+{
+    CHIP8_AGENT_STEP = 1,  /* apply keypad, then advance frames timer ticks */
+    CHIP8_AGENT_RESET = 2, /* return to the state the server started serving in, then publish it */
+    CHIP8_AGENT_QUIT = 3   /* the server publishes nothing and exits */
+};
+
+typedef struct chip8_agent_region
+{
+    uint32_t magic; /* CHIP8_AGENT_MAGIC once the server is ready */
+    uint32_t version;
+
+    /* handshake: the agent fills in the command, then increments request; the server sets
+       response to request once the command is done. Both are futex words; the sleepers
+       count the threads asleep on each, so that nobody makes a system call for nothing. */
+    uint32_t request;
+    uint32_t response;
+    uint32_t request_sleepers;
+    uint32_t response_sleepers;
+    uint32_t command; /* a chip8_agent_command */
+    uint32_t frames; /* CHIP8_AGENT_STEP: timer ticks to advance, 0 publishes the state as is */
+
+    /* action: nonzero = pressed, applied before stepping */
+    uint8_t keypad[16];
+
+    /* observation, valid while response == request */
+    uint64_t cycles;
+    uint64_t frame_count;
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t hires; /* 1: 128x64, else 64x32 */
+    uint8_t planes; /* bitplanes selected with FN01 */
+    /* pixel x of row y in plane p is bit (63 - x % 64) of display[p][y][x / 64]; in low
+       resolution only rows 0-31 and word 0 of each are used */
+    uint64_t display[2][64][2];
+} chip8_agent_region;
+
+typedef struct chip8_agent chip8_agent;
+
+/* NULL if no server is serving name (yet) */
+chip8_agent* chip8_agent_open(const char* name);
+void chip8_agent_close(chip8_agent* agent);
+
+/* the mapped region: write keypad before a step, read the observation after it */
+chip8_agent_region* chip8_agent_state(chip8_agent* agent);
+
+/* submit/wait let one thread keep many servers busy at once; step is both. Every submit
+   must be followed by a wait before the next one. */
+void chip8_agent_submit(chip8_agent* agent, uint32_t command, uint32_t frames);
+void chip8_agent_wait(chip8_agent* agent);
+void chip8_agent_step(chip8_agent* agent, uint32_t frames);
+void chip8_agent_reset(chip8_agent* agent);
+void chip8_agent_quit(chip8_agent* agent); /* does not wait: the server exits without answering */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+#include "AgentServer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+static_assert(sizeof(chip8_agent_region::display) == sizeof(DisplayState::rows), "the region holds the display rows as is");
+
+AgentServer::AgentServer(Emulator& emulator) :
+    emulator(emulator),
+    state{ nullptr },
+    stepCount{ 0 }
+{
+}
+
+bool AgentServer::open(const std::string& name)
+{
+    if (!region.create(name, sizeof(chip8_agent_region)))
+    {
+        return false;
+    }
+
+    state = static_cast<chip8_agent_region*>(region.data());
+    initial = emulator.snapshot();
+    state->version = CHIP8_AGENT_VERSION;
+    std::copy(std::begin(emulator.cpu().keypad), std::end(emulator.cpu().keypad), std::begin(state->keypad));
+    publish();
+    SharedRegion::store(&state->magic, CHIP8_AGENT_MAGIC); // last: an agent that sees it also sees everything above
+    return true;
+}
+
+void AgentServer::serve()
+{
+    uint32_t served = state->response;
+    for (;;)
+    {
+        served = SharedRegion::waitWhile(&state->request, served, &state->request_sleepers);
+
+        const uint32_t command = state->command;
+        if (command == CHIP8_AGENT_QUIT)
+        {
+            break;
+        }
+        if (command == CHIP8_AGENT_STEP)
+        {
+            for (uint8_t key = 0; key < 16; ++key)
+            {
+                emulator.setKey(key, state->keypad[key] != 0);
+            }
+            emulator.runFrames(state->frames);
+            ++stepCount;
+        }
+        else if (command == CHIP8_AGENT_RESET)
+        {
+            emulator.restore(initial);
+        }
+        publish();
+        SharedRegion::publish(&state->response, served, &state->response_sleepers);
+    }
+
+    region.close();
+    state = nullptr;
+}
+
+uint64_t AgentServer::steps() const
+{
+    return stepCount;
+}
+
+void AgentServer::publish()
+{
+    const CPU& cpu = emulator.cpu();
+    state->cycles = emulator.cycles();
+    state->frame_count = emulator.frames();
+    std::copy(std::begin(cpu.V), std::end(cpu.V), std::begin(state->V));
+    state->I = cpu.I;
+    state->pc = cpu.pc;
+    state->delay_timer = cpu.delayTimer;
+    state->sound_timer = cpu.soundTimer;
+
+    const DisplayState& display = cpu.display.state();
+    state->hires = display.hires ? 1 : 0;
+    state->planes = display.planes;
+    std::memcpy(state->display, display.rows, sizeof(state->display));
+}
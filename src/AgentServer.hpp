@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "AgentApi.h"
+#include "Emulator.hpp"
+#include "SharedRegion.hpp"
+
+// Server side of the agent interface (AgentApi.h): drives an Emulator from the commands an
+// external process posts into a shared chip8_agent_region and publishes the machine state
+// there after each one. The emulator runs flat out, frames are only ever advanced on request.
+class AgentServer
+{
+public:
+    explicit AgentServer(Emulator& emulator);
+
+    AgentServer(const AgentServer&) = delete;
+    AgentServer& operator=(const AgentServer&) = delete;
+
+    bool open(const std::string& name); // creates the region and publishes the current state
+    void serve(); // handles commands until CHIP8_AGENT_QUIT, then removes the region
+
+    uint64_t steps() const; // CHIP8_AGENT_STEP commands handled
+
+private:
+    void publish(); // copies the observation into the region
+
+private:
+    Emulator& emulator;
+    std::shared_ptr<const Snapshot> initial; // CHIP8_AGENT_RESET target, taken by open()
+    SharedRegion region;
+    chip8_agent_region* state;
+    uint64_t stepCount;
+};
@@ -0,0 +1,173 @@
+#include "Aot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    std::vector<const AotProgram*>& registry()
+    {
+        static std::vector<const AotProgram*> programs;
+        return programs;
+    }
+}
+
+AotMachine::AotMachine(CPU& cpu) :
+    cpu(cpu),
+    V(cpu.V),
+    I(cpu.I),
+    pc(cpu.pc),
+    stack(cpu.stack),
+    sp(cpu.sp),
+    delayTimer(cpu.delayTimer),
+    soundTimer(cpu.soundTimer),
+    memory(cpu.memory),
+    keypad(cpu.keypad),
+    display(cpu.display)
+{
+}
+
+void AotMachine::interpret(uint16_t address, uint16_t opcode)
+{
+    pc = address;
+    cpu.execute(cpu.decode(opcode));
+}
+
+AotRegistration::AotRegistration(const AotProgram& program)
+{
+    registry().push_back(&program);
+}
+
+const std::vector<const AotProgram*>& aotPrograms()
+{
+    return registry();
+}
+
+Aot::Aot(CPU& cpu) :
+    cpu(cpu),
+    machine(cpu),
+    loaded(nullptr),
+    span{ 0 }
+{
+    clear();
+}
+
+unsigned Aot::run(unsigned budget)
+{
+    unsigned executed = 0;
+    while (executed < budget)
+    {
+        executed += shadow ? runChecked(budget - executed) : step(budget - executed);
+    }
+    return executed;
+}
+
+unsigned Aot::step(unsigned budget)
+{
+    invalidateWrites();
+
+    const uint16_t pc = cpu.programCounter();
+    const int32_t index = (pc < entries.size()) ? entries[pc] : -1;
+    if (index >= 0 && valid[index])
+    {
+        const AotBlock& block = loaded->blocks[index];
+        const unsigned count = std::min<unsigned>(block.length, budget);
+        block.function(machine, count);
+        return count;
+    }
+
+    cpu.emulateCycle();
+    return 1;
+}
+
+unsigned Aot::runChecked(unsigned budget)
+{
+    *shadow = cpu;
+    const uint16_t pc = cpu.programCounter();
+
+    const unsigned executed = step(budget);
+    for (unsigned i = 0; i < executed; ++i)
+    {
+        shadow->emulateCycle();
+    }
+
+    if (!cpu.sameState(*shadow))
+    {
+        std::ostringstream message;
+        message << std::hex << std::uppercase << "Recompiled code diverged from the interpreter in the "
+            << std::dec << executed << std::hex << " instructions from address 0x" << pc << "\nrecompiled:\n";
+        cpu.printState(message);
+        message << "interpreter:\n";
+        shadow->printState(message);
+        throw std::runtime_error(message.str());
+    }
+    return executed;
+}
+
+void Aot::clear()
+{
+    unsigned begin;
+    unsigned end;
+    cpu.takeMemoryWrite(begin, end);
+
+    // the longest matching image wins; blocks of a shorter one would be valid as well
+    loaded = nullptr;
+    for (const AotProgram* program : aotPrograms())
+    {
+        if (program->quirks == cpu.quirks() && program->size <= cpu.memory.size() - PROGRAM_MEMORY_OFFSET
+            && (!loaded || program->size > loaded->size)
+            && std::memcmp(cpu.memory + PROGRAM_MEMORY_OFFSET, program->image, program->size) == 0)
+        {
+            loaded = program;
+        }
+    }
+
+    entries.assign(cpu.memory.size(), -1);
+    valid.assign(loaded ? loaded->count : 0, true);
+    span = 0;
+    for (size_t i = 0; i < valid.size(); ++i)
+    {
+        const AotBlock& block = loaded->blocks[i];
+        entries[block.start] = static_cast<int32_t>(i);
+        span = std::max<unsigned>(span, block.end - block.start);
+    }
+}
+
+const AotProgram* Aot::program() const
+{
+    return loaded;
+}
+
+void Aot::setDifferential(bool enabled)
+{
+    shadow.reset(enabled ? new CPU(cpu) : nullptr);
+}
+
+void Aot::invalidateWrites()
+{
+    unsigned begin;
+    unsigned end;
+    if (!cpu.takeMemoryWrite(begin, end) || !loaded)
+    {
+        return;
+    }
+
+    // blocks are sorted by start, so only the ones starting less than span before begin can overlap
+    const AotBlock* first = std::lower_bound(loaded->blocks, loaded->blocks + loaded->count, begin - std::min<unsigned>(begin, span),
+        [](const AotBlock& block, unsigned address) { return block.start < address; });
+    for (const AotBlock* block = first; block != loaded->blocks + loaded->count && block->start < end; ++block)
+    {
+        if (begin < block->end)
+        {
+            valid[block - loaded->blocks] = matches(*block); // a write may also restore the original code
+        }
+    }
+}
+
+bool Aot::matches(const AotBlock& block) const
+{
+    const size_t offset = block.start - PROGRAM_MEMORY_OFFSET;
+    return std::memcmp(cpu.memory + block.start, loaded->image + offset, block.end - block.start) == 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "CPU.hpp"
+
+// The machine state as seen by code generated by the Recompiler: references straight into a CPU,
+// so translated blocks read and write the same registers the interpreter does.
+struct AotMachine
+{
+    explicit AotMachine(CPU& cpu);
+
+    void interpret(uint16_t address, uint16_t opcode); // runs one instruction through the CPU handlers
+
+    CPU& cpu;
+    uint8_t (&V)[16];
+    uint16_t& I;
+    uint16_t& pc;
+    uint16_t (&stack)[16];
+    uint8_t& sp;
+    uint8_t& delayTimer;
+    uint8_t& soundTimer;
+    Memory& memory;
+    uint8_t (&keypad)[16];
+    Framebuffer& display;
+};
+
+// A basic block translated ahead of time. function executes the first count (1 to length)
+// instructions of the block and leaves pc where the interpreter would have.
+struct AotBlock
+{
+    uint16_t start;
+    uint32_t end; // one past the last byte translated
+    uint16_t length;
+    void (*function)(AotMachine& m, unsigned count);
+};
+
+// A recompiled ROM: the image the blocks were translated from, loaded at PROGRAM_MEMORY_OFFSET.
+struct AotProgram
+{
+    const char* name;
+    const uint8_t* image;
+    size_t size;
+    const AotBlock* blocks; // sorted by start
+    size_t count;
+    QuirkProfile quirks; // the semantics the blocks were translated with
+};
+
+// Each generated translation unit adds its program to the registry with a static instance.
+struct AotRegistration
+{
+    explicit AotRegistration(const AotProgram& program);
+};
+
+const std::vector<const AotProgram*>& aotPrograms();
+
+// Runs recompiled ROMs natively. clear() picks the registered program whose image matches
+// memory and whose quirks match the CPU's; a block only runs while its bytes still match that
+// image, so code the program writes over (FX33/FX55, state restores) and code outside the
+// image, including BNNN and 00EE targets the Recompiler could not see, is interpreted instead.
+class Aot
+{
+public:
+    explicit Aot(CPU& cpu);
+
+    unsigned run(unsigned budget); // executes up to budget (>= 1) instructions, returns how many ran
+    void clear(); // must be called after memory is modified outside of the CPU (e.g. a ROM load)
+    const AotProgram* program() const; // the program in use, nullptr if no registered one matches
+
+    // Differential mode: every block is also executed by the interpreter on a copy of the
+    // machine and the results are compared; a mismatch throws std::runtime_error.
+    void setDifferential(bool enabled);
+
+private:
+    unsigned step(unsigned budget);
+    unsigned runChecked(unsigned budget);
+    void invalidateWrites(); // rechecks the blocks overlapping memory written since the last call
+    bool matches(const AotBlock& block) const;
+
+private:
+    CPU& cpu;
+    AotMachine machine;
+    const AotProgram* loaded;
+    std::vector<int32_t> entries; // index of the block starting at each address, -1 if none
+    std::vector<bool> valid; // per block: its bytes in memory still match the image
+    unsigned span; // bytes covered by the longest block
+    std::unique_ptr<CPU> shadow;
+};
@@ -0,0 +1,206 @@
+#include "Audio.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    void putLittleEndian(std::ostream& out, uint32_t value, unsigned bytes)
+    {
+        for (unsigned i = 0; i < bytes; ++i)
+        {
+            out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void writeWavHeader(std::ostream& out, unsigned sampleRate, uint32_t dataBytes)
+    {
+        out.write("RIFF", 4);
+        putLittleEndian(out, 36 + dataBytes, 4);
+        out.write("WAVEfmt ", 8);
+        putLittleEndian(out, 16, 4); // fmt chunk size
+        putLittleEndian(out, 1, 2); // PCM
+        putLittleEndian(out, 1, 2); // mono
+        putLittleEndian(out, sampleRate, 4);
+        putLittleEndian(out, sampleRate * 2, 4); // bytes per second
+        putLittleEndian(out, 2, 2); // bytes per frame
+        putLittleEndian(out, 16, 2); // bits per sample
+        out.write("data", 4);
+        putLittleEndian(out, dataBytes, 4);
+    }
+}
+
+SoundChannel::SoundChannel(unsigned cyclesPerSecond, unsigned sampleRate) :
+    cyclesPerSecond{ std::max(1u, cyclesPerSecond) },
+    sampleRate{ sampleRate },
+    cycle{ 0 },
+    dropped{ 0 }
+{
+}
+
+void SoundChannel::post(const SoundEvent& event)
+{
+    if (!events.push(event))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t SoundChannel::sample(uint64_t cycle) const
+{
+    return cycle / cyclesPerSecond * sampleRate + cycle % cyclesPerSecond * sampleRate / cyclesPerSecond;
+}
+
+Synthesizer::Synthesizer(SoundChannel& channel, unsigned frequency) :
+    channel{ channel },
+    phase{ 0 },
+    phaseStep{ static_cast<uint32_t>((static_cast<uint64_t>(frequency) << 32) / channel.sampleRate) },
+    on{ false },
+    rendered{ 0 },
+    realtime{ false },
+    latency{ 0 },
+    anchored{ false },
+    offset{ 0 },
+    hasPending{ false },
+    pendingSample{ 0 },
+    pendingOn{ false }
+{
+}
+
+void Synthesizer::setRealtime(unsigned latencySamples)
+{
+    realtime = true;
+    latency = latencySamples;
+    anchored = false;
+}
+
+void Synthesizer::render(int16_t* samples, size_t count)
+{
+    if (!hasPending)
+    {
+        nextEvent();
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        while (hasPending && pendingSample <= rendered)
+        {
+            on = pendingOn;
+            hasPending = false;
+            nextEvent();
+        }
+
+        phase += phaseStep;
+        samples[i] = !on ? 0 : (phase < 0x80000000u) ? BEEP_AMPLITUDE : static_cast<int16_t>(-BEEP_AMPLITUDE);
+        ++rendered;
+    }
+}
+
+uint64_t Synthesizer::available() const
+{
+    return channel.sample(channel.cycle.load(std::memory_order_acquire));
+}
+
+uint64_t Synthesizer::position() const
+{
+    return rendered;
+}
+
+bool Synthesizer::nextEvent()
+{
+    SoundEvent event;
+    if (!channel.events.pop(event))
+    {
+        return false;
+    }
+
+    const int64_t target = static_cast<int64_t>(channel.sample(event.cycle));
+    int64_t scheduled = target;
+    if (realtime)
+    {
+        // events normally arrive up to a frame ahead of the paced timeline; one that is badly
+        // late or far ahead means the two clocks parted ways, so schedule from here again
+        const int64_t now = static_cast<int64_t>(rendered);
+        const int64_t window = static_cast<int64_t>(latency + channel.sampleRate / 10);
+        scheduled = target + offset;
+        if (!anchored || scheduled + static_cast<int64_t>(latency) < now || scheduled > now + window)
+        {
+            offset = now + static_cast<int64_t>(latency) - target;
+            anchored = true;
+            scheduled = now + static_cast<int64_t>(latency);
+        }
+    }
+
+    pendingSample = static_cast<uint64_t>(std::max<int64_t>(scheduled, 0)); // in the past: takes effect at once
+    pendingOn = event.on;
+    hasPending = true;
+    return true;
+}
+
+WavWriter::WavWriter(SoundChannel& channel) :
+    channel{ channel },
+    synthesizer{ channel },
+    buffer(4096),
+    stopping{ false }
+{
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+bool WavWriter::open(const std::string& fileName)
+{
+    close();
+    file.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    writeWavHeader(file, channel.sampleRate, 0); // sizes are filled in by close()
+
+    stopping = false;
+    writer = std::thread{ &WavWriter::work, this };
+    return true;
+}
+
+bool WavWriter::close()
+{
+    if (!file.is_open())
+    {
+        return true;
+    }
+
+    stopping = true;
+    writer.join();
+    write(synthesizer.available());
+
+    const uint64_t bytes = synthesizer.position() * 2;
+    file.seekp(0);
+    writeWavHeader(file, channel.sampleRate, static_cast<uint32_t>(std::min<uint64_t>(bytes, 0xFFFFFFFFu - 36)));
+    file.close();
+    return !file.fail();
+}
+
+void WavWriter::work()
+{
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        write(synthesizer.available());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+void WavWriter::write(uint64_t end)
+{
+    while (synthesizer.position() < end)
+    {
+        const size_t count = static_cast<size_t>(std::min<uint64_t>(end - synthesizer.position(), buffer.size()));
+        synthesizer.render(buffer.data(), count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            putLittleEndian(file, static_cast<uint16_t>(buffer[i]), 2);
+        }
+    }
+}
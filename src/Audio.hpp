@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.hpp"
+
+const unsigned AUDIO_SAMPLE_RATE = 44100;
+const unsigned DEFAULT_AUDIO_LATENCY = 30; // milliseconds
+const unsigned MIN_AUDIO_LATENCY = 5;
+const unsigned BEEP_FREQUENCY = 440; // Hz
+const int16_t BEEP_AMPLITUDE = 6000;
+
+// The tone starts or stops at an emulated cycle: it plays while the sound timer is non-zero.
+struct SoundEvent
+{
+    uint64_t cycle;
+    bool on;
+};
+
+// Carries sound timer edges from the emulation thread to an audio consumer without either
+// side waiting: the emulator pushes events and then advances cycle, so every event up to
+// cycle has been pushed by the time the consumer sees it. Events that do not fit are dropped.
+struct SoundChannel
+{
+    explicit SoundChannel(unsigned cyclesPerSecond, unsigned sampleRate = AUDIO_SAMPLE_RATE);
+
+    void post(const SoundEvent& event); // producer only
+    uint64_t sample(uint64_t cycle) const; // sample at which an emulated cycle starts
+
+    const unsigned cyclesPerSecond;
+    const unsigned sampleRate;
+    SpscQueue<SoundEvent, 1024> events;
+    std::atomic<uint64_t> cycle; // the emulator has executed everything before this cycle
+    std::atomic<uint64_t> dropped;
+};
+
+// Square wave synthesiser fed by a SoundChannel. Each event takes effect exactly at the sample
+// its cycle maps to, and the phase keeps running across silences so restarts do not click.
+//
+// Offline (the default) the emulated timeline is rendered as is: render() may only be asked for
+// samples before available(). In realtime mode the device pulls samples at its own pace; events
+// are scheduled latency samples after the render position the first time one arrives, and again
+// whenever one falls outside the window that scheduling implies (clock drift, rewind, turbo).
+class Synthesizer
+{
+public:
+    explicit Synthesizer(SoundChannel& channel, unsigned frequency = BEEP_FREQUENCY);
+
+    void setRealtime(unsigned latencySamples);
+    void render(int16_t* samples, size_t count); // the next count samples
+    uint64_t available() const; // offline: end of the samples every event is known for
+    uint64_t position() const; // samples rendered so far
+
+private:
+    bool nextEvent(); // pops the next event into pending, scheduling it
+
+private:
+    SoundChannel& channel;
+    uint32_t phase;
+    uint32_t phaseStep; // phase advance per sample, 2^32 per period
+    bool on;
+
+    uint64_t rendered;
+    bool realtime;
+    uint64_t latency;
+    bool anchored;
+    int64_t offset; // realtime: render position minus timeline position
+
+    bool hasPending;
+    uint64_t pendingSample;
+    bool pendingOn;
+};
+
+// Headless sink: a background thread renders a SoundChannel offline into a 16-bit mono WAV file
+// as emulation progresses, so the emulation thread never waits for the disk.
+class WavWriter
+{
+public:
+    explicit WavWriter(SoundChannel& channel);
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    bool open(const std::string& fileName);
+    bool close(); // renders up to the channel's final cycle and completes the header; false on a write error
+
+private:
+    void work();
+    void write(uint64_t end); // renders and writes the samples before end
+
+private:
+    SoundChannel& channel;
+    Synthesizer synthesizer;
+    std::ofstream file;
+    std::vector<int16_t> buffer;
+    std::thread writer;
+    std::atomic<bool> stopping;
+};
@@ -0,0 +1,28 @@
+#include "AudioStream.hpp"
+
+#include <algorithm>
+
+AudioStream::AudioStream(SoundChannel& channel, unsigned latency) :
+    synthesizer{ channel }
+{
+    // the latency is split between the chunks queued in SFML and the margin by which events
+    // are scheduled ahead of the chunk being filled, which absorbs emulation thread jitter
+    const unsigned samples = channel.sampleRate * std::max(latency, MIN_AUDIO_LATENCY) / 1000;
+    const unsigned chunk = std::max(64u, samples / (QUEUED_CHUNKS + 1));
+    buffer.resize(chunk);
+    synthesizer.setRealtime(chunk);
+    initialize(1, channel.sampleRate);
+}
+
+bool AudioStream::onGetData(Chunk& data)
+{
+    synthesizer.render(buffer.data(), buffer.size());
+    data.samples = buffer.data();
+    data.sampleCount = buffer.size();
+    return true;
+}
+
+void AudioStream::onSeek(sf::Time)
+{
+    // a live stream has no position to seek to
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <SFML/Audio.hpp>
+
+#include "Audio.hpp"
+
+// Plays a SoundChannel through the sound card. SFML pulls chunks from its own thread and keeps
+// a few of them queued, so the chunk size follows from the requested latency.
+class AudioStream : public sf::SoundStream
+{
+public:
+    AudioStream(SoundChannel& channel, unsigned latency); // latency in milliseconds, at least MIN_AUDIO_LATENCY
+
+private:
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time timeOffset) override;
+
+private:
+    static const unsigned QUEUED_CHUNKS = 3; // buffers sf::SoundStream keeps in flight
+
+    Synthesizer synthesizer;
+    std::vector<int16_t> buffer;
+};
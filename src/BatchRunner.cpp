@@ -0,0 +1,261 @@
+#include "BatchRunner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "InputLog.hpp"
+#include "ThreadPool.hpp"
+
+namespace
+{
+    // The words of the rows in use, plane 1 only when anything is lit in it: a 64x32 picture
+    // drawn on plane 0 alone hashes as it did before high resolution and bitplanes existed.
+    uint64_t hashFramebuffer(const Framebuffer& framebuffer)
+    {
+        const DisplayState& display = framebuffer.state();
+        const uint64_t* second = &display.rows[1][0][0];
+        const unsigned planes = std::all_of(second, second + HIRES_DISPLAY_HEIGHT * ROW_WORDS,
+            [](uint64_t word) { return word == 0; }) ? 1 : 2;
+
+        uint64_t hash = 0xCBF29CE484222325ull; // FNV-1a
+        for (unsigned plane = 0; plane < planes; ++plane)
+        {
+            for (unsigned y = 0; y < framebuffer.height(); ++y)
+            {
+                for (unsigned word = 0; word < framebuffer.width() / 64; ++word)
+                {
+                    const uint64_t bits = display.rows[plane][y][word];
+                    for (unsigned byte = 0; byte < 8; ++byte)
+                    {
+                        hash ^= (bits >> (byte * 8)) & 0xFF;
+                        hash *= 0x100000001B3ull;
+                    }
+                }
+            }
+        }
+        return hash;
+    }
+}
+
+BatchRunner::BatchRunner(Backend backend, unsigned cyclesPerSecond) :
+    backend{ backend },
+    cyclesPerSecond{ cyclesPerSecond },
+    seed{ DEFAULT_BATCH_SEED },
+    wallSeconds{ 0.0 }
+{
+}
+
+bool BatchRunner::loadManifest(const std::string& fileName)
+{
+    std::ifstream manifest(fileName.c_str());
+    if (!manifest.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.romPath))
+        {
+            continue;
+        }
+        if (!(fields >> job.inputPath >> job.cycles))
+        {
+            return false;
+        }
+        if (job.inputPath == "-")
+        {
+            job.inputPath.clear();
+        }
+        std::string quirks;
+        if (fields >> quirks && !parseQuirkProfile(quirks, job.quirks))
+        {
+            return false;
+        }
+        addJob(job);
+    }
+    return true;
+}
+
+void BatchRunner::addJob(const BatchJob& job)
+{
+    queue.push_back(job);
+}
+
+void BatchRunner::setSeed(uint32_t seed)
+{
+    this->seed = seed;
+}
+
+void BatchRunner::run(unsigned threads)
+{
+    outcomes.assign(queue.size(), BatchResult());
+
+    // every file is read once up front; the maps are not modified while jobs run
+    std::map<std::string, std::vector<uint8_t>> images;
+    std::map<std::string, InputLog> inputs;
+    for (const BatchJob& job : queue)
+    {
+        if (images.find(job.romPath) == images.end())
+        {
+            std::ifstream rom(job.romPath.c_str(), std::ios::binary);
+            if (rom.is_open())
+            {
+                images[job.romPath].assign(std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>());
+            }
+        }
+        if (!job.inputPath.empty() && inputs.find(job.inputPath) == inputs.end())
+        {
+            InputLog input;
+            if (input.load(job.inputPath))
+            {
+                inputs[job.inputPath] = input;
+            }
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool{ threads };
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            const BatchJob& job = queue[i];
+            const auto image = images.find(job.romPath);
+            const auto input = inputs.find(job.inputPath);
+            if (image == images.end())
+            {
+                outcomes[i].error = "unable to open ROM";
+            }
+            else if (!job.inputPath.empty() && input == inputs.end())
+            {
+                outcomes[i].error = "unable to read input log";
+            }
+            else
+            {
+                const std::vector<uint8_t>* rom = &image->second;
+                const InputLog* log = (input == inputs.end()) ? nullptr : &input->second;
+                const uint32_t jobSeed = seed + static_cast<uint32_t>(i);
+                pool.submit([this, i, jobSeed, rom, log] { outcomes[i] = runJob(queue[i], jobSeed, *rom, log); });
+            }
+        }
+        pool.wait();
+    }
+    wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BatchRunner::printResults(std::ostream& out) const
+{
+    uint64_t totalCycles = 0;
+    size_t failures = 0;
+
+    for (size_t i = 0; i < outcomes.size(); ++i)
+    {
+        const BatchJob& job = queue[i];
+        const BatchResult& result = outcomes[i];
+        out << job.romPath << ' ' << (job.inputPath.empty() ? "-" : job.inputPath) << ' ';
+        if (!result.ok)
+        {
+            out << "error: " << result.error << '\n';
+            ++failures;
+            continue;
+        }
+
+        std::ostringstream line;
+        line << std::hex << std::uppercase << std::setfill('0')
+            << "fb=" << std::setw(16) << result.framebufferHash
+            << " pc=" << std::setw(3) << result.pc
+            << " I=" << std::setw(3) << result.I << " V=";
+        for (uint8_t value : result.V)
+        {
+            line << std::setw(2) << static_cast<unsigned>(value);
+        }
+        out << line.str() << " cycles=" << result.cycles << " time=" << result.seconds << '\n';
+        totalCycles += result.cycles;
+    }
+
+    out << "jobs: " << outcomes.size() << " failed: " << failures
+        << " wall time: " << wallSeconds << " s"
+        << " aggregate IPS: " << static_cast<uint64_t>(totalCycles / std::max(wallSeconds, 1e-9)) << std::endl;
+}
+
+const std::vector<BatchJob>& BatchRunner::jobs() const
+{
+    return queue;
+}
+
+const std::vector<BatchResult>& BatchRunner::results() const
+{
+    return outcomes;
+}
+
+BatchResult BatchRunner::runJob(const BatchJob& job, uint32_t seed, const std::vector<uint8_t>& image, const InputLog* input) const
+{
+    BatchResult result;
+    try
+    {
+        std::unique_ptr<Emulator> emulator{ new Emulator(cyclesPerSecond) };
+        emulator->setQuirks(job.quirks); // sizes memory, so before the ROM goes in
+        if (!emulator->loadROM(image))
+        {
+            result.error = "ROM image is too big";
+            return result;
+        }
+        emulator->setBackend(backend);
+        emulator->setSeed(seed);
+
+        uint64_t cycles = job.cycles;
+        if (input)
+        {
+            // a recorded session replays under the conditions it was recorded with
+            if (input->hasSeed())
+            {
+                emulator->setSeed(input->seed());
+            }
+            if (input->clock() != 0)
+            {
+                emulator->setClock(input->clock());
+            }
+            if (cycles == 0)
+            {
+                cycles = input->length();
+            }
+            emulator->setReplay(input);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        emulator->runCycles(cycles);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const CPU& cpu = emulator->cpu();
+        result.cycles = emulator->cycles();
+        result.framebufferHash = hashFramebuffer(cpu.display);
+        result.pc = cpu.programCounter();
+        result.I = cpu.indexRegister();
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            result.V[i] = cpu.registerValue(i);
+        }
+        result.ok = true;
+    }
+    catch (const std::runtime_error& error)
+    {
+        result.error = error.what();
+    }
+    return result;
+}
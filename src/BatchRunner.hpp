@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "InputLog.hpp"
+
+const uint32_t DEFAULT_BATCH_SEED = 0;
+
+struct BatchJob
+{
+    std::string romPath;
+    std::string inputPath; // empty: no input
+    uint64_t cycles; // 0: the length of the input log
+    QuirkProfile quirks = QuirkProfile::Default;
+};
+
+struct BatchResult
+{
+    bool ok = false;
+    std::string error;
+    uint64_t cycles = 0;
+    double seconds = 0.0;
+    uint64_t framebufferHash = 0;
+    uint16_t pc = 0;
+    uint16_t I = 0;
+    uint8_t V[16] = {};
+};
+
+// Runs many independent headless machines on a work-stealing ThreadPool. Every job gets
+// its own Emulator; ROM images and input logs are read once and shared read-only. Job i is
+// seeded with the batch seed plus i, or with the seed its input log was recorded with, so a
+// batch gives the same results on every run.
+class BatchRunner
+{
+public:
+    BatchRunner(Backend backend, unsigned cyclesPerSecond);
+
+    // manifest: one job per line, "<rom> <input log or -> <cycles> [quirks]" with quirks as for
+    // parseQuirkProfile; '#' starts a comment
+    bool loadManifest(const std::string& fileName);
+    void addJob(const BatchJob& job);
+    void setSeed(uint32_t seed); // the batch seed, DEFAULT_BATCH_SEED if never set
+
+    void run(unsigned threads); // 0 = one worker per hardware thread
+    void printResults(std::ostream& out) const;
+
+    const std::vector<BatchJob>& jobs() const;
+    const std::vector<BatchResult>& results() const;
+
+private:
+    BatchResult runJob(const BatchJob& job, uint32_t seed, const std::vector<uint8_t>& image, const InputLog* input) const;
+
+private:
+    Backend backend;
+    unsigned cyclesPerSecond;
+    uint32_t seed;
+    std::vector<BatchJob> queue;
+    std::vector<BatchResult> outcomes;
+    double wallSeconds;
+};
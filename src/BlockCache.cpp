@@ -0,0 +1,118 @@
+#include "BlockCache.hpp"
+
+#include <algorithm>
+
+BlockCache::BlockCache(CPU& cpu) :
+    cpu{ cpu }
+{
+    clear();
+}
+
+unsigned BlockCache::run(unsigned budget)
+{
+    unsigned executed = 0;
+    while (executed < budget)
+    {
+        // FX33/FX55 only write in the last op of a block, and restores happen between runs,
+        // so dropping blocks before each lookup never pulls one out from under its caller
+        invalidateWrites();
+
+        const Block& block = lookup(cpu.programCounter());
+        const unsigned count = std::min<unsigned>(static_cast<unsigned>(block.ops.size()), budget - executed);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            cpu.execute(block.ops[i]);
+        }
+        executed += count;
+    }
+    return executed;
+}
+
+void BlockCache::invalidateWrites()
+{
+    unsigned begin;
+    unsigned end;
+    if (cpu.takeMemoryWrite(begin, end))
+    {
+        invalidate(begin, end);
+    }
+}
+
+void BlockCache::clear()
+{
+    // sized here since the memory size follows the quirk profile
+    blocks.clear();
+    blocks.resize(cpu.memory.size());
+    decoded.assign(cpu.memory.size(), 0);
+
+    unsigned begin;
+    unsigned end;
+    cpu.takeMemoryWrite(begin, end);
+}
+
+BlockCache::Block& BlockCache::lookup(uint16_t address)
+{
+    if (address >= blocks.size())
+    {
+        // pc ran past the end of memory: a single instruction, fetched wrapped around and
+        // rebuilt at every lookup, since no write to memory can invalidate it
+        outside.start = address;
+        outside.end = address;
+        outside.ops.assign(1, cpu.decode(cpu.fetch(address)));
+        outside.native = nullptr;
+        outside.nativeLength = 0;
+        return outside;
+    }
+
+    std::unique_ptr<Block>& block = blocks[address];
+    if (block)
+    {
+        return *block;
+    }
+
+    block.reset(new Block);
+    block->start = address;
+    unsigned pc = address;
+    while (pc < blocks.size() && block->ops.size() < MAX_BLOCK_LENGTH)
+    {
+        const CPU::Instruction op = cpu.decode(cpu.fetch(pc));
+        block->ops.push_back(op);
+        pc += 2;
+        if (CPU::endsBlock(op))
+        {
+            break;
+        }
+    }
+    block->end = std::min<unsigned>(pc, static_cast<unsigned>(blocks.size()));
+
+    for (unsigned i = block->start; i < block->end; ++i)
+    {
+        ++decoded[i];
+    }
+    return *block;
+}
+
+void BlockCache::invalidate(unsigned begin, unsigned end)
+{
+    end = std::min(end, static_cast<unsigned>(decoded.size()));
+    const bool covered = std::any_of(std::begin(decoded) + begin, std::begin(decoded) + end,
+        [](uint8_t count) { return count != 0; });
+    if (!covered)
+    {
+        return;
+    }
+
+    const unsigned first = (begin > 2 * MAX_BLOCK_LENGTH) ? begin - 2 * MAX_BLOCK_LENGTH : 0;
+    for (unsigned start = first; start < end; ++start)
+    {
+        std::unique_ptr<Block>& block = blocks[start];
+        if (block && block->end > begin)
+        {
+            for (unsigned i = block->start; i < block->end; ++i)
+            {
+                --decoded[i];
+            }
+            block.reset();
+        }
+    }
+}
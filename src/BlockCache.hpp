@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "CPU.hpp"
+
+// Cached interpreter: decodes straight-line runs of instructions once per entry pc
+// and replays the predecoded handlers. Blocks end with the first instruction that
+// can redirect pc (see CPU::endsBlock) and are dropped when FX33/FX55 write into them.
+class BlockCache
+{
+public:
+    explicit BlockCache(CPU& cpu);
+
+    struct Block
+    {
+        uint16_t start;
+        unsigned end; // one past the last byte decoded
+        std::vector<CPU::Instruction> ops;
+        void* native = nullptr; // translated code owned by the Jit, if any
+        uint16_t nativeLength = 0; // number of leading ops covered by native
+    };
+
+    unsigned run(unsigned budget); // executes up to budget (>= 1) instructions, returns how many ran
+    void clear(); // must be called after memory is modified outside of the CPU (e.g. a ROM load)
+
+    Block& lookup(uint16_t address);
+    void invalidateWrites(); // drops blocks overlapping memory recorded by CPU::recordMemoryWrite since the last call
+
+private:
+    void invalidate(unsigned begin, unsigned end);
+
+private:
+    static const unsigned MAX_BLOCK_LENGTH = 64;
+
+    CPU& cpu;
+    std::vector<std::unique_ptr<Block>> blocks; // indexed by entry pc
+    std::vector<uint8_t> decoded; // number of blocks covering each memory byte
+    Block outside; // the latest lookup past the end of memory
+};
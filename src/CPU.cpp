@@ -1,26 +1,104 @@
 #include "CPU.hpp"
+#include "Snapshot.hpp"
 
-#include <array>
-#include <map>
-#include <functional>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // instructions whose only inputs and outputs are V, I, pc, the timers and the keypad
+    bool touchesOnlyRegisters(uint16_t opcode)
+    {
+        const unsigned n = opcode & 0x000F;
+        const unsigned nn = opcode & 0x00FF;
+
+        switch ((opcode & 0xF000) >> 12)
+        {
+        case 0x1: case 0x3: case 0x4: case 0x6: case 0x7: case 0xA: case 0xB:
+            return true;
+        case 0x5: case 0x9:
+            return n == 0x0;
+        case 0x8:
+            return n <= 0x7 || n == 0xE;
+        case 0xE:
+            return nn == 0x9E || nn == 0xA1;
+        case 0xF:
+            return nn == 0x07 || nn == 0x0A || nn == 0x15 || nn == 0x18 || nn == 0x1E || nn == 0x29;
+        default:
+            return false;
+        }
+    }
+}
+
+Memory::Memory() :
+    bytes{ local },
+    mask{ MEMORY_SIZE - 1 }
+{
+    std::fill(std::begin(local), std::end(local), 0);
+}
+
+Memory::Memory(const Memory& other) :
+    Memory()
+{
+    *this = other;
+}
+
+Memory& Memory::operator=(const Memory& other)
+{
+    if (this != &other)
+    {
+        resize(other.size());
+        std::copy_n(other.bytes, other.size(), bytes);
+    }
+    return *this;
+}
+
+void Memory::resize(unsigned size)
+{
+    if (size == this->size())
+    {
+        return;
+    }
+    if (size > MEMORY_SIZE)
+    {
+        extended.reset(new uint8_t[size]());
+        std::copy(std::begin(local), std::end(local), extended.get());
+        bytes = extended.get();
+    }
+    else
+    {
+        std::copy_n(extended.get(), MEMORY_SIZE, local);
+        extended.reset();
+        bytes = local;
+    }
+    mask = size - 1;
+}
 
 CPU::CPU() :
     engine{ std::random_device()() },
-    distribution{ 0, 0xFF }
+    distribution{ 0, 0xFF },
+    profile{ QuirkProfile::Default },
+    decoder{ &CPU::decodeFor<QuirkProfile::Default> }
 {
     pc = PROGRAM_MEMORY_OFFSET;
     sp = 0;
     I = 0;
 
-    std::fill(std::begin(memory), std::end(memory), 0);
     std::fill(std::begin(V), std::end(V), 0);
     std::fill(std::begin(stack), std::end(stack), 0);
-    std::fill(std::begin(display), std::end(display), 0);
     std::fill(std::begin(keypad), std::end(keypad), 0);
+    std::fill(std::begin(flags), std::end(flags), 0);
 
     delayTimer = 0;
     soundTimer = 0;
-    drawFlag = false;
+
+    writeBegin = XO_CHIP_MEMORY_SIZE;
+    writeEnd = 0;
+
+    dirtyPages.set();
+    randomDraws = 0;
 
     const int FONTSET_SIZE = 80;
     unsigned char fontset[FONTSET_SIZE] =
@@ -47,14 +125,73 @@ CPU::CPU() :
     {
         memory[i] = fontset[i];
     }
+
+    const int BIG_FONTSET_SIZE = 160;
+    unsigned char bigFontset[BIG_FONTSET_SIZE] =
+    {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+
+    for (unsigned int i = 0; i < BIG_FONTSET_SIZE; ++i)
+    {
+        memory[BIG_FONT_ADDRESS + i] = bigFontset[i];
+    }
+}
+
+void CPU::seed(uint32_t value)
+{
+    engine.seed(value);
+    distribution.reset();
+    ++randomDraws; // keeps snapshots from sharing the previous engine state
+}
+
+void CPU::setQuirks(QuirkProfile profile)
+{
+    this->profile = profile;
+    switch (profile)
+    {
+    case QuirkProfile::Default: decoder = &CPU::decodeFor<QuirkProfile::Default>; break;
+    case QuirkProfile::CosmacVip: decoder = &CPU::decodeFor<QuirkProfile::CosmacVip>; break;
+    case QuirkProfile::Chip48: decoder = &CPU::decodeFor<QuirkProfile::Chip48>; break;
+    case QuirkProfile::SuperChip: decoder = &CPU::decodeFor<QuirkProfile::SuperChip>; break;
+    case QuirkProfile::XoChip: decoder = &CPU::decodeFor<QuirkProfile::XoChip>; break;
+    }
+    display.setSpriteEdge(quirksOf(profile).spriteEdge);
+
+    if (memory.size() != memorySizeOf(profile))
+    {
+        memory.resize(memorySizeOf(profile));
+        recordMemoryWrite(0, memory.size());
+        baseline.reset(); // its page table covers the previous size
+    }
+}
+
+QuirkProfile CPU::quirks() const
+{
+    return profile;
 }
 
 void CPU::emulateCycle()
 {
     // fetch opcode
-    uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
-    // process opcode
-    processOpcode(opcode);
+    uint16_t opcode = fetch(pc);
+    // decode and process opcode
+    execute(decode(opcode));
 }
 
 void CPU::decrementTimers()
@@ -70,11 +207,43 @@ void CPU::decrementTimers()
     }
 }
 
-bool CPU::redraw()
+unsigned CPU::skipIdleLoop(unsigned limit, unsigned& skipped)
 {
-    bool old = drawFlag;
-    drawFlag = false;
-    return old;
+    const uint16_t start = pc;
+    skipped = 0;
+    unsigned executed = 0;
+
+    // the first iteration after a timer tick or key change usually picks the change up,
+    // the second one shows whether the loop has settled
+    for (unsigned iteration = 0; iteration < 2; ++iteration)
+    {
+        uint8_t registers[16];
+        std::copy(std::begin(V), std::end(V), std::begin(registers));
+        const uint16_t index = I;
+        const uint8_t delay = delayTimer;
+        const uint8_t sound = soundTimer;
+
+        unsigned length = 0;
+        do
+        {
+            const uint16_t opcode = fetch(pc);
+            if (executed == limit || length == MAX_IDLE_LOOP || !touchesOnlyRegisters(opcode))
+            {
+                return executed;
+            }
+            execute(decode(opcode));
+            ++executed;
+            ++length;
+        } while (pc != start);
+
+        if (I == index && delayTimer == delay && soundTimer == sound
+            && std::equal(std::begin(V), std::end(V), std::begin(registers)))
+        {
+            skipped = (limit - executed) / length * length;
+            return executed + skipped;
+        }
+    }
+    return executed;
 }
 
 bool CPU::playSound() const
@@ -82,121 +251,437 @@ bool CPU::playSound() const
     return (soundTimer == 1);
 }
 
-void CPU::processOpcode(uint16_t opcode)
-{
-    static const std::array<std::function<void()>, 16> opcodeFunctions =
-    {
-        [&]() { process_00EN(opcode); },
-        [&]() { process_1NNN(opcode); },
-        [&]() { process_2NNN(opcode); },
-        [&]() { process_3XNN(opcode); },
-        [&]() { process_4XNN(opcode); },
-        [&]() { process_5XY0(opcode); },
-        [&]() { process_6XNN(opcode); },
-        [&]() { process_7XNN(opcode); },
-        [&]() { process_8XYN(opcode); },
-        [&]() { process_9XY0(opcode); },
-        [&]() { process_ANNN(opcode); },
-        [&]() { process_BNNN(opcode); },
-        [&]() { process_CXNN(opcode); },
-        [&]() { process_DXYN(opcode); },
-        [&]() { process_EXNN(opcode); },
-        [&]() { process_FXNN(opcode); }
-    };
+bool CPU::soundOn() const
+{
+    return soundTimer > 0;
+}
+
+void CPU::printState(std::ostream& out) const
+{
+    const std::ios_base::fmtflags flags = out.flags();
+    const char fill = out.fill('0');
+
+    out << std::hex << std::uppercase
+        << "PC: 0x" << std::setw(3) << pc
+        << " I: 0x" << std::setw(3) << I
+        << " SP: " << static_cast<unsigned>(sp)
+        << " DT: " << std::setw(2) << static_cast<unsigned>(delayTimer)
+        << " ST: " << std::setw(2) << static_cast<unsigned>(soundTimer) << '\n';
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        out << 'V' << i << ": " << std::setw(2) << static_cast<unsigned>(V[i]) << ((i % 8 == 7) ? '\n' : ' ');
+    }
+
+    out.fill(fill);
+    out.flags(flags);
+}
 
-    uint8_t nibble = (opcode & 0xF000) >> 12;
-    opcodeFunctions.at(nibble)();
+bool CPU::sameState(const CPU& other) const
+{
+    return memory.size() == other.memory.size()
+        && std::equal(&memory[0], &memory[memory.size()], &other.memory[0])
+        && display == other.display
+        && std::equal(std::begin(V), std::end(V), std::begin(other.V))
+        && std::equal(std::begin(stack), std::end(stack), std::begin(other.stack))
+        && std::equal(std::begin(flags), std::end(flags), std::begin(other.flags))
+        && I == other.I && pc == other.pc && sp == other.sp
+        && delayTimer == other.delayTimer && soundTimer == other.soundTimer
+        && engine == other.engine;
+}
+
+CPU::Instruction CPU::decode(uint16_t opcode) const
+{
+    return decoder(opcode);
 }
 
-void CPU::process_00EN(uint16_t opcode)
+CPU::Instruction CPU::decode(uint16_t opcode, QuirkProfile profile)
 {
-    uint8_t nibble = opcode & 0x000F;
-    static const std::map<uint8_t, std::function<void()>> opcodeFunctions =
+    switch (profile)
     {
-        { 0x0, [&]() { process_00E0(opcode); } },
-        { 0xE, [&]() { process_00EE(opcode); } }
-    };
-    opcodeFunctions.at(nibble)();
+    case QuirkProfile::CosmacVip: return decodeFor<QuirkProfile::CosmacVip>(opcode);
+    case QuirkProfile::Chip48: return decodeFor<QuirkProfile::Chip48>(opcode);
+    case QuirkProfile::SuperChip: return decodeFor<QuirkProfile::SuperChip>(opcode);
+    case QuirkProfile::XoChip: return decodeFor<QuirkProfile::XoChip>(opcode);
+    default: return decodeFor<QuirkProfile::Default>(opcode);
+    }
 }
 
-void CPU::process_8XYN(uint16_t opcode)
+template <QuirkProfile Profile>
+CPU::Instruction CPU::decodeFor(uint16_t opcode)
 {
-    uint8_t nibble = opcode & 0x000F;
-    static const std::map<uint8_t, std::function<void()>> opcodeFunctions =
+    Instruction op;
+    op.opcode = opcode;
+    op.nnn = opcode & 0x0FFF;
+    op.nn = opcode & 0x00FF;
+    op.n = opcode & 0x000F;
+    op.x = (opcode & 0x0F00) >> 8;
+    op.y = (opcode & 0x00F0) >> 4;
+    op.handler = &CPU::process_unknown;
+
+    switch ((opcode & 0xF000) >> 12)
     {
-        { 0x0, [&]() { process_8XY0(opcode); } },
-        { 0x1, [&]() { process_8XY1(opcode); } },
-        { 0x2, [&]() { process_8XY2(opcode); } },
-        { 0x3, [&]() { process_8XY3(opcode); } },
-        { 0x4, [&]() { process_8XY4(opcode); } },
-        { 0x5, [&]() { process_8XY5(opcode); } },
-        { 0x6, [&]() { process_8XY6(opcode); } },
-        { 0x7, [&]() { process_8XY7(opcode); } },
-        { 0xE, [&]() { process_8XYE(opcode); } }
-    };
-    opcodeFunctions.at(nibble)();
+    case 0x0:
+        if (quirksOf(Profile).superChipOpcodes && (opcode & 0x0FF0) == 0x00C0)
+        {
+            op.handler = &CPU::process_00CN;
+        }
+        else if (quirksOf(Profile).xoChipOpcodes && (opcode & 0x0FF0) == 0x00D0)
+        {
+            op.handler = &CPU::process_00DN;
+        }
+        else if (quirksOf(Profile).superChipOpcodes && (opcode & 0x0FF0) == 0x00F0)
+        {
+            switch (op.n)
+            {
+            case 0xB: op.handler = &CPU::process_00FB; break;
+            case 0xC: op.handler = &CPU::process_00FC; break;
+            case 0xD: op.handler = &CPU::process_00FD; break;
+            case 0xE: op.handler = &CPU::process_00FE; break;
+            case 0xF: op.handler = &CPU::process_00FF; break;
+            }
+        }
+        else
+        {
+            switch (op.n)
+            {
+            case 0x0: op.handler = &CPU::process_00E0; break;
+            case 0xE: op.handler = &CPU::process_00EE; break;
+            }
+        }
+        break;
+    case 0x1: op.handler = &CPU::process_1NNN; break;
+    case 0x2: op.handler = &CPU::process_2NNN; break;
+    case 0x3: op.handler = &CPU::process_3XNN<Profile>; break;
+    case 0x4: op.handler = &CPU::process_4XNN<Profile>; break;
+    case 0x5:
+        if (quirksOf(Profile).xoChipOpcodes && (op.n == 0x2 || op.n == 0x3))
+        {
+            op.handler = (op.n == 0x2) ? &CPU::process_5XY2 : &CPU::process_5XY3;
+        }
+        else
+        {
+            op.handler = &CPU::process_5XY0<Profile>;
+        }
+        break;
+    case 0x6: op.handler = &CPU::process_6XNN; break;
+    case 0x7: op.handler = &CPU::process_7XNN; break;
+    case 0x8:
+        switch (op.n)
+        {
+        case 0x0: op.handler = &CPU::process_8XY0; break;
+        case 0x1: op.handler = &CPU::process_8XY1<Profile>; break;
+        case 0x2: op.handler = &CPU::process_8XY2<Profile>; break;
+        case 0x3: op.handler = &CPU::process_8XY3<Profile>; break;
+        case 0x4: op.handler = &CPU::process_8XY4; break;
+        case 0x5: op.handler = &CPU::process_8XY5; break;
+        case 0x6: op.handler = &CPU::process_8XY6<Profile>; break;
+        case 0x7: op.handler = &CPU::process_8XY7; break;
+        case 0xE: op.handler = &CPU::process_8XYE<Profile>; break;
+        }
+        break;
+    case 0x9: op.handler = &CPU::process_9XY0<Profile>; break;
+    case 0xA: op.handler = &CPU::process_ANNN; break;
+    case 0xB: op.handler = &CPU::process_BNNN<Profile>; break;
+    case 0xC: op.handler = &CPU::process_CXNN; break;
+    case 0xD: op.handler = &CPU::process_DXYN<Profile>; break;
+    case 0xE:
+        switch (op.nn)
+        {
+        case 0x9E: op.handler = &CPU::process_EX9E<Profile>; break;
+        case 0xA1: op.handler = &CPU::process_EXA1<Profile>; break;
+        }
+        break;
+    case 0xF:
+        switch (op.nn)
+        {
+        case 0x00:
+            if (quirksOf(Profile).xoChipOpcodes && op.x == 0x0)
+            {
+                op.handler = &CPU::process_F000;
+            }
+            break;
+        case 0x01:
+            if (quirksOf(Profile).xoChipOpcodes)
+            {
+                op.handler = &CPU::process_FN01;
+            }
+            break;
+        case 0x07: op.handler = &CPU::process_FX07; break;
+        case 0x0A: op.handler = &CPU::process_FX0A; break;
+        case 0x15: op.handler = &CPU::process_FX15; break;
+        case 0x18: op.handler = &CPU::process_FX18; break;
+        case 0x1E: op.handler = &CPU::process_FX1E; break;
+        case 0x29: op.handler = &CPU::process_FX29; break;
+        case 0x30:
+            if (quirksOf(Profile).superChipOpcodes)
+            {
+                op.handler = &CPU::process_FX30;
+            }
+            break;
+        case 0x33: op.handler = &CPU::process_FX33; break;
+        case 0x55: op.handler = &CPU::process_FX55<Profile>; break;
+        case 0x65: op.handler = &CPU::process_FX65<Profile>; break;
+        case 0x75:
+        case 0x85:
+            if (quirksOf(Profile).superChipOpcodes)
+            {
+                op.handler = (op.nn == 0x75) ? &CPU::process_FX75 : &CPU::process_FX85;
+            }
+            break;
+        }
+        break;
+    }
+    return op;
 }
 
-void CPU::process_EXNN(uint16_t opcode)
+bool CPU::isUnknown(const Instruction& op)
 {
-    uint8_t byte = opcode & 0x00FF;
-    static const std::map<uint8_t, std::function<void()>> opcodeFunctions =
+    return op.handler == &CPU::process_unknown;
+}
+
+bool CPU::endsBlock(const Instruction& op)
+{
+    switch ((op.opcode & 0xF000) >> 12)
     {
-        { 0x9E, [&]() { process_EX9E(opcode); } },
-        { 0xA1, [&]() { process_EXA1(opcode); } }
-    };
-    opcodeFunctions.at(byte)();
+    case 0x0: // 00FD does not advance pc
+        return op.handler == &CPU::process_00EE || op.handler == &CPU::process_00FD;
+    case 0x1:
+    case 0x2:
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    case 0xB:
+    case 0xE:
+        return true;
+    case 0xF: // FX0A may not advance pc, F000 NNNN advances it by 4, FX33 and FX55 may rewrite the block being executed
+        return op.nn == 0x0A || op.nn == 0x33 || op.nn == 0x55 || op.handler == &CPU::process_F000;
+    default:
+        return false;
+    }
 }
 
-void CPU::process_FXNN(uint16_t opcode)
+void CPU::execute(const Instruction& op)
 {
-    uint8_t byte = opcode & 0x00FF;
-    static const std::map<uint8_t, std::function<void()>> opcodeFunctions =
+    (this->*op.handler)(op);
+}
+
+uint16_t CPU::programCounter() const
+{
+    return pc;
+}
+
+uint16_t CPU::indexRegister() const
+{
+    return I;
+}
+
+uint8_t CPU::registerValue(unsigned index) const
+{
+    return V[index & 0xF];
+}
+
+uint16_t CPU::fetch(unsigned address) const
+{
+    return memory[memory.wrap(address)] << 8 | memory[memory.wrap(address + 1)];
+}
+
+bool CPU::takeMemoryWrite(unsigned& begin, unsigned& end)
+{
+    if (writeBegin >= writeEnd)
     {
-        { 0x07, [&]() { process_FX07(opcode); } },
-        { 0x0A, [&]() { process_FX0A(opcode); } },
-        { 0x15, [&]() { process_FX15(opcode); } },
-        { 0x18, [&]() { process_FX18(opcode); } },
-        { 0x1E, [&]() { process_FX1E(opcode); } },
-        { 0x29, [&]() { process_FX29(opcode); } },
-        { 0x33, [&]() { process_FX33(opcode); } },
-        { 0x55, [&]() { process_FX55(opcode); } },
-        { 0x65, [&]() { process_FX65(opcode); } }
-    };
-    opcodeFunctions.at(byte)();
+        return false;
+    }
+    begin = writeBegin;
+    end = writeEnd;
+    writeBegin = XO_CHIP_MEMORY_SIZE;
+    writeEnd = 0;
+    return true;
+}
+
+void CPU::recordMemoryWrite(unsigned address, unsigned size)
+{
+    // FX33, FX55 and 5XY2 may run past the end of memory and go on at address 0; as part of
+    // a single range that is all of memory, rare enough not to track the two pieces apart
+    address = memory.wrap(address);
+    const bool wraps = address + size > memory.size();
+    writeBegin = wraps ? 0 : std::min<unsigned>(writeBegin, address);
+    writeEnd = wraps ? memory.size() : std::max<unsigned>(writeEnd, address + size);
+
+    for (unsigned page = address / Snapshot::PAGE_SIZE; page <= (address + size - 1) / Snapshot::PAGE_SIZE; ++page)
+    {
+        dirtyPages.set(page % (memory.size() / Snapshot::PAGE_SIZE));
+    }
+}
+
+std::shared_ptr<Snapshot> CPU::snapshot()
+{
+    // built in place, so keeping it as the baseline shares rather than copies the page table
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    snapshot->memory.resize(memory.size() / Snapshot::PAGE_SIZE);
+    for (unsigned page = 0; page < snapshot->memory.size(); ++page)
+    {
+        if (baseline && !dirtyPages.test(page))
+        {
+            snapshot->memory[page] = baseline->memory[page];
+            continue;
+        }
+        std::shared_ptr<Snapshot::Page> copy = std::make_shared<Snapshot::Page>();
+        std::copy_n(memory + page * Snapshot::PAGE_SIZE, Snapshot::PAGE_SIZE, copy->begin());
+        snapshot->memory[page] = copy;
+    }
+    snapshot->engine = (baseline && baseline->randomDraws == randomDraws)
+        ? baseline->engine
+        : std::make_shared<const std::mt19937>(engine);
+    snapshot->randomDraws = randomDraws;
+
+    snapshot->display = display.state();
+    std::copy(std::begin(keypad), std::end(keypad), std::begin(snapshot->keypad));
+    std::copy(std::begin(V), std::end(V), std::begin(snapshot->V));
+    snapshot->I = I;
+    snapshot->pc = pc;
+    std::copy(std::begin(stack), std::end(stack), std::begin(snapshot->stack));
+    snapshot->sp = sp;
+    std::copy(std::begin(flags), std::end(flags), std::begin(snapshot->flags));
+    snapshot->delayTimer = delayTimer;
+    snapshot->soundTimer = soundTimer;
+
+    dirtyPages.reset();
+    baseline = snapshot;
+    return snapshot;
 }
 
-void CPU::process_00E0(uint16_t opcode)
+void CPU::restore(const std::shared_ptr<const Snapshot>& snapshot)
 {
-    std::fill(std::begin(display), std::end(display), 0);
-    drawFlag = true;
+    // a snapshot of a differently sized memory fills what both have; the rest is zero
+    const Snapshot::Page zero = {};
+    for (unsigned page = 0; page < memory.size() / Snapshot::PAGE_SIZE; ++page)
+    {
+        if (baseline && !dirtyPages.test(page) && page < snapshot->memory.size() && baseline->memory[page] == snapshot->memory[page])
+        {
+            continue;
+        }
+        const Snapshot::Page& bytes = (page < snapshot->memory.size()) ? *snapshot->memory[page] : zero;
+        std::copy(bytes.begin(), bytes.end(), memory + page * Snapshot::PAGE_SIZE);
+        recordMemoryWrite(page * Snapshot::PAGE_SIZE, Snapshot::PAGE_SIZE); // lets the block caches drop stale code
+    }
+    if (!baseline || randomDraws != baseline->randomDraws || baseline->engine != snapshot->engine)
+    {
+        engine = *snapshot->engine;
+    }
+    randomDraws = snapshot->randomDraws;
+
+    if (display.state() != snapshot->display)
+    {
+        display.setState(snapshot->display);
+    }
+    std::copy(std::begin(snapshot->keypad), std::end(snapshot->keypad), std::begin(keypad));
+    std::copy(std::begin(snapshot->V), std::end(snapshot->V), std::begin(V));
+    I = snapshot->I;
+    pc = snapshot->pc;
+    std::copy(std::begin(snapshot->stack), std::end(snapshot->stack), std::begin(stack));
+    sp = snapshot->sp;
+    std::copy(std::begin(snapshot->flags), std::end(snapshot->flags), std::begin(flags));
+    delayTimer = snapshot->delayTimer;
+    soundTimer = snapshot->soundTimer;
+
+    // a page table of another size cannot lend its pages to the next snapshot
+    const bool sameSize = snapshot->memory.size() == memory.size() / Snapshot::PAGE_SIZE;
+    dirtyPages.reset();
+    if (!sameSize)
+    {
+        dirtyPages.set();
+    }
+    baseline = sameSize ? snapshot : nullptr;
+}
+
+template <QuirkProfile Profile>
+unsigned CPU::skipLength() const
+{
+    // F000 NNNN is the only instruction longer than two bytes
+    const bool longNext = quirksOf(Profile).longSkips && fetch(pc + 2) == 0xF000;
+    return longNext ? 6 : 4;
+}
+
+void CPU::process_unknown(const Instruction& op)
+{
+    std::ostringstream message;
+    message << "Unknown opcode 0x" << std::hex << std::uppercase << std::setfill('0')
+        << std::setw(4) << op.opcode << " at address 0x" << std::setw(3) << pc;
+    throw std::runtime_error(message.str());
+}
+
+void CPU::process_00CN(const Instruction& op)
+{
+    display.scrollDown(op.n);
+    pc += 2;
+}
+
+void CPU::process_00DN(const Instruction& op)
+{
+    display.scrollUp(op.n);
     pc += 2;
 }
 
-void CPU::process_00EE(uint16_t opcode)
+void CPU::process_00E0(const Instruction&)
+{
+    display.clear();
+    pc += 2;
+}
+
+void CPU::process_00EE(const Instruction&)
 {
     --sp;
     pc = stack[sp];
     pc += 2;
 }
 
-void CPU::process_1NNN(uint16_t opcode)
+void CPU::process_00FB(const Instruction&)
+{
+    display.scrollRight();
+    pc += 2;
+}
+
+void CPU::process_00FC(const Instruction&)
 {
-    pc = opcode & 0x0FFF;
+    display.scrollLeft();
+    pc += 2;
 }
 
-void CPU::process_2NNN(uint16_t opcode)
+void CPU::process_00FD(const Instruction&)
+{
+}
+
+void CPU::process_00FE(const Instruction&)
+{
+    display.setHires(false);
+    pc += 2;
+}
+
+void CPU::process_00FF(const Instruction&)
+{
+    display.setHires(true);
+    pc += 2;
+}
+
+void CPU::process_1NNN(const Instruction& op)
+{
+    pc = op.nnn;
+}
+
+void CPU::process_2NNN(const Instruction& op)
 {
     stack[sp] = pc;
     ++sp;
-    pc = opcode & 0x0FFF;
+    pc = op.nnn;
 }
 
-void CPU::process_3XNN(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_3XNN(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
+    if (V[op.x] == op.nn)
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
@@ -204,11 +689,12 @@ void CPU::process_3XNN(uint16_t opcode)
     }
 }
 
-void CPU::process_4XNN(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_4XNN(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
+    if (V[op.x] != op.nn)
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
@@ -216,11 +702,12 @@ void CPU::process_4XNN(uint16_t opcode)
     }
 }
 
-void CPU::process_5XY0(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_5XY0(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
+    if (V[op.x] == V[op.y])
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
@@ -228,45 +715,91 @@ void CPU::process_5XY0(uint16_t opcode)
     }
 }
 
-void CPU::process_6XNN(uint16_t opcode)
+void CPU::process_5XY2(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
+    const int step = (op.x <= op.y) ? 1 : -1;
+    unsigned address = I;
+    for (int i = op.x; ; i += step, ++address)
+    {
+        memory[memory.wrap(address)] = V[i];
+        if (i == op.y)
+        {
+            break;
+        }
+    }
+    recordMemoryWrite(I, address - I + 1);
     pc += 2;
 }
 
-void CPU::process_7XNN(uint16_t opcode)
+void CPU::process_5XY3(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] += opcode & 0x00FF;
+    const int step = (op.x <= op.y) ? 1 : -1;
+    unsigned address = I;
+    for (int i = op.x; ; i += step, ++address)
+    {
+        V[i] = memory[memory.wrap(address)];
+        if (i == op.y)
+        {
+            break;
+        }
+    }
     pc += 2;
 }
 
-void CPU::process_8XY0(uint16_t opcode)
+void CPU::process_6XNN(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
+    V[op.x] = op.nn;
     pc += 2;
 }
 
-void CPU::process_8XY1(uint16_t opcode)
+void CPU::process_7XNN(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
+    V[op.x] += op.nn;
     pc += 2;
 }
 
-void CPU::process_8XY2(uint16_t opcode)
+void CPU::process_8XY0(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] &= V[(opcode & 0x00F0) >> 4];
+    V[op.x] = V[op.y];
     pc += 2;
 }
 
-void CPU::process_8XY3(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_8XY1(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
+    V[op.x] |= V[op.y];
+    if (quirksOf(Profile).logicClearsVF)
+    {
+        V[0xF] = 0x00;
+    }
+    pc += 2;
+}
+
+template <QuirkProfile Profile>
+void CPU::process_8XY2(const Instruction& op)
+{
+    V[op.x] &= V[op.y];
+    if (quirksOf(Profile).logicClearsVF)
+    {
+        V[0xF] = 0x00;
+    }
+    pc += 2;
+}
+
+template <QuirkProfile Profile>
+void CPU::process_8XY3(const Instruction& op)
+{
+    V[op.x] ^= V[op.y];
+    if (quirksOf(Profile).logicClearsVF)
+    {
+        V[0xF] = 0x00;
+    }
     pc += 2;
 }
 
-void CPU::process_8XY4(uint16_t opcode)
+void CPU::process_8XY4(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 4] > (0xFF - V[(opcode & 0x00F0) >> 8]))
+    if (V[op.x] > (0xFF - V[op.y]))
     {
         V[0xF] = 0x01;
     }
@@ -274,13 +807,13 @@ void CPU::process_8XY4(uint16_t opcode)
     {
         V[0xF] = 0x00;
     }
-    V[(opcode & 0x0F00) >> 8] += V[(opcode & 0x00F0) >> 4];
+    V[op.x] += V[op.y];
     pc += 2;
 }
 
-void CPU::process_8XY5(uint16_t opcode)
+void CPU::process_8XY5(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] < V[(opcode & 0x00F0) >> 4])
+    if (V[op.x] < V[op.y])
     {
         V[0xF] = 0x00;
     }
@@ -288,20 +821,25 @@ void CPU::process_8XY5(uint16_t opcode)
     {
         V[0xF] = 0x01;
     }
-    V[(opcode & 0x0F00) >> 8] -= V[(opcode & 0x00F0) >> 4];
+    V[op.x] -= V[op.y];
     pc += 2;
 }
 
-void CPU::process_8XY6(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_8XY6(const Instruction& op)
 {
-    V[0xF] = V[(opcode & 0x0F00) >> 8] & 0x1;
-    V[(opcode & 0x0F00) >> 8] >>= 1;
+    if (quirksOf(Profile).shiftReadsVY)
+    {
+        V[op.x] = V[op.y];
+    }
+    V[0xF] = V[op.x] & 0x1;
+    V[op.x] >>= 1;
     pc += 2;
 }
 
-void CPU::process_8XY7(uint16_t opcode)
+void CPU::process_8XY7(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] > V[(opcode & 0x00F0) >> 4])
+    if (V[op.x] > V[op.y])
     {
         V[0xF] = 0x00;
     }
@@ -309,22 +847,28 @@ void CPU::process_8XY7(uint16_t opcode)
     {
         V[0xF] = 0x01;
     }
-    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4] - V[(opcode & 0x0F00) >> 8];
+    V[op.x] = V[op.y] - V[op.x];
     pc += 2;
 }
 
-void CPU::process_8XYE(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_8XYE(const Instruction& op)
 {
-    V[0xF] = V[(opcode & 0x0F00) >> 8] >> 7;
-    V[(opcode & 0x0F00) >> 8] <<= 1;
+    if (quirksOf(Profile).shiftReadsVY)
+    {
+        V[op.x] = V[op.y];
+    }
+    V[0xF] = V[op.x] >> 7;
+    V[op.x] <<= 1;
     pc += 2;
 }
 
-void CPU::process_9XY0(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_9XY0(const Instruction& op)
 {
-    if (V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4])
+    if (V[op.x] != V[op.y])
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
@@ -332,57 +876,47 @@ void CPU::process_9XY0(uint16_t opcode)
     }
 }
 
-void CPU::process_ANNN(uint16_t opcode)
+void CPU::process_ANNN(const Instruction& op)
 {
-    I = opcode & 0x0FFF;
+    I = op.nnn;
     pc += 2;
 }
 
-void CPU::process_BNNN(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_BNNN(const Instruction& op)
 {
-    pc = (opcode & 0x0FFF) + V[0x0];
+    pc = (op.nnn) + V[quirksOf(Profile).jumpAddsVX ? op.x : 0x0];
 }
 
-void CPU::process_CXNN(uint16_t opcode)
+void CPU::process_CXNN(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] = distribution(engine) & (opcode & 0x00FF);
+    V[op.x] = distribution(engine) & op.nn;
+    ++randomDraws;
     pc += 2;
 }
 
-void CPU::process_DXYN(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_DXYN(const Instruction& op)
 {
-    uint16_t x = V[(opcode & 0x0F00) >> 8];
-    uint16_t y = V[(opcode & 0x00F0) >> 4];
-    uint16_t height = opcode & 0x000F;
-    uint16_t line;
-
-    V[0xF] = 0x00;
-    for (int yline = 0; yline < height; ++yline)
+    const bool wide = quirksOf(Profile).superChipOpcodes && op.n == 0;
+    const unsigned height = wide ? 16 : op.n;
+    const unsigned size = display.spriteSize(height, wide);
+    uint8_t sprite[DISPLAY_PLANES * 32];
+    for (unsigned i = 0; i < size; ++i)
     {
-        line = memory[I + yline];
-        for (int xline = 0; xline < 8; ++xline)
-        {
-            if (line & (0x80 >> xline)) // 0x80 -> 0b1000 0000
-            {
-                if (display[x + xline + (y + yline) * DISPLAY_WIDTH] == 1)
-                {
-                    V[0xF] = 0x01;
-                }
-
-                display[x + xline + (y + yline) * DISPLAY_WIDTH] ^= 1;
-            }
-        }
+        sprite[i] = memory[memory.wrap(I + i)];
     }
 
-    drawFlag = true;
+    V[0xF] = display.drawSprite(V[op.x], V[op.y], sprite, height, wide) ? 0x01 : 0x00;
     pc += 2;
 }
 
-void CPU::process_EX9E(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_EX9E(const Instruction& op)
 {
-    if (keypad[V[(opcode & 0x0F00) >> 8]])
+    if (keypad[V[op.x] & 0xF])
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
@@ -390,84 +924,122 @@ void CPU::process_EX9E(uint16_t opcode)
     }
 }
 
-void CPU::process_EXA1(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_EXA1(const Instruction& op)
 {
-    if (!keypad[V[(opcode & 0x0F00) >> 8]])
+    if (!keypad[V[op.x] & 0xF])
     {
-        pc += 4;
+        pc += skipLength<Profile>();
     }
     else
     {
         pc += 2;
     }
 }
-void CPU::process_FX07(uint16_t opcode)
+
+void CPU::process_F000(const Instruction&)
+{
+    I = fetch(pc + 2);
+    pc += 4;
+}
+
+void CPU::process_FN01(const Instruction& op)
 {
-    V[(opcode & 0x0F00) >> 8] = delayTimer;
+    display.selectPlanes(op.x);
     pc += 2;
 }
 
-void CPU::process_FX0A(uint16_t opcode)
+void CPU::process_FX07(const Instruction& op)
+{
+    V[op.x] = delayTimer;
+    pc += 2;
+}
+
+void CPU::process_FX0A(const Instruction& op)
 {
     for (int i = 0; i < 16; ++i)
     {
         if (keypad[i])
         {
-            V[(opcode & 0x0F00) >> 8] = i;
+            V[op.x] = i;
             pc += 2; // move program counter only if key is pressed
         }
     }
 }
 
-void CPU::process_FX15(uint16_t opcode)
+void CPU::process_FX15(const Instruction& op)
 {
-    delayTimer = V[(opcode & 0x0F00) >> 8];
+    delayTimer = V[op.x];
     pc += 2;
 }
 
-void CPU::process_FX18(uint16_t opcode)
+void CPU::process_FX18(const Instruction& op)
 {
-    soundTimer = V[(opcode & 0x0F00) >> 8];
+    soundTimer = V[op.x];
     pc += 2;
 }
 
-void CPU::process_FX1E(uint16_t opcode)
+void CPU::process_FX1E(const Instruction& op)
 {
-    I += V[(opcode & 0x0F00) >> 8];
+    I += V[op.x];
     pc += 2;
 }
 
-void CPU::process_FX29(uint16_t opcode)
+void CPU::process_FX29(const Instruction& op)
 {
     const unsigned short FONT_WIDTH = 5;
-    I = V[(opcode & 0x0F00) >> 8] * FONT_WIDTH;
+    I = V[op.x] * FONT_WIDTH;
+    pc += 2;
+}
+
+void CPU::process_FX30(const Instruction& op)
+{
+    const unsigned short BIG_FONT_HEIGHT = 10;
+    I = BIG_FONT_ADDRESS + (V[op.x] & 0xF) * BIG_FONT_HEIGHT;
     pc += 2;
 }
 
-void CPU::process_FX33(uint16_t opcode)
+void CPU::process_FX33(const Instruction& op)
 {
-    memory[I] = V[(opcode & 0x0F00) >> 8] / 100;
-    memory[I + 1] = (V[(opcode & 0x0F00) >> 8] % 100) / 10;
-    memory[I + 2] = (V[(opcode & 0x0F00) >> 8] % 100) % 10;
+    memory[memory.wrap(I)] = V[op.x] / 100;
+    memory[memory.wrap(I + 1)] = (V[op.x] % 100) / 10;
+    memory[memory.wrap(I + 2)] = (V[op.x] % 100) % 10;
+    recordMemoryWrite(I, 3);
     pc += 2;
 }
 
-void CPU::process_FX55(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_FX55(const Instruction& op)
 {
-    for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+    for (int i = 0; i <= op.x; ++i)
     {
-        memory[I + i] = V[i];
+        memory[memory.wrap(I + i)] = V[i];
     }
-    I += ((opcode & 0x0F00) >> 8) + 1;
+    recordMemoryWrite(I, op.x + 1);
+    I += indexAdvance(quirksOf(Profile).indexAdvance, op.x);
     pc += 2;
 }
 
-void CPU::process_FX65(uint16_t opcode)
+template <QuirkProfile Profile>
+void CPU::process_FX65(const Instruction& op)
 {
-    for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+    for (int i = 0; i <= op.x; ++i)
     {
-        V[i] = memory[I + i];
+        V[i] = memory[memory.wrap(I + i)];
     }
-    I += ((opcode & 0x0F00) >> 8) + 1;
+    I += indexAdvance(quirksOf(Profile).indexAdvance, op.x);
     pc += 2;
 }
+
+void CPU::process_FX75(const Instruction& op)
+{
+    std::copy_n(std::begin(V), op.x + 1, std::begin(flags));
+    pc += 2;
+}
+
+void CPU::process_FX85(const Instruction& op)
+{
+    std::copy_n(std::begin(flags), op.x + 1, std::begin(V));
+    pc += 2;
+}
+
@@ -1,76 +1,198 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <ostream>
 #include <random>
 
-const unsigned MEMORY_SIZE = 4096;
+#include "Framebuffer.hpp"
+#include "Quirks.hpp"
+
+const unsigned MEMORY_SIZE = 0x1000; // CHIP-8 and SUPER-CHIP
+const unsigned XO_CHIP_MEMORY_SIZE = 0x10000; // the whole 16-bit address space
+const unsigned SNAPSHOT_PAGE_SIZE = 256; // copy-on-write granularity of Snapshot memory
 const unsigned short PROGRAM_MEMORY_OFFSET = 0x200;
+const unsigned short BIG_FONT_ADDRESS = 0x50; // the 8x10 SUPER-CHIP digits, right after the 4x5 ones at 0
+const unsigned MAX_IDLE_LOOP = 8; // longest loop, in instructions, that skipIdleLoop recognizes
+
+constexpr unsigned memorySizeOf(QuirkProfile profile)
+{
+    return quirksOf(profile).xoChipOpcodes ? XO_CHIP_MEMORY_SIZE : MEMORY_SIZE;
+}
 
-const unsigned DISPLAY_WIDTH = 64;
-const unsigned DISPLAY_HEIGHT = 32;
+struct Snapshot;
+
+// CPU memory: MEMORY_SIZE bytes held inline, or XO_CHIP_MEMORY_SIZE on the heap for profiles
+// with XO-CHIP opcodes, so plain machines stay small. Converts to a pointer to its first byte,
+// so it is indexed and offset like the array it stands for.
+class Memory
+{
+public:
+    Memory();
+    Memory(const Memory& other);
+    Memory& operator=(const Memory& other);
+
+    void resize(unsigned size); // MEMORY_SIZE or XO_CHIP_MEMORY_SIZE; keeps the bytes both sizes have and zeroes the rest
+    unsigned size() const { return mask + 1; }
+    unsigned wrap(unsigned address) const { return address & mask; } // addresses past the end continue at 0
+
+    operator uint8_t*() { return bytes; }
+    operator const uint8_t*() const { return bytes; }
+
+private:
+    uint8_t* bytes; // local or extended.get()
+    unsigned mask;
+    uint8_t local[MEMORY_SIZE];
+    std::unique_ptr<uint8_t[]> extended;
+};
 
 class CPU
 {
+    friend class AgentServer;
+    friend class Jit;
+    friend struct AotMachine;
+    friend class TraceWriter;
+
 public:
     CPU();
+    void seed(uint32_t value); // CXNN draws from std::random_device entropy until seeded
+    void setQuirks(QuirkProfile profile); // picks the handlers decode() returns, the sprite edge and the memory size; QuirkProfile::Default until set
+    QuirkProfile quirks() const;
     void emulateCycle();
+    template <typename Observer>
+    void emulateCycle(Observer& observer); // then calls observer.retired(*this, address, opcode), e.g. Profiler
     void decrementTimers();
 
-    bool redraw();
-    bool playSound() const;
+    // Interprets up to two iterations of a loop starting at pc, stopping early at the first
+    // instruction that touches more than registers, timers and pc. If an iteration ends with
+    // all of those unchanged, the CPU is in a loop that only a timer tick or a key change can
+    // end (an FX0A wait, an FX07 poll), and every further whole iteration that fits in limit is
+    // skipped: the state after them is the state now. Returns the instructions executed plus
+    // skipped, at most limit; skipped receives the latter.
+    unsigned skipIdleLoop(unsigned limit, unsigned& skipped);
+
+    bool playSound() const; // the sound timer expires at the next decrementTimers()
+    bool soundOn() const; // the tone plays while the sound timer runs
+    void printState(std::ostream& out) const;
+    bool sameState(const CPU& other) const;
+
+    struct Instruction
+    {
+        void (CPU::*handler)(const Instruction&);
+        uint16_t opcode;
+        uint16_t nnn;
+        uint8_t nn;
+        uint8_t n;
+        uint8_t x;
+        uint8_t y;
+    };
+
+    Instruction decode(uint16_t opcode) const; // with the handlers of this CPU's quirk profile
+    static Instruction decode(uint16_t opcode, QuirkProfile profile);
+    static bool isUnknown(const Instruction& op);
+    static bool endsBlock(const Instruction& op); // true for instructions after which pc may not simply advance by 2
+    void execute(const Instruction& op);
+
+    uint16_t programCounter() const;
+    uint16_t indexRegister() const;
+    uint8_t registerValue(unsigned index) const;
+    uint16_t fetch(unsigned address) const; // the opcode at address
+    bool takeMemoryWrite(unsigned& begin, unsigned& end); // range written by FX33/FX55/5XY2 since the last call; all of memory after a write wrapped around
+    void recordMemoryWrite(unsigned address, unsigned size); // must also be called after writing memory directly
+
+    // shares the pages not written since the previous snapshot or restore; the CPU keeps the
+    // result as its baseline, so callers may only fill in the counters
+    std::shared_ptr<Snapshot> snapshot();
+    void restore(const std::shared_ptr<const Snapshot>& snapshot); // only copies the pages that differ from the current memory
 
 private:
-    void processOpcode(uint16_t opcode);
-
-    void process_00EN(uint16_t opcode);
-    void process_8XYN(uint16_t opcode);
-    void process_EXNN(uint16_t opcode);
-    void process_FXNN(uint16_t opcode);
-
-    void process_00E0(uint16_t opcode); // 0x00E0: clear the screen
-    void process_00EE(uint16_t opcode); // 0x00EE: return from a subroutine
-    void process_1NNN(uint16_t opcode); // 0x1NNN: jump to address NNN
-    void process_2NNN(uint16_t opcode); // 0x2NNN: execute subrouting starting at address NNN
-    void process_3XNN(uint16_t opcode); // 0x3XNN: skip the following instruction if VX == NN
-    void process_4XNN(uint16_t opcode); // 0x4XNN: skip the following instruction if VX != NN
-    void process_5XY0(uint16_t opcode); // 0x5XY0: skip the following instruction if VX == VY
-    void process_6XNN(uint16_t opcode); // 0x6XNN: store NN in VX
-    void process_7XNN(uint16_t opcode); // 0x7XNN: add NN to VX
-    void process_8XY0(uint16_t opcode); // 0x8XY0: store VY in VX
-    void process_8XY1(uint16_t opcode); // 0x8XY1: set VX to VX | VY
-    void process_8XY2(uint16_t opcode); // 0x8XY2: set VX to VX & VY
-    void process_8XY3(uint16_t opcode); // 0x8XY3: set VX to VX ^ VY
-    void process_8XY4(uint16_t opcode); // 0x8XY4: add VY to VX; set VF to 01 if a carry occurs, 00 otherwise
-    void process_8XY5(uint16_t opcode); // 0x8XY5: substruct VY from VX; set VF to 00 if a borrow occurs, 01 otherwise
-    void process_8XY6(uint16_t opcode); // 0x8XY6: store VY shifted right one bit in VX;
-                                        // set VF to the least significant bit prior to the shift
-    void process_8XY7(uint16_t opcode); // 0x8XY7: set VX to VY - VX; set VF to 00 if a borrow occurs, 01 otherwise
-    void process_8XYE(uint16_t opcode); // 0x8XYE: store VY shifted left one bit in VX;
-                                        // set VF to the most significant bit prior to the shift
-    void process_9XY0(uint16_t opcode); // 0x9XY0: skip the following instruction if VX != VY
-    void process_ANNN(uint16_t opcode); // 0xANNN: store NNN in I
-    void process_BNNN(uint16_t opcode); // 0xBNNN: jump to address NNN + V0
-    void process_CXNN(uint16_t opcode); // 0xCXNN: set VX to a random number with a mask NN
-    void process_DXYN(uint16_t opcode); // 0xDXYN: draw a sprite at position (VX, VY) with N bytes of sprite data starting at the address I; 
-                                        // set VF to 01 if any set pixels are changed to unset, and 00 otherwise
-    void process_EX9E(uint16_t opcode); // 0xEX9E: skip the following instruction if the key corresponding
-                                        // to the hex value currently stored in VX is pressed
-    void process_EXA1(uint16_t opcode); // 0xEXA1: skip the following instruction if the key corresponding
-                                        // to the hex value currently stored in VX is not pressed
-    void process_FX07(uint16_t opcode); // 0xFX07: store the current value of the delay timer in VX
-    void process_FX0A(uint16_t opcode); // 0xFX0A: wait for a keypress and store the result in VX
-    void process_FX15(uint16_t opcode); // 0xFX15: set the delay timer to the value of VX
-    void process_FX18(uint16_t opcode); // 0xFX18: set the sound timer to the value of VX
-    void process_FX1E(uint16_t opcode); // 0xFX1E: add the value stored in VX to I
-    void process_FX29(uint16_t opcode); // 0xFX29: set I to the memory address of the sprite data corresponding
-                                        // to the hexadecimal digit stored in VX
-    void process_FX33(uint16_t opcode); // 0xFX33: store the binary-coded decimal equivalent of the value
-                                        // stored in VX at addresses I, I + 1, and I + 2
-    void process_FX55(uint16_t opcode); // 0xFX55: store the values of registers V0 to VX inclusive in memory starting at address I;
-                                        // I is set to I + X + 1 after operation
-    void process_FX65(uint16_t opcode); // 0xFX65: fill registers V0 to VX inclusive with the values stored in memory starting at address I
-                                        // I is set to I + X + 1 after operation
+    // One instantiation per QuirkProfile; the handlers below that take the profile as a template
+    // argument resolve their quirks at compile time, so the interpreter never tests them.
+    template <QuirkProfile Profile>
+    static Instruction decodeFor(uint16_t opcode);
+
+    void process_unknown(const Instruction& op); // throws std::runtime_error describing the opcode and its address
+    void process_00CN(const Instruction& op); // 0x00CN: scroll the selected planes down N rows
+    void process_00DN(const Instruction& op); // 0x00DN: scroll the selected planes up N rows (XO-CHIP)
+    void process_00E0(const Instruction& op); // 0x00E0: clear the selected planes
+    void process_00EE(const Instruction& op); // 0x00EE: return from a subroutine
+    void process_00FB(const Instruction& op); // 0x00FB: scroll the selected planes right 4 pixels
+    void process_00FC(const Instruction& op); // 0x00FC: scroll the selected planes left 4 pixels
+    void process_00FD(const Instruction& op); // 0x00FD: exit the interpreter; pc stays put, so the machine idles
+    void process_00FE(const Instruction& op); // 0x00FE: switch to 64x32 and clear the screen
+    void process_00FF(const Instruction& op); // 0x00FF: switch to 128x64 and clear the screen
+    void process_1NNN(const Instruction& op); // 0x1NNN: jump to address NNN
+    void process_2NNN(const Instruction& op); // 0x2NNN: execute subrouting starting at address NNN
+    template <QuirkProfile Profile>
+    void process_3XNN(const Instruction& op); // 0x3XNN: skip the following instruction if VX == NN
+    template <QuirkProfile Profile>
+    void process_4XNN(const Instruction& op); // 0x4XNN: skip the following instruction if VX != NN
+    template <QuirkProfile Profile>
+    void process_5XY0(const Instruction& op); // 0x5XY0: skip the following instruction if VX == VY
+    void process_5XY2(const Instruction& op); // 0x5XY2: store VX to VY (or down to VY) in memory starting at address I; I is unchanged
+    void process_5XY3(const Instruction& op); // 0x5XY3: fill VX to VY (or down to VY) from memory starting at address I; I is unchanged
+    void process_6XNN(const Instruction& op); // 0x6XNN: store NN in VX
+    void process_7XNN(const Instruction& op); // 0x7XNN: add NN to VX
+    void process_8XY0(const Instruction& op); // 0x8XY0: store VY in VX
+    template <QuirkProfile Profile>
+    void process_8XY1(const Instruction& op); // 0x8XY1: set VX to VX | VY; VF = 00 afterwards if Quirks::logicClearsVF
+    template <QuirkProfile Profile>
+    void process_8XY2(const Instruction& op); // 0x8XY2: set VX to VX & VY; likewise
+    template <QuirkProfile Profile>
+    void process_8XY3(const Instruction& op); // 0x8XY3: set VX to VX ^ VY; likewise
+    void process_8XY4(const Instruction& op); // 0x8XY4: add VY to VX; set VF to 01 if a carry occurs, 00 otherwise
+    void process_8XY5(const Instruction& op); // 0x8XY5: substruct VY from VX; set VF to 00 if a borrow occurs, 01 otherwise
+    template <QuirkProfile Profile>
+    void process_8XY6(const Instruction& op); // 0x8XY6: store VX (VY if Quirks::shiftReadsVY) shifted right one bit in VX;
+                                              // set VF to the least significant bit prior to the shift
+    void process_8XY7(const Instruction& op); // 0x8XY7: set VX to VY - VX; set VF to 00 if a borrow occurs, 01 otherwise
+    template <QuirkProfile Profile>
+    void process_8XYE(const Instruction& op); // 0x8XYE: store VX (VY if Quirks::shiftReadsVY) shifted left one bit in VX;
+                                              // set VF to the most significant bit prior to the shift
+    template <QuirkProfile Profile>
+    void process_9XY0(const Instruction& op); // 0x9XY0: skip the following instruction if VX != VY
+    void process_ANNN(const Instruction& op); // 0xANNN: store NNN in I
+    template <QuirkProfile Profile>
+    void process_BNNN(const Instruction& op); // 0xBNNN: jump to address NNN + V0 (XNN + VX if Quirks::jumpAddsVX)
+    void process_CXNN(const Instruction& op); // 0xCXNN: set VX to a random number with a mask NN
+    template <QuirkProfile Profile>
+    void process_DXYN(const Instruction& op); // 0xDXYN: draw a sprite at position (VX, VY) with N bytes of sprite data starting at the address I; 
+                                              // set VF to 01 if any set pixels are changed to unset, and 00 otherwise;
+                                              // DXY0 draws a 16x16 sprite of 32 bytes if Quirks::superChipOpcodes, and nothing otherwise. Each selected plane takes its own data, one after the other
+    template <QuirkProfile Profile>
+    void process_EX9E(const Instruction& op); // 0xEX9E: skip the following instruction if the key corresponding
+                                              // to the hex value currently stored in VX is pressed
+    template <QuirkProfile Profile>
+    void process_EXA1(const Instruction& op); // 0xEXA1: skip the following instruction if the key corresponding
+                                              // to the hex value currently stored in VX is not pressed
+    void process_F000(const Instruction& op); // 0xF000 NNNN: store the 16-bit address in the next two bytes in I, then skip them
+    void process_FN01(const Instruction& op); // 0xFN01: select the planes N (bit 0: plane 0, bit 1: plane 1) for drawing, clearing and scrolling
+    void process_FX07(const Instruction& op); // 0xFX07: store the current value of the delay timer in VX
+    void process_FX0A(const Instruction& op); // 0xFX0A: wait for a keypress and store the result in VX
+    void process_FX15(const Instruction& op); // 0xFX15: set the delay timer to the value of VX
+    void process_FX18(const Instruction& op); // 0xFX18: set the sound timer to the value of VX
+    void process_FX1E(const Instruction& op); // 0xFX1E: add the value stored in VX to I
+    void process_FX29(const Instruction& op); // 0xFX29: set I to the memory address of the sprite data corresponding
+                                              // to the hexadecimal digit stored in VX
+    void process_FX30(const Instruction& op); // 0xFX30: set I to the memory address of the big 8x10 sprite of the hexadecimal digit in VX
+    void process_FX33(const Instruction& op); // 0xFX33: store the binary-coded decimal equivalent of the value
+                                              // stored in VX at addresses I, I + 1, and I + 2
+    template <QuirkProfile Profile>
+    void process_FX55(const Instruction& op); // 0xFX55: store the values of registers V0 to VX inclusive in memory starting at address I;
+                                              // I is then advanced as Quirks::indexAdvance says
+    template <QuirkProfile Profile>
+    void process_FX65(const Instruction& op); // 0xFX65: fill registers V0 to VX inclusive with the values stored in memory starting at address I
+                                              // I is then advanced as Quirks::indexAdvance says
+    void process_FX75(const Instruction& op); // 0xFX75: store V0 to VX inclusive in the RPL user flags
+    void process_FX85(const Instruction& op); // 0xFX85: fill V0 to VX inclusive from the RPL user flags
+
+    template <QuirkProfile Profile>
+    unsigned skipLength() const; // bytes a taken skip at pc advances it by
 
 public:
-    uint8_t memory[MEMORY_SIZE];
-    uint8_t display[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    Memory memory; // memorySizeOf(quirks()) bytes
+    Framebuffer display;
     uint8_t keypad[16];
 
 private:
@@ -79,11 +201,30 @@ private:
     uint16_t pc;
     uint16_t stack[16];
     uint8_t sp;
+    uint8_t flags[16]; // SUPER-CHIP RPL user flags, FX75/FX85
 
     uint8_t delayTimer;
     uint8_t soundTimer;
-    bool drawFlag;
+
+    unsigned writeBegin;
+    unsigned writeEnd;
+
+    std::bitset<XO_CHIP_MEMORY_SIZE / SNAPSHOT_PAGE_SIZE> dirtyPages; // bit p: Snapshot page p written since baseline was taken
+    uint64_t randomDraws; // CXNN draws and reseeds, lets snapshots share an unchanged engine
+    std::shared_ptr<const Snapshot> baseline; // latest snapshot taken or restored
 
     std::mt19937 engine;
     std::uniform_int_distribution<> distribution;
+
+    QuirkProfile profile;
+    Instruction (*decoder)(uint16_t opcode); // decodeFor<profile>
 };
+
+template <typename Observer>
+void CPU::emulateCycle(Observer& observer)
+{
+    const uint16_t address = pc;
+    const uint16_t opcode = fetch(pc);
+    execute(decode(opcode));
+    observer.retired(*this, address, opcode);
+}
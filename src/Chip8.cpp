@@ -1,112 +1,276 @@
 #define _SCL_SECURE_NO_WARNINGS
 #include "Chip8.hpp"
 
-#include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <thread>
 
 #include <SFML/Graphics.hpp>
 
-const float TILE_SIZE = 10.0f;
+Chip8::Chip8(Emulator& emulator, unsigned scale, float fade) :
+    emulator{ emulator },
+    cpu{ emulator.cpu() },
+    window{ sf::VideoMode(DISPLAY_WIDTH * scale, DISPLAY_HEIGHT * scale), "Chip8" },
+    renderer{ scale },
+    scale{ scale },
+    running{ false },
+    scheduler{ TIMER_FREQUENCY },
+    sound{ emulator.clock() },
+    audio{ new AudioStream{ sound, DEFAULT_AUDIO_LATENCY } },
+    metrics{ nullptr },
+    overlayShown{ false },
+    overlayToggled{ false },
+    rewinding{ false },
+    turbo{ false },
+    turboInterval{ DEFAULT_TURBO_INTERVAL },
+    lastInput{ 0 },
+    emulatedFrames{ 0 },
+    publishedFrames{ 0 },
+    shown{},
+    measuredInput{ 0 },
+    presentedFrames{ 0 }
+{
+    renderer.setFade(fade);
+    window.setKeyRepeatEnabled(false); // held keys are state, not a stream of presses
+}
 
-Chip8::Chip8() :
-    window{ sf::VideoMode(DISPLAY_WIDTH * static_cast<unsigned>(TILE_SIZE),
-                          DISPLAY_HEIGHT * static_cast<unsigned>(TILE_SIZE)),
-                          "Chip8" }
+void Chip8::setTurbo(unsigned interval)
 {
+    turbo = interval > 0;
+    turboInterval = turbo ? interval : DEFAULT_TURBO_INTERVAL;
 }
 
-bool Chip8::loadROM(const std::string& fileName)
+void Chip8::setAudioLatency(unsigned milliseconds)
 {
-    std::ifstream program(fileName.c_str(), std::ios::binary);
-    if (program.is_open())
-    {
-        std::vector<char> buffer{
-            std::istreambuf_iterator<char>(program),
-            std::istreambuf_iterator<char>()
-        };
-        if (buffer.size() <= MEMORY_SIZE - PROGRAM_MEMORY_OFFSET)
-        {
-            std::copy(std::begin(buffer), std::end(buffer),
-                std::begin(cpu.memory) + PROGRAM_MEMORY_OFFSET);
+    audio.reset(milliseconds > 0 ? new AudioStream{ sound, milliseconds } : nullptr);
+}
+
+void Chip8::setMetrics(Metrics* metrics, bool showOverlay)
+{
+    this->metrics = metrics;
+    overlay.reset(metrics ? new MetricsOverlay{ *metrics, scale } : nullptr);
+    overlayShown = overlay && showOverlay;
+}
 
-            std::cout << "ROM '" << fileName << "' loaded, size: " << buffer.size() << std::endl;
+void Chip8::run()
+{
+    if (audio)
+    {
+        emulator.setSound(&sound);
+        audio->play();
+    }
+
+    running = true;
+    std::thread emulation{ &Chip8::emulate, this };
+
+    while (window.isOpen())
+    {
+        {
+            PhaseTimer timer{ metrics, Phase::Input };
+            handleInput();
+        }
+        if (!running.load(std::memory_order_acquire))
+        {
+            window.close(); // the emulation thread failed
+        }
+        else if (frames.acquire())
+        {
+            PhaseTimer timer{ metrics, Phase::Draw };
+            present();
         }
         else
         {
-            std::cerr << "ROM image is too big: " << buffer.size() << " (max "
-                << MEMORY_SIZE - PROGRAM_MEMORY_OFFSET << ")" << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        return true;
     }
-    else
+
+    running = false;
+    emulation.join();
+    if (audio)
+    {
+        audio->stop();
+        emulator.setSound(nullptr);
+    }
+    if (failure)
     {
-        std::cerr << "Unable to open ROM: " << fileName << std::endl;
-        return false;
+        std::rethrow_exception(failure);
+    }
+    if (scheduler.overruns() > 0)
+    {
+        scheduler.printReport(std::cerr);
     }
 }
 
-void Chip8::run()
+void Chip8::printStats(std::ostream& out) const
 {
-    sf::Clock clock;
-    sf::Time lag;
+    out << "frames: " << emulatedFrames << " emulated, " << publishedFrames << " published, "
+        << presentedFrames << " presented" << std::endl;
 
-    while (window.isOpen())
+    if (latencies.empty())
     {
-        handleInput();
+        out << "input latency: no key presses" << std::endl;
+        return;
+    }
+
+    std::vector<int64_t> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+    int64_t total = 0;
+    for (int64_t latency : sorted)
+    {
+        total += latency;
+    }
+    const auto milliseconds = [](double microseconds) { return microseconds / 1000.0; };
+
+    out << std::fixed << std::setprecision(2)
+        << "input latency: " << sorted.size() << " key presses, mean " << milliseconds(static_cast<double>(total) / sorted.size())
+        << " ms, median " << milliseconds(static_cast<double>(sorted[sorted.size() / 2]))
+        << " ms, 95th percentile " << milliseconds(static_cast<double>(sorted[sorted.size() * 95 / 100]))
+        << " ms, max " << milliseconds(static_cast<double>(sorted.back())) << " ms"
+        << std::defaultfloat << std::endl;
+}
+
+int64_t Chip8::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        sf::Time elapsed = clock.getElapsedTime();
-        sf::Time time = elapsed + lag;
-        
-        const unsigned int CYCLES_PER_SECOND = 600; // 600 Hz
-        const unsigned int TIMER_FREQUENCY = 60; // 60 Hz
-        const unsigned int CYCLES_PER_FRAME = CYCLES_PER_SECOND / TIMER_FREQUENCY;
-        const sf::Time tickInterval = sf::microseconds(static_cast<sf::Int64>(1000000.0f / TIMER_FREQUENCY));
+void Chip8::present()
+{
+    const Frame& frame = frames.front();
+    ++presentedFrames;
+    if (metrics)
+    {
+        metrics->add(Counter::PresentedFrames);
+    }
+
+    const uint64_t changedRows = frame.display.rowsDifferingFrom(shown);
+    shown = frame.display.state();
 
-        if (time > tickInterval)
+    bool redraw = renderer.update(frame.display, changedRows) || overlayToggled;
+    redraw = (overlayShown && overlay->update()) || redraw;
+    overlayToggled = false;
+    if (redraw)
+    {
+        window.clear();
+        renderer.draw(window);
+        if (overlayShown)
         {
-            for (unsigned int i = 0; i < CYCLES_PER_FRAME; ++i)
+            overlay->draw(window);
+        }
+        window.display();
+    }
+
+    if (frame.input != measuredInput)
+    {
+        latencies.push_back(now() - frame.input); // the first frame that saw the input is on screen
+        measuredInput = frame.input;
+    }
+}
+
+void Chip8::emulate()
+{
+    try
+    {
+        scheduler.reset();
+        while (running.load(std::memory_order_relaxed))
+        {
+            if (turbo)
             {
-                cpu.emulateCycle();
+                for (unsigned frame = 0; frame < turboInterval && turbo; ++frame)
+                {
+                    step();
+                }
+                if (!turbo)
+                {
+                    scheduler.resume();
+                }
             }
-            
-            if (cpu.playSound())
+            else
             {
-                std::cout << "BEEP" << std::endl; // playSound!
+                const unsigned ticks = scheduler.wait();
+                if (metrics)
+                {
+                    metrics->observe(scheduler);
+                }
+                for (unsigned tick = 0; tick < ticks; ++tick)
+                {
+                    step();
+                }
             }
+            publish();
+        }
+    }
+    catch (...)
+    {
+        failure = std::current_exception();
+        running.store(false, std::memory_order_release);
+    }
+}
+
+void Chip8::publish()
+{
+    Frame& frame = frames.back();
+    frame.display = cpu.display;
+    frame.input = lastInput;
+    frames.publish();
+    ++publishedFrames;
+}
 
-            cpu.decrementTimers();
+void Chip8::step()
+{
+    applyEvents();
 
-            lag = time - tickInterval;
-            clock.restart();
+    std::shared_ptr<const Snapshot> state;
+    if (rewinding)
+    {
+        if (history.stepBack(state))
+        {
+            restore(state);
         }
-
-        draw();
     }
+    else
+    {
+        history.record(emulator.snapshot()); // the state before the frame, so stepping back shows a change
+        emulator.runFrame();
+    }
+    ++emulatedFrames;
 }
 
-void Chip8::draw()
+void Chip8::applyEvents()
 {
-    if (cpu.redraw())
+    Event event;
+    while (events.pop(event))
     {
-        window.clear();
-
-        for (unsigned int i = 0; i < DISPLAY_WIDTH; ++i)
+        switch (event.command)
         {
-            for (unsigned int j = 0; j < DISPLAY_HEIGHT; ++j)
+        case Command::Key:
+            if (!emulator.replaying())
             {
-                if (cpu.display[i + j * DISPLAY_WIDTH] != 0)
-                {
-                    sf::RectangleShape shape({ TILE_SIZE, TILE_SIZE });
-                    shape.setPosition({ i * TILE_SIZE, j * TILE_SIZE });
-                    shape.setFillColor({ 255, 255, 255 });
-                    window.draw(shape);
-                }
+                emulator.setKey(event.key, event.pressed);
+                lastInput = event.time;
+            }
+            break;
+        case Command::Rewind:
+            rewinding = event.pressed;
+            break;
+        case Command::Turbo:
+            turbo = !turbo;
+            break;
+        case Command::QuickSave:
+            quickSave = emulator.snapshot();
+            break;
+        case Command::QuickLoad:
+            if (quickSave)
+            {
+                restore(quickSave);
             }
+            break;
         }
-
-        window.display();
     }
 }
 
@@ -148,14 +312,64 @@ void Chip8::handleInput()
             case sf::Keyboard::Escape:
                 window.close();
                 break;
+            case sf::Keyboard::BackSpace:
+                post(Command::Rewind, 0, isPressed(event.type) != 0);
+                break;
+            case sf::Keyboard::Tab:
+                if (event.type == sf::Event::KeyPressed)
+                {
+                    post(Command::Turbo, 0, true);
+                }
+                break;
+            case sf::Keyboard::F1:
+                if (event.type == sf::Event::KeyPressed && overlay)
+                {
+                    overlayShown = !overlayShown;
+                    overlayToggled = true;
+                }
+                break;
+            case sf::Keyboard::F5:
+                if (event.type == sf::Event::KeyPressed)
+                {
+                    post(Command::QuickSave, 0, true);
+                }
+                break;
+            case sf::Keyboard::F9:
+                if (event.type == sf::Event::KeyPressed)
+                {
+                    post(Command::QuickLoad, 0, true);
+                }
+                break;
             default:
                 const auto it = keyCodeMap.find(event.key.code);
                 if (it != keyCodeMap.end())
                 {
-                    cpu.keypad[it->second] = isPressed(event.type);
+                    post(Command::Key, it->second, isPressed(event.type) != 0);
                 }
                 break;
             }
         }
     }
 }
+
+void Chip8::post(Command command, uint8_t key, bool pressed)
+{
+    if (!events.push({ command, key, pressed, now() }))
+    {
+        std::cerr << "Input queue full, event dropped" << std::endl;
+    }
+}
+
+void Chip8::restore(const std::shared_ptr<const Snapshot>& state)
+{
+    uint8_t held[16];
+    std::copy(std::begin(cpu.keypad), std::end(cpu.keypad), std::begin(held));
+    emulator.restore(state);
+    if (!emulator.replaying())
+    {
+        for (uint8_t key = 0; key < 16; ++key)
+        {
+            emulator.setKey(key, held[key] != 0); // keys still held stay held
+        }
+    }
+}
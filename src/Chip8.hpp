@@ -1,22 +1,114 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
 #include <SFML/Graphics.hpp>
 
-#include "CPU.hpp"
+#include "AudioStream.hpp"
+#include "Emulator.hpp"
+#include "FrameScheduler.hpp"
+#include "Metrics.hpp"
+#include "MetricsOverlay.hpp"
+#include "Renderer.hpp"
+#include "Rewind.hpp"
+#include "SpscQueue.hpp"
+#include "TripleBuffer.hpp"
 
+const unsigned DEFAULT_TURBO_INTERVAL = 10; // emulated frames per presented frame in turbo mode
+
+// SFML frontend: presents the framebuffer in a window and feeds the keypad.
+// F5 keeps a quick save in memory, F9 returns to it; holding Backspace rewinds one frame per tick.
+// Tab toggles turbo mode: frames run back to back and only every Nth one is presented.
+// F1 toggles the metrics overlay when metrics are attached.
+//
+// The emulator runs on its own thread, paced to TIMER_FREQUENCY frames per second. Finished
+// frames reach the window thread through a triple buffer and input goes the other way through
+// a queue, so a slow present never holds up emulation and a slow frame never drops input.
+// When presenting cannot keep up, the window simply skips to the newest finished frame.
+// Sound timer edges reach the AudioStream through a SoundChannel in the same non-blocking way.
 class Chip8
 {
 public:
-    Chip8();
-    bool loadROM(const std::string& fileName);
-    void run();
+    Chip8(Emulator& emulator, unsigned scale, float fade);
+    void setTurbo(unsigned interval); // start in turbo mode presenting every interval-th frame; 0 = paced
+    void setAudioLatency(unsigned milliseconds); // DEFAULT_AUDIO_LATENCY unless set; 0 mutes
+    void setMetrics(Metrics* metrics, bool showOverlay); // times input and drawing, counts late ticks; overlay shows them from the start
+    void run(); // until the window is closed; rethrows what the emulation thread threw, reports late frames
+    void printStats(std::ostream& out) const; // input-to-photon latency and presented frames of the last run()
 
 private:
-    void draw();
+    enum class Command : uint8_t
+    {
+        Key,
+        Rewind,
+        Turbo,
+        QuickSave,
+        QuickLoad
+    };
+
+    struct Event
+    {
+        Command command;
+        uint8_t key;
+        bool pressed;
+        int64_t time; // microseconds, see now()
+    };
+
+    struct Frame
+    {
+        Framebuffer display;
+        int64_t input; // time of the newest key event applied before this frame ran, 0 if none
+    };
+
+    static int64_t now();
+
+    // window thread
     void handleInput();
+    void post(Command command, uint8_t key, bool pressed);
+    void present();
+
+    // emulation thread
+    void emulate();
+    void step();
+    void publish();
+    void applyEvents();
+    void restore(const std::shared_ptr<const Snapshot>& state);
 
 private:
-    CPU cpu;
+    Emulator& emulator;
+    CPU& cpu;
     sf::RenderWindow window;
+    Renderer renderer;
+    unsigned scale;
+
+    TripleBuffer<Frame> frames;
+    SpscQueue<Event, 256> events;
+    std::atomic<bool> running;
+    std::exception_ptr failure; // written by the emulation thread before it clears running
+    FrameScheduler scheduler;
+    SoundChannel sound;
+    std::unique_ptr<AudioStream> audio;
+    Metrics* metrics;
+    std::unique_ptr<MetricsOverlay> overlay;
+    bool overlayShown;
+    bool overlayToggled; // redraw the next frame even if it did not change
+
+    std::shared_ptr<const Snapshot> quickSave; // null until the first quick save
+    RewindBuffer history;
+    bool rewinding;
+    bool turbo;
+    unsigned turboInterval;
+    int64_t lastInput;
+    uint64_t emulatedFrames;
+    uint64_t publishedFrames;
+
+    DisplayState shown; // display of the presented frame
+    int64_t measuredInput; // Frame::input of the last latency sample
+    uint64_t presentedFrames;
+    std::vector<int64_t> latencies; // microseconds from key event to the end of window.display()
 };
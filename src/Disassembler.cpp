@@ -0,0 +1,161 @@
+#include "Disassembler.hpp"
+
+#include <cstdio>
+
+const char* opcodeClass(uint16_t opcode)
+{
+    const unsigned n = opcode & 0x000F;
+    const unsigned nn = opcode & 0x00FF;
+
+    switch ((opcode & 0xF000) >> 12)
+    {
+    case 0x0:
+        switch (opcode)
+        {
+        case 0x00E0: return "00E0";
+        case 0x00EE: return "00EE";
+        case 0x00FB: return "00FB";
+        case 0x00FC: return "00FC";
+        case 0x00FD: return "00FD";
+        case 0x00FE: return "00FE";
+        case 0x00FF: return "00FF";
+        }
+        return ((opcode & 0xFFF0) == 0x00C0) ? "00CN" : ((opcode & 0xFFF0) == 0x00D0) ? "00DN" : "????";
+    case 0x1: return "1NNN";
+    case 0x2: return "2NNN";
+    case 0x3: return "3XNN";
+    case 0x4: return "4XNN";
+    case 0x5: return (n == 0x0) ? "5XY0" : (n == 0x2) ? "5XY2" : (n == 0x3) ? "5XY3" : "????";
+    case 0x6: return "6XNN";
+    case 0x7: return "7XNN";
+    case 0x8:
+        switch (n)
+        {
+        case 0x0: return "8XY0";
+        case 0x1: return "8XY1";
+        case 0x2: return "8XY2";
+        case 0x3: return "8XY3";
+        case 0x4: return "8XY4";
+        case 0x5: return "8XY5";
+        case 0x6: return "8XY6";
+        case 0x7: return "8XY7";
+        case 0xE: return "8XYE";
+        default: return "????";
+        }
+    case 0x9: return (n == 0x0) ? "9XY0" : "????";
+    case 0xA: return "ANNN";
+    case 0xB: return "BNNN";
+    case 0xC: return "CXNN";
+    case 0xD: return "DXYN";
+    case 0xE: return (nn == 0x9E) ? "EX9E" : (nn == 0xA1) ? "EXA1" : "????";
+    case 0xF:
+        switch (nn)
+        {
+        case 0x00: return (opcode == 0xF000) ? "F000" : "????";
+        case 0x01: return "FN01";
+        case 0x07: return "FX07";
+        case 0x0A: return "FX0A";
+        case 0x15: return "FX15";
+        case 0x18: return "FX18";
+        case 0x1E: return "FX1E";
+        case 0x29: return "FX29";
+        case 0x30: return "FX30";
+        case 0x33: return "FX33";
+        case 0x55: return "FX55";
+        case 0x65: return "FX65";
+        case 0x75: return "FX75";
+        case 0x85: return "FX85";
+        default: return "????";
+        }
+    }
+    return "????";
+}
+
+std::string disassemble(uint16_t opcode)
+{
+    const unsigned x = (opcode & 0x0F00) >> 8;
+    const unsigned y = (opcode & 0x00F0) >> 4;
+    const unsigned n = opcode & 0x000F;
+    const unsigned nn = opcode & 0x00FF;
+    const unsigned nnn = opcode & 0x0FFF;
+
+    char text[32];
+    switch ((opcode & 0xF000) >> 12)
+    {
+    case 0x0:
+        if (opcode == 0x00E0) return "CLS";
+        if (opcode == 0x00EE) return "RET";
+        if (opcode == 0x00FB) return "SCR";
+        if (opcode == 0x00FC) return "SCL";
+        if (opcode == 0x00FD) return "EXIT";
+        if (opcode == 0x00FE) return "LOW";
+        if (opcode == 0x00FF) return "HIGH";
+        if ((opcode & 0xFFF0) == 0x00C0) { std::snprintf(text, sizeof(text), "SCD %u", n); return text; }
+        if ((opcode & 0xFFF0) == 0x00D0) { std::snprintf(text, sizeof(text), "SCU %u", n); return text; }
+        break;
+    case 0x1: std::snprintf(text, sizeof(text), "JP 0x%03X", nnn); return text;
+    case 0x2: std::snprintf(text, sizeof(text), "CALL 0x%03X", nnn); return text;
+    case 0x3: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); return text;
+    case 0x4: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); return text;
+    case 0x5:
+        if (n == 0x2) { std::snprintf(text, sizeof(text), "SAVE V%X-V%X", x, y); return text; }
+        if (n == 0x3) { std::snprintf(text, sizeof(text), "LOAD V%X-V%X", x, y); return text; }
+        if (n != 0x0) break;
+        std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+        return text;
+    case 0x6: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); return text;
+    case 0x7: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); return text;
+    case 0x8:
+    {
+        static const char* const mnemonics[16] =
+        {
+            "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+        };
+        if (!mnemonics[n]) break;
+        std::snprintf(text, sizeof(text), "%s V%X, V%X", mnemonics[n], x, y);
+        return text;
+    }
+    case 0x9:
+        if (n != 0x0) break;
+        std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y);
+        return text;
+    case 0xA: std::snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); return text;
+    case 0xB: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); return text;
+    case 0xC: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); return text;
+    case 0xD: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); return text;
+    case 0xE:
+        if (nn == 0x9E) { std::snprintf(text, sizeof(text), "SKP V%X", x); return text; }
+        if (nn == 0xA1) { std::snprintf(text, sizeof(text), "SKNP V%X", x); return text; }
+        break;
+    case 0xF:
+    {
+        const char* format = nullptr;
+        switch (nn)
+        {
+        case 0x00:
+            if (opcode == 0xF000) return "LD I, LONG"; // the address is the next word
+            break;
+        case 0x01: format = "PLANE %X"; break;
+        case 0x07: format = "LD V%X, DT"; break;
+        case 0x0A: format = "LD V%X, K"; break;
+        case 0x15: format = "LD DT, V%X"; break;
+        case 0x18: format = "LD ST, V%X"; break;
+        case 0x1E: format = "ADD I, V%X"; break;
+        case 0x29: format = "LD F, V%X"; break;
+        case 0x30: format = "LD HF, V%X"; break;
+        case 0x33: format = "LD B, V%X"; break;
+        case 0x55: format = "LD [I], V%X"; break;
+        case 0x65: format = "LD V%X, [I]"; break;
+        case 0x75: format = "LD R, V%X"; break;
+        case 0x85: format = "LD V%X, R"; break;
+        }
+        if (!format) break;
+        std::snprintf(text, sizeof(text), format, x);
+        return text;
+    }
+    }
+
+    std::snprintf(text, sizeof(text), "DW 0x%04X", static_cast<unsigned>(opcode));
+    return text;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Opcode pattern as used in the CPU handler names, e.g. "8XY4"; "????" for unknown opcodes.
+const char* opcodeClass(uint16_t opcode);
+
+// Conventional CHIP-8 assembly, e.g. "ADD V1, V2" or "DRW V0, V1, 5"; unknown opcodes become "DW 0x....".
+std::string disassemble(uint16_t opcode);
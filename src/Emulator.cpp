@@ -0,0 +1,552 @@
+#define _SCL_SECURE_NO_WARNINGS
+#include "Emulator.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+Emulator::Emulator(unsigned cyclesPerSecond) :
+    backend{ Backend::Interpreter },
+    cyclesPerSecond{ DEFAULT_CYCLES_PER_SECOND },
+    cyclesInFrame{ 1 },
+    frameCycle{ 0 },
+    cycleCount{ 0 },
+    frameCount{ 0 },
+    realtime{ false },
+    frameScheduler{ TIMER_FREQUENCY },
+    pendingTicks{ 0 },
+    recorder{ nullptr },
+    replay{ nullptr },
+    replayPosition{ 0 },
+    profiler{ nullptr },
+    tracer{ nullptr },
+    idleSkipping{ true },
+    skippedCycles{ 0 },
+    video{ nullptr },
+    metrics{ nullptr },
+    sound{ nullptr },
+    soundPlaying{ false },
+    soundResolution{ 1 }
+{
+    setClock(cyclesPerSecond);
+}
+
+bool Emulator::loadROM(const std::string& fileName)
+{
+    std::ifstream program(fileName.c_str(), std::ios::binary);
+    if (program.is_open())
+    {
+        std::vector<char> buffer{
+            std::istreambuf_iterator<char>(program),
+            std::istreambuf_iterator<char>()
+        };
+        if (buffer.size() <= processor.memory.size() - PROGRAM_MEMORY_OFFSET)
+        {
+            std::copy(std::begin(buffer), std::end(buffer),
+                processor.memory + PROGRAM_MEMORY_OFFSET);
+            processor.recordMemoryWrite(PROGRAM_MEMORY_OFFSET, static_cast<unsigned>(buffer.size()));
+            resetBackends();
+
+            std::cout << "ROM '" << fileName << "' loaded, size: " << buffer.size() << std::endl;
+        }
+        else
+        {
+            std::cerr << "ROM image is too big: " << buffer.size() << " (max "
+                << processor.memory.size() - PROGRAM_MEMORY_OFFSET << ")" << std::endl;
+        }
+        return true;
+    }
+    else
+    {
+        std::cerr << "Unable to open ROM: " << fileName << std::endl;
+        return false;
+    }
+}
+
+bool Emulator::loadROM(const std::vector<uint8_t>& image)
+{
+    if (image.size() > processor.memory.size() - PROGRAM_MEMORY_OFFSET)
+    {
+        return false;
+    }
+
+    std::copy(std::begin(image), std::end(image), processor.memory + PROGRAM_MEMORY_OFFSET);
+    processor.recordMemoryWrite(PROGRAM_MEMORY_OFFSET, static_cast<unsigned>(image.size()));
+    resetBackends();
+    return true;
+}
+
+void Emulator::setClock(unsigned cyclesPerSecond)
+{
+    this->cyclesPerSecond = std::min(std::max(cyclesPerSecond, MIN_CYCLES_PER_SECOND), UNLIMITED_CYCLES_PER_SECOND);
+    updateFrameBudget();
+    soundResolution = std::max(1u, this->cyclesPerSecond / (sound ? sound->sampleRate : AUDIO_SAMPLE_RATE));
+}
+
+void Emulator::setRealtime(bool enabled)
+{
+    realtime = enabled;
+    frameScheduler.reset();
+    pendingTicks = 0;
+}
+
+void Emulator::setBackend(Backend backend)
+{
+    if (backend == Backend::Jit && !Jit::available())
+    {
+        throw std::runtime_error("JIT backend is not available on this host");
+    }
+
+    this->backend = backend;
+    if (backend == Backend::Cached && !cache)
+    {
+        cache.reset(new BlockCache(processor));
+    }
+    if (backend == Backend::Jit && !jit)
+    {
+        jit.reset(new Jit(processor));
+    }
+    if (backend == Backend::Aot && !aot)
+    {
+        aot.reset(new Aot(processor));
+    }
+    resetBackends();
+}
+
+void Emulator::setQuirks(QuirkProfile profile)
+{
+    processor.setQuirks(profile);
+    resetBackends(); // their decoded and translated blocks carry the previous profile's handlers
+}
+
+void Emulator::setDifferential(bool enabled)
+{
+    if (jit)
+    {
+        jit->setDifferential(enabled);
+    }
+    if (aot)
+    {
+        aot->setDifferential(enabled);
+    }
+}
+
+void Emulator::setProfiler(Profiler* profiler)
+{
+    this->profiler = profiler;
+}
+
+void Emulator::setTracer(TraceWriter* tracer)
+{
+    this->tracer = tracer;
+}
+
+void Emulator::setVideo(VideoWriter* video)
+{
+    this->video = video;
+}
+
+void Emulator::setMetrics(Metrics* metrics)
+{
+    this->metrics = metrics;
+}
+
+void Emulator::setSound(SoundChannel* channel)
+{
+    sound = channel;
+    soundPlaying = false;
+    setClock(cyclesPerSecond);
+    if (sound)
+    {
+        reportSound();
+    }
+}
+
+void Emulator::setIdleSkipping(bool enabled)
+{
+    idleSkipping = enabled;
+}
+
+unsigned Emulator::clock() const
+{
+    return cyclesPerSecond;
+}
+
+unsigned Emulator::cyclesPerFrame() const
+{
+    return cyclesInFrame;
+}
+
+void Emulator::setSeed(uint32_t seed)
+{
+    processor.seed(seed);
+}
+
+void Emulator::setKey(uint8_t key, bool pressed)
+{
+    key &= 0xF;
+    if ((processor.keypad[key] != 0) == pressed)
+    {
+        return;
+    }
+    processor.keypad[key] = pressed ? 1 : 0;
+    if (recorder)
+    {
+        recorder->add({ cycleCount, key, pressed });
+    }
+}
+
+void Emulator::setRecorder(InputLog* log)
+{
+    recorder = log;
+}
+
+void Emulator::setReplay(const InputLog* log)
+{
+    replay = log;
+    replayPosition = 0;
+    while (replay && replayPosition < replay->events().size() && replay->events()[replayPosition].cycle < cycleCount)
+    {
+        ++replayPosition;
+    }
+}
+
+bool Emulator::replaying() const
+{
+    return replay && replayPosition < replay->events().size();
+}
+
+bool Emulator::runFrame()
+{
+    return advance(cyclesInFrame - frameCycle);
+}
+
+void Emulator::runFrames(uint64_t count)
+{
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        runFrame();
+    }
+}
+
+void Emulator::runCycles(uint64_t count)
+{
+    while (count > 0)
+    {
+        const unsigned cycles = static_cast<unsigned>(std::min<uint64_t>(count, cyclesInFrame - frameCycle));
+        advance(cycles);
+        count -= cycles;
+    }
+}
+
+uint64_t Emulator::cycles() const
+{
+    return cycleCount;
+}
+
+uint64_t Emulator::frames() const
+{
+    return frameCount;
+}
+
+uint64_t Emulator::idleCycles() const
+{
+    return skippedCycles;
+}
+
+std::shared_ptr<const Snapshot> Emulator::snapshot()
+{
+    std::shared_ptr<Snapshot> snapshot = processor.snapshot();
+    snapshot->cycles = cycleCount;
+    snapshot->frames = frameCount;
+    snapshot->frameCycle = frameCycle;
+    return snapshot;
+}
+
+void Emulator::restore(const std::shared_ptr<const Snapshot>& snapshot)
+{
+    processor.restore(snapshot); // the backends pick up the rewritten pages on their next run
+    cycleCount = snapshot->cycles;
+    frameCount = snapshot->frames;
+    frameCycle = snapshot->frameCycle;
+    updateFrameBudget();
+    if (sound)
+    {
+        reportSound();
+    }
+
+    if (recorder)
+    {
+        // the log continues from the restored point; stating every key keeps it replayable
+        // even though events recorded after the snapshot was taken may share its cycle
+        recorder->truncate(cycleCount);
+        for (uint8_t key = 0; key < 16; ++key)
+        {
+            recorder->add({ cycleCount, key, processor.keypad[key] != 0 });
+        }
+    }
+    if (replay)
+    {
+        setReplay(replay); // events are absolute, so applying those at the restored cycle again is harmless
+    }
+}
+
+bool Emulator::saveState(const std::string& fileName)
+{
+    std::ofstream file(fileName.c_str(), std::ios::binary);
+    return file.is_open() && writeSnapshot(file, *snapshot());
+}
+
+bool Emulator::loadState(const std::string& fileName)
+{
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    std::shared_ptr<Snapshot> state = std::make_shared<Snapshot>();
+    if (!file.is_open() || !readSnapshot(file, *state))
+    {
+        return false;
+    }
+    restore(state);
+    return true;
+}
+
+CPU& Emulator::cpu()
+{
+    return processor;
+}
+
+const CPU& Emulator::cpu() const
+{
+    return processor;
+}
+
+const FrameScheduler& Emulator::scheduler() const
+{
+    return frameScheduler;
+}
+
+const AotProgram* Emulator::recompiledProgram() const
+{
+    return aot ? aot->program() : nullptr;
+}
+
+void Emulator::resetBackends()
+{
+    if (cache)
+    {
+        cache->clear();
+    }
+    if (jit)
+    {
+        jit->clear();
+    }
+    if (aot)
+    {
+        aot->clear();
+    }
+}
+
+void Emulator::reportSound()
+{
+    const bool on = processor.soundOn();
+    if (on != soundPlaying)
+    {
+        soundPlaying = on;
+        sound->post({ cycleCount, on });
+    }
+    sound->cycle.store(cycleCount, std::memory_order_release);
+}
+
+void Emulator::updateFrameBudget()
+{
+    const uint64_t begin = frameCount * cyclesPerSecond / TIMER_FREQUENCY;
+    const uint64_t end = (frameCount + 1) * cyclesPerSecond / TIMER_FREQUENCY;
+    cyclesInFrame = static_cast<unsigned>(end - begin);
+    frameCycle = std::min(frameCycle, cyclesInFrame); // a frame already past its new budget ends at the next advance()
+}
+
+bool Emulator::advance(unsigned count)
+{
+    PhaseTimer timer{ metrics, Phase::Emulate };
+    for (unsigned remaining = count; remaining > 0; )
+    {
+        unsigned cycles = replay ? applyReplay(remaining) : remaining;
+        if (sound)
+        {
+            cycles = std::min(cycles, soundResolution); // so an FX18 is known to within a sample
+        }
+        execute(cycles);
+        cycleCount += cycles;
+        frameCycle += cycles;
+        remaining -= cycles;
+        if (sound)
+        {
+            reportSound();
+        }
+    }
+
+    if (metrics)
+    {
+        metrics->add(Counter::Instructions, count);
+    }
+    if (frameCycle < cyclesInFrame)
+    {
+        return false;
+    }
+
+    const bool expired = processor.playSound();
+    processor.decrementTimers();
+    frameCycle = 0;
+    ++frameCount;
+    updateFrameBudget();
+    if (sound)
+    {
+        reportSound();
+    }
+    if (video)
+    {
+        video->capture(processor.display);
+    }
+    if (metrics)
+    {
+        metrics->add(Counter::Ticks);
+        metrics->add(Counter::SoundEvents, expired ? 1 : 0);
+    }
+
+    if (realtime)
+    {
+        timer.stop(); // pacing is not emulation
+        waitForNextFrame();
+    }
+    return expired;
+}
+
+unsigned Emulator::applyReplay(unsigned count)
+{
+    const std::vector<InputEvent>& events = replay->events();
+    for (; replayPosition < events.size() && events[replayPosition].cycle <= cycleCount; ++replayPosition)
+    {
+        processor.keypad[events[replayPosition].key & 0xF] = events[replayPosition].pressed ? 1 : 0;
+    }
+    if (replayPosition < events.size())
+    {
+        count = static_cast<unsigned>(std::min<uint64_t>(count, events[replayPosition].cycle - cycleCount));
+    }
+    return count;
+}
+
+void Emulator::execute(unsigned count)
+{
+    if (profiler || tracer)
+    {
+        observe(count); // observers see every instruction, so nothing is skipped
+        return;
+    }
+    if (!idleSkipping)
+    {
+        runBackend(count);
+        return;
+    }
+
+    // advance() never lets count cross a frame boundary or a replayed key event, so a loop
+    // that only waits for one of those stays idle for the rest of count
+    while (count > 0)
+    {
+        unsigned skipped = 0;
+        count -= processor.skipIdleLoop(count, skipped);
+        skippedCycles += skipped;
+
+        const unsigned chunk = std::min(count, IDLE_CHECK_INTERVAL);
+        runBackend(chunk);
+        count -= chunk;
+    }
+}
+
+void Emulator::runBackend(unsigned count)
+{
+    switch (backend)
+    {
+    case Backend::Interpreter:
+        for (unsigned i = 0; i < count; ++i)
+        {
+            processor.emulateCycle();
+        }
+        break;
+    case Backend::Cached:
+        for (unsigned executed = 0; executed < count; )
+        {
+            executed += cache->run(count - executed);
+        }
+        break;
+    case Backend::Jit:
+        for (unsigned executed = 0; executed < count; )
+        {
+            executed += jit->run(count - executed);
+        }
+        break;
+    case Backend::Aot:
+        for (unsigned executed = 0; executed < count; )
+        {
+            executed += aot->run(count - executed);
+        }
+        break;
+    }
+}
+
+void Emulator::observe(unsigned count)
+{
+    struct Both
+    {
+        Profiler& profiler;
+        TraceWriter& tracer;
+
+        void retired(const CPU& cpu, uint16_t address, uint16_t opcode)
+        {
+            profiler.retired(cpu, address, opcode);
+            tracer.retired(cpu, address, opcode);
+        }
+    };
+
+    if (tracer)
+    {
+        tracer->resume(processor, cycleCount);
+    }
+
+    if (profiler && tracer)
+    {
+        Both both{ *profiler, *tracer };
+        for (unsigned i = 0; i < count; ++i)
+        {
+            processor.emulateCycle(both);
+        }
+    }
+    else if (profiler)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            processor.emulateCycle(*profiler);
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            processor.emulateCycle(*tracer);
+        }
+    }
+}
+
+void Emulator::waitForNextFrame()
+{
+    if (pendingTicks == 0)
+    {
+        pendingTicks = frameScheduler.wait();
+        if (metrics)
+        {
+            metrics->observe(frameScheduler);
+        }
+    }
+    --pendingTicks; // after a stall the frames that fell due run without waiting
+}
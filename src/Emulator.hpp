@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Aot.hpp"
+#include "Audio.hpp"
+#include "BlockCache.hpp"
+#include "CPU.hpp"
+#include "FrameScheduler.hpp"
+#include "InputLog.hpp"
+#include "Jit.hpp"
+#include "Metrics.hpp"
+#include "Profiler.hpp"
+#include "Snapshot.hpp"
+#include "Trace.hpp"
+#include "VideoWriter.hpp"
+
+const unsigned TIMER_FREQUENCY = 60; // 60 Hz
+const unsigned DEFAULT_CYCLES_PER_SECOND = 600; // 600 Hz
+const unsigned MIN_CYCLES_PER_SECOND = 1;
+const unsigned UNLIMITED_CYCLES_PER_SECOND = 960000000; // 16M cycles per frame; idle loops still end a frame early in wall time
+const unsigned IDLE_CHECK_INTERVAL = 1024; // cycles run by the backend between two idle loop checks
+
+enum class Backend
+{
+    Interpreter, // fetch and decode every instruction
+    Cached,      // replay predecoded basic blocks (BlockCache)
+    Jit,         // translate basic blocks to x86-64 code (Jit)
+    Aot          // run code translated ahead of time by the Recompiler, interpret the rest (Aot)
+};
+
+// Frontend-independent emulation loop: owns the CPU, ticks the timers once every
+// cyclesPerFrame() executed cycles and optionally paces itself to real time.
+// Frame k runs floor((k + 1) * clock / 60) - floor(k * clock / 60) cycles, so any clock keeps
+// its exact average rate; below 60 Hz some frames run no instruction at all.
+class Emulator
+{
+public:
+    explicit Emulator(unsigned cyclesPerSecond = DEFAULT_CYCLES_PER_SECOND);
+    bool loadROM(const std::string& fileName);
+    bool loadROM(const std::vector<uint8_t>& image); // silent; false if the image does not fit in memory
+
+    void setClock(unsigned cyclesPerSecond); // clamped to [MIN_CYCLES_PER_SECOND, UNLIMITED_CYCLES_PER_SECOND]
+    void setRealtime(bool enabled); // restarts the frame scheduler
+    void setBackend(Backend backend); // throws std::runtime_error if the backend is unavailable
+    void setQuirks(QuirkProfile profile); // see CPU::setQuirks; once per ROM, before loading it, since it sizes memory
+    void setDifferential(bool enabled); // JIT and AOT backends: check all native code against the interpreter
+    void setProfiler(Profiler* profiler); // nullptr disables; while set, every backend interprets
+    void setTracer(TraceWriter* tracer); // likewise
+    void setSound(SoundChannel* channel); // nullptr detaches; posts sound timer edges to within an audio sample
+    void setVideo(VideoWriter* video); // nullptr detaches; captures the display at every timer tick
+    void setMetrics(Metrics* metrics); // nullptr detaches; counts instructions, ticks and beeps and times every advance()
+    void setIdleSkipping(bool enabled); // on by default: skip wait loops up to the next frame or event, see CPU::skipIdleLoop
+    unsigned clock() const;
+    unsigned cyclesPerFrame() const; // of the current frame
+
+    // Deterministic runs: with a fixed seed and every key change going through setKey or a
+    // replayed log, the same ROM and clock always produce the same state at the same cycle.
+    void setSeed(uint32_t seed);
+    void setKey(uint8_t key, bool pressed); // logged to the recorder, if any, stamped with cycles()
+    void setRecorder(InputLog* log); // nullptr stops recording; the log must outlive the recording
+    void setReplay(const InputLog* log); // applies each event right before its cycle executes
+    bool replaying() const; // true while replayed events are still pending
+
+    bool runFrame(); // returns true if the sound timer expires during this frame
+    void runFrames(uint64_t count);
+    void runCycles(uint64_t count);
+
+    uint64_t cycles() const;
+    uint64_t frames() const;
+    uint64_t idleCycles() const; // cycles skipped rather than executed, included in cycles()
+
+    std::shared_ptr<const Snapshot> snapshot(); // CPU state plus the cycle and frame counters
+    void restore(const std::shared_ptr<const Snapshot>& snapshot);
+    bool saveState(const std::string& fileName); // see writeSnapshot for the format
+    bool loadState(const std::string& fileName);
+
+    CPU& cpu();
+    const CPU& cpu() const;
+    const FrameScheduler& scheduler() const; // realtime pacing statistics
+    const AotProgram* recompiledProgram() const; // AOT backend: the program matching the loaded ROM, if any
+
+private:
+    void resetBackends();
+    void updateFrameBudget();
+    bool advance(unsigned count); // count must not cross a frame boundary; returns true if a sound timer expired
+    unsigned applyReplay(unsigned count); // applies due events, returns how much of count runs before the next one
+    void execute(unsigned count);
+    void runBackend(unsigned count);
+    void reportSound(); // posts an event if the tone started or stopped, then publishes cycleCount
+    void observe(unsigned count); // execute() with the profiler and/or tracer attached
+    void waitForNextFrame();
+
+private:
+    CPU processor;
+    std::unique_ptr<BlockCache> cache;
+    std::unique_ptr<Jit> jit;
+    std::unique_ptr<Aot> aot;
+    Backend backend;
+
+    unsigned cyclesPerSecond;
+    unsigned cyclesInFrame; // budget of frame frameCount, see updateFrameBudget
+    unsigned frameCycle;
+    uint64_t cycleCount;
+    uint64_t frameCount;
+
+    bool realtime;
+    FrameScheduler frameScheduler;
+    unsigned pendingTicks; // catch-up frames the scheduler granted that have not run yet
+
+    InputLog* recorder;
+    const InputLog* replay;
+    size_t replayPosition; // next event of replay to apply
+
+    Profiler* profiler;
+    TraceWriter* tracer;
+
+    bool idleSkipping;
+    uint64_t skippedCycles;
+
+    VideoWriter* video;
+    Metrics* metrics;
+    SoundChannel* sound;
+    bool soundPlaying; // last state posted to sound
+    unsigned soundResolution; // most cycles run between two sound checks: one audio sample's worth
+};
@@ -0,0 +1,112 @@
+#include "FrameScheduler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+namespace
+{
+    const FrameScheduler::Clock::duration INITIAL_MARGIN = std::chrono::milliseconds(1);
+    const FrameScheduler::Clock::duration MIN_MARGIN = std::chrono::microseconds(50);
+    const FrameScheduler::Clock::duration MAX_MARGIN = std::chrono::milliseconds(4);
+
+    double milliseconds(FrameScheduler::Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+}
+
+FrameScheduler::FrameScheduler(unsigned frequency, unsigned maxCatchUp) :
+    period{ std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / std::max(1u, frequency) },
+    maxCatchUp{ std::max(1u, maxCatchUp) },
+    margin{ INITIAL_MARGIN }
+{
+    reset();
+}
+
+void FrameScheduler::reset()
+{
+    deadline = Clock::now() + period;
+    tickCount = 0;
+    overrunCount = 0;
+    droppedCount = 0;
+    punctualCount = 0;
+    worstLateness = Clock::duration::zero();
+    totalError = Clock::duration::zero();
+}
+
+void FrameScheduler::resume()
+{
+    deadline = Clock::now() + period;
+}
+
+unsigned FrameScheduler::wait()
+{
+    Clock::time_point now = Clock::now();
+    if (now > deadline)
+    {
+        // run everything that fell due back to back, but after a long stall (a debugger,
+        // a suspended laptop) jump ahead rather than fast-forwarding through it
+        const Clock::duration lateness = now - deadline;
+        ++overrunCount;
+        worstLateness = std::max(worstLateness, lateness);
+
+        Clock::rep due = 1 + lateness / period;
+        if (due > maxCatchUp)
+        {
+            droppedCount += due - maxCatchUp;
+            due = maxCatchUp;
+            deadline = now + period;
+        }
+        else
+        {
+            deadline += due * period;
+        }
+        tickCount += due;
+        return static_cast<unsigned>(due);
+    }
+
+    const Clock::time_point wake = deadline - margin;
+    if (now < wake)
+    {
+        std::this_thread::sleep_until(wake);
+        // a sleep that overshot the margin raises it at once, shorter ones lower it slowly
+        const Clock::duration overshoot = Clock::now() - wake;
+        margin = (overshoot > margin) ? overshoot + overshoot / 4 : margin - (margin - overshoot) / 16;
+        margin = std::min(std::max(margin, MIN_MARGIN), MAX_MARGIN);
+    }
+    while ((now = Clock::now()) < deadline)
+    {
+        std::this_thread::yield();
+    }
+
+    ++punctualCount;
+    totalError += now - deadline;
+    deadline += period;
+    ++tickCount;
+    return 1;
+}
+
+uint64_t FrameScheduler::ticks() const
+{
+    return tickCount;
+}
+
+uint64_t FrameScheduler::overruns() const
+{
+    return overrunCount;
+}
+
+uint64_t FrameScheduler::droppedTicks() const
+{
+    return droppedCount;
+}
+
+void FrameScheduler::printReport(std::ostream& out) const
+{
+    out << std::fixed << std::setprecision(3)
+        << "scheduler: " << tickCount << " ticks, " << overrunCount << " late (worst " << milliseconds(worstLateness)
+        << " ms), " << droppedCount << " dropped, mean wake-up error "
+        << (punctualCount ? milliseconds(totalError) / punctualCount : 0.0)
+        << " ms, sleep margin " << milliseconds(margin) << " ms" << std::defaultfloat << std::endl;
+}
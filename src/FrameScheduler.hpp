@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+const unsigned DEFAULT_MAX_CATCH_UP = 4; // ticks run back to back after a stall before the rest are dropped
+
+// Paces a loop to a fixed tick rate without burning a core. Ticks are due at fixed multiples
+// of the period from reset(), so waking up late never shifts later ticks. wait() sleeps until
+// shortly before the deadline and yields for the remainder; the sleep margin adapts to how
+// late the host's sleeps have actually been returning.
+class FrameScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FrameScheduler(unsigned frequency, unsigned maxCatchUp = DEFAULT_MAX_CATCH_UP);
+
+    void reset(); // the first tick is due one period from now; clears the statistics
+    void resume(); // after running unpaced: the next tick is due one period from now, not a late one
+
+    // Blocks until the next tick is due and returns how many ticks to run now: 1 when on
+    // time, up to maxCatchUp after a stall. Ticks beyond that are dropped and counted.
+    unsigned wait();
+
+    uint64_t ticks() const; // ticks handed out by wait(), including catch-up ticks
+    uint64_t overruns() const; // calls to wait() that found their tick already late
+    uint64_t droppedTicks() const;
+    void printReport(std::ostream& out) const;
+
+private:
+    Clock::duration period;
+    unsigned maxCatchUp;
+    Clock::time_point deadline; // of the next tick
+    Clock::duration margin; // how early to stop sleeping and start yielding
+
+    uint64_t tickCount;
+    uint64_t overrunCount;
+    uint64_t droppedCount;
+    uint64_t punctualCount; // calls to wait() that had to wait
+    Clock::duration worstLateness;
+    Clock::duration totalError; // summed wake-up time - deadline of the punctual calls
+};
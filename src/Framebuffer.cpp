@@ -0,0 +1,315 @@
+#include "Framebuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    uint64_t rotateRight(uint64_t value, unsigned shift)
+    {
+        return (value >> shift) | (value << ((64 - shift) & 63));
+    }
+}
+
+bool DisplayState::operator==(const DisplayState& other) const
+{
+    return std::memcmp(rows, other.rows, sizeof(rows)) == 0 && hires == other.hires && planes == other.planes;
+}
+
+bool DisplayState::operator!=(const DisplayState& other) const
+{
+    return !(*this == other);
+}
+
+Framebuffer::Framebuffer() :
+    edge{ SpriteEdge::Wrap }
+{
+    std::memset(display.rows, 0, sizeof(display.rows));
+    display.hires = false;
+    display.planes = 0x1;
+}
+
+void Framebuffer::clear()
+{
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+        std::memset(display.rows[plane], 0, height() * sizeof(display.rows[plane][0]));
+    }
+}
+
+bool Framebuffer::drawSprite(unsigned x, unsigned y, const uint8_t* sprite, unsigned height, bool wide)
+{
+    if (!display.hires && !wide && display.planes == 0x1)
+    {
+        return drawPlainSprite(x, y, sprite, height);
+    }
+
+    // a line is rotated into the word holding x and, unless x is word aligned, spills into
+    // the next one: past the right edge that is word 0 again when wrapping and nothing when
+    // clipping; in low resolution a wrapping line stays within its single word
+    const unsigned words = width() / 64;
+    const unsigned rows = this->height();
+    x &= words * 64 - 1; // both resolutions are powers of two, which spares a division per draw
+    y &= rows - 1;
+    const unsigned first = x / 64;
+    const unsigned shift = x % 64;
+    const unsigned next = (first + 1 < words) ? first + 1 : (edge == SpriteEdge::Wrap) ? 0 : words;
+    const uint64_t kept = (next == first) ? ~uint64_t(0) : ~uint64_t(0) >> shift;
+    const uint64_t spilled = (next < words && next != first) ? ~kept : 0;
+    const unsigned second = (next < words) ? next : first; // gets nothing when clipped
+    const unsigned lines = (edge == SpriteEdge::Clip) ? std::min(height, rows - y) : height;
+
+    uint64_t collision = 0;
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+
+        for (unsigned i = 0; i < lines; ++i)
+        {
+            unsigned line = y + i;
+            if (line >= rows)
+            {
+                line -= rows;
+            }
+
+            const uint64_t bits = wide ? static_cast<uint64_t>(sprite[2 * i] << 8 | sprite[2 * i + 1]) << 48 : static_cast<uint64_t>(sprite[i]) << 56;
+            const uint64_t pixels = rotateRight(bits, shift);
+            uint64_t* row = display.rows[plane][line];
+            collision |= (row[first] & pixels & kept) | (row[second] & pixels & spilled);
+            row[first] ^= pixels & kept;
+            row[second] ^= pixels & spilled;
+        }
+        sprite += height * (wide ? 2 : 1);
+    }
+    return collision != 0;
+}
+
+unsigned Framebuffer::spriteSize(unsigned height, bool wide) const
+{
+    const unsigned planes = (display.planes & 0x1) + ((display.planes >> 1) & 0x1);
+    return planes * height * (wide ? 2 : 1);
+}
+
+void Framebuffer::setHires(bool enabled)
+{
+    std::memset(display.rows, 0, sizeof(display.rows));
+    display.hires = enabled;
+}
+
+bool Framebuffer::hires() const
+{
+    return display.hires;
+}
+
+unsigned Framebuffer::width() const
+{
+    return display.hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+}
+
+unsigned Framebuffer::height() const
+{
+    return display.hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+}
+
+void Framebuffer::selectPlanes(uint8_t planes)
+{
+    display.planes = planes & ((1u << DISPLAY_PLANES) - 1);
+}
+
+uint8_t Framebuffer::selectedPlanes() const
+{
+    return display.planes;
+}
+
+void Framebuffer::scrollDown(unsigned rows)
+{
+    const unsigned height = this->height();
+    rows = std::min(rows, height);
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+        uint64_t (*bits)[ROW_WORDS] = display.rows[plane];
+        std::memmove(bits[rows], bits[0], (height - rows) * sizeof(bits[0]));
+        std::memset(bits[0], 0, rows * sizeof(bits[0]));
+    }
+}
+
+void Framebuffer::scrollUp(unsigned rows)
+{
+    const unsigned height = this->height();
+    rows = std::min(rows, height);
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+        uint64_t (*bits)[ROW_WORDS] = display.rows[plane];
+        std::memmove(bits[0], bits[rows], (height - rows) * sizeof(bits[0]));
+        std::memset(bits[height - rows], 0, rows * sizeof(bits[0]));
+    }
+}
+
+void Framebuffer::scrollRight()
+{
+    const unsigned words = width() / 64;
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+        for (unsigned y = 0; y < height(); ++y)
+        {
+            uint64_t* row = display.rows[plane][y];
+            uint64_t moved[ROW_WORDS] = {};
+            for (unsigned word = 0; word < words; ++word)
+            {
+                moved[word] = row[word] >> 4 | ((word > 0) ? row[word - 1] << 60 : 0);
+            }
+            std::copy(std::begin(moved), std::end(moved), row);
+        }
+    }
+}
+
+void Framebuffer::scrollLeft()
+{
+    const unsigned words = width() / 64;
+    for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!(display.planes & (1u << plane)))
+        {
+            continue;
+        }
+        for (unsigned y = 0; y < height(); ++y)
+        {
+            uint64_t* row = display.rows[plane][y];
+            uint64_t moved[ROW_WORDS] = {};
+            for (unsigned word = 0; word < words; ++word)
+            {
+                moved[word] = row[word] << 4 | ((word + 1 < words) ? row[word + 1] >> 60 : 0);
+            }
+            std::copy(std::begin(moved), std::end(moved), row);
+        }
+    }
+}
+
+void Framebuffer::setSpriteEdge(SpriteEdge edge)
+{
+    this->edge = edge;
+}
+
+SpriteEdge Framebuffer::spriteEdge() const
+{
+    return edge;
+}
+
+uint64_t Framebuffer::rowsDifferingFrom(const DisplayState& other) const
+{
+    if (other.hires != display.hires)
+    {
+        return allRows();
+    }
+
+    uint64_t rows = 0;
+    for (unsigned y = 0; y < height(); ++y)
+    {
+        bool same = true;
+        for (unsigned plane = 0; plane < DISPLAY_PLANES; ++plane)
+        {
+            for (unsigned word = 0; word < ROW_WORDS; ++word)
+            {
+                same = same && display.rows[plane][y][word] == other.rows[plane][y][word];
+            }
+        }
+        rows |= static_cast<uint64_t>(!same) << y;
+    }
+    return rows;
+}
+
+bool Framebuffer::pixel(unsigned x, unsigned y) const
+{
+    return color(x, y) != 0;
+}
+
+unsigned Framebuffer::color(unsigned x, unsigned y) const
+{
+    const unsigned shift = 63 - x % 64;
+    return ((display.rows[0][y][x / 64] >> shift) & 0x1) | ((display.rows[1][y][x / 64] >> shift) & 0x1) << 1;
+}
+
+const DisplayState& Framebuffer::state() const
+{
+    return display;
+}
+
+void Framebuffer::setState(const DisplayState& state)
+{
+    display = state;
+}
+
+bool Framebuffer::operator==(const Framebuffer& other) const
+{
+    return display == other.display && edge == other.edge;
+}
+
+bool Framebuffer::operator!=(const Framebuffer& other) const
+{
+    return !(*this == other);
+}
+
+unsigned Framebuffer::leadingZeros(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(value);
+#else
+    unsigned count = 0;
+    for (uint64_t bit = 0x8000000000000000ull; (value & bit) == 0; bit >>= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+bool Framebuffer::drawPlainSprite(unsigned x, unsigned y, const uint8_t* sprite, unsigned height)
+{
+    x %= DISPLAY_WIDTH;
+    y %= DISPLAY_HEIGHT;
+
+    uint64_t collision = 0;
+    for (unsigned i = 0; i < height; ++i)
+    {
+        unsigned line = y + i;
+        if (line >= DISPLAY_HEIGHT)
+        {
+            if (edge == SpriteEdge::Clip)
+            {
+                break;
+            }
+            line -= DISPLAY_HEIGHT;
+        }
+
+        const uint64_t bits = static_cast<uint64_t>(sprite[i]) << 56;
+        const uint64_t mask = (edge == SpriteEdge::Clip) ? bits >> x : rotateRight(bits, x);
+        collision |= display.rows[0][line][0] & mask;
+        display.rows[0][line][0] ^= mask;
+    }
+    return collision != 0;
+}
+
+uint64_t Framebuffer::allRows() const
+{
+    return ~uint64_t(0) >> (64 - height());
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+const unsigned DISPLAY_WIDTH = 64;
+const unsigned DISPLAY_HEIGHT = 32;
+const unsigned HIRES_DISPLAY_WIDTH = 128; // SUPER-CHIP high resolution mode (00FF)
+const unsigned HIRES_DISPLAY_HEIGHT = 64;
+const unsigned DISPLAY_PLANES = 2; // XO-CHIP bitplanes, selected with FN01
+const unsigned ROW_WORDS = HIRES_DISPLAY_WIDTH / 64;
+
+// RGB of each pixel color, the color being the bitplanes the pixel is lit in: a plain CHIP-8
+// program only ever draws to plane 0 and stays white on black.
+const uint8_t DISPLAY_PALETTE[1 << DISPLAY_PLANES][3] =
+{
+    { 0x00, 0x00, 0x00 },
+    { 0xFF, 0xFF, 0xFF },
+    { 0xAA, 0xAA, 0xAA },
+    { 0x55, 0x55, 0x55 }
+};
+
+// What happens to sprite pixels that fall past the right or bottom edge.
+// The sprite origin itself always wraps around the screen.
+enum class SpriteEdge
+{
+    Clip,
+    Wrap
+};
+
+// Everything a snapshot needs to rebuild a Framebuffer. Pixel x of row y in a plane is bit
+// (63 - x % 64) of rows[plane][y][x / 64]; in low resolution only the first DISPLAY_HEIGHT
+// rows and the first word of each are used, the rest stays 0.
+struct DisplayState
+{
+    uint64_t rows[DISPLAY_PLANES][HIRES_DISPLAY_HEIGHT][ROW_WORDS];
+    bool hires;
+    uint8_t planes; // bit p: plane p is drawn to, cleared and scrolled
+
+    bool operator==(const DisplayState& other) const;
+    bool operator!=(const DisplayState& other) const;
+};
+
+// 1 bit per pixel and plane framebuffer, packed 64 pixels to a word. Rows are counted in the
+// current resolution: 32 rows of 64 pixels, or 64 of 128 in high resolution.
+class Framebuffer
+{
+public:
+    Framebuffer();
+
+    void clear(); // the selected planes
+    // Draws height lines on each selected plane in turn, reading the lines of plane 0 first;
+    // a line is one byte, or two for the 16x16 sprites of DXY0. Returns true on collision.
+    bool drawSprite(unsigned x, unsigned y, const uint8_t* sprite, unsigned height, bool wide = false);
+    unsigned spriteSize(unsigned height, bool wide) const; // bytes drawSprite reads
+
+    void setHires(bool enabled); // 00FF/00FE; clears every plane
+    bool hires() const;
+    unsigned width() const;
+    unsigned height() const;
+    void selectPlanes(uint8_t planes); // FN01
+    uint8_t selectedPlanes() const;
+
+    // 00CN, 00DN, 00FB and 00FC: the selected planes move by whole rows, or by whole words
+    // shifted 4 pixels; what moves in is blank
+    void scrollDown(unsigned rows);
+    void scrollUp(unsigned rows);
+    void scrollRight();
+    void scrollLeft();
+
+    void setSpriteEdge(SpriteEdge edge);
+    SpriteEdge spriteEdge() const;
+
+    uint64_t rowsDifferingFrom(const DisplayState& other) const; // every row if the resolution differs
+
+    bool pixel(unsigned x, unsigned y) const; // lit in any plane
+    unsigned color(unsigned x, unsigned y) const; // bit p: lit in plane p, an index into DISPLAY_PALETTE
+    const DisplayState& state() const;
+    void setState(const DisplayState& state); // e.g. when restoring a snapshot
+
+    template <typename Function>
+    void forEachLitPixel(Function function) const // function(x, y) for every pixel lit in any plane, row by row
+    {
+        for (unsigned y = 0; y < height(); ++y)
+        {
+            for (unsigned word = 0; word < width() / 64; ++word)
+            {
+                for (uint64_t bits = display.rows[0][y][word] | display.rows[1][y][word]; bits != 0; )
+                {
+                    const unsigned x = leadingZeros(bits);
+                    function(word * 64 + x, y);
+                    bits &= ~(0x8000000000000000ull >> x);
+                }
+            }
+        }
+    }
+
+    bool operator==(const Framebuffer& other) const;
+    bool operator!=(const Framebuffer& other) const;
+
+private:
+    bool drawPlainSprite(unsigned x, unsigned y, const uint8_t* sprite, unsigned height); // low resolution, plane 0 only
+    static unsigned leadingZeros(uint64_t value); // value must not be 0
+    uint64_t allRows() const;
+
+private:
+    DisplayState display;
+    SpriteEdge edge;
+};
@@ -0,0 +1,164 @@
+#include "InputLog.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+InputLog::InputLog() :
+    seeded{ false },
+    seedValue{ 0 },
+    cyclesPerSecond{ 0 },
+    cycleCount{ 0 }
+{
+}
+
+bool InputLog::load(const std::string& fileName)
+{
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    entries.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        std::istringstream fields(line);
+        std::string directive;
+        if (fields >> directive && !std::isdigit(static_cast<unsigned char>(directive[0])))
+        {
+            uint64_t value;
+            if (!(fields >> value))
+            {
+                return false;
+            }
+            if (directive == "seed")
+            {
+                setSeed(static_cast<uint32_t>(value));
+            }
+            else if (directive == "clock")
+            {
+                cyclesPerSecond = static_cast<unsigned>(value);
+            }
+            else if (directive == "cycles")
+            {
+                cycleCount = value;
+            }
+            else
+            {
+                return false;
+            }
+            continue;
+        }
+        fields.clear();
+        fields.seekg(0);
+
+        uint64_t cycle;
+        unsigned key;
+        unsigned pressed;
+        if (!(fields >> cycle))
+        {
+            continue;
+        }
+        if (!(fields >> std::hex >> key >> std::dec >> pressed) || key > 0xF)
+        {
+            return false;
+        }
+        entries.push_back({ cycle, static_cast<uint8_t>(key), pressed != 0 });
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+        [](const InputEvent& a, const InputEvent& b) { return a.cycle < b.cycle; });
+    return true;
+}
+
+bool InputLog::save(const std::string& fileName) const
+{
+    std::ofstream file(fileName.c_str());
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    if (seeded)
+    {
+        file << "seed " << seedValue << '\n';
+    }
+    if (cyclesPerSecond != 0)
+    {
+        file << "clock " << cyclesPerSecond << '\n';
+    }
+    if (cycleCount != 0)
+    {
+        file << "cycles " << cycleCount << '\n';
+    }
+    file << "# cycle key pressed\n";
+    for (const InputEvent& event : entries)
+    {
+        file << event.cycle << ' ' << std::hex << static_cast<unsigned>(event.key) << std::dec
+            << ' ' << (event.pressed ? 1 : 0) << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+void InputLog::add(const InputEvent& event)
+{
+    entries.push_back(event);
+}
+
+void InputLog::truncate(uint64_t cycle)
+{
+    while (!entries.empty() && entries.back().cycle > cycle)
+    {
+        entries.pop_back();
+    }
+}
+
+const std::vector<InputEvent>& InputLog::events() const
+{
+    return entries;
+}
+
+void InputLog::setSeed(uint32_t seed)
+{
+    seeded = true;
+    seedValue = seed;
+}
+
+bool InputLog::hasSeed() const
+{
+    return seeded;
+}
+
+uint32_t InputLog::seed() const
+{
+    return seedValue;
+}
+
+void InputLog::setClock(unsigned cyclesPerSecond)
+{
+    this->cyclesPerSecond = cyclesPerSecond;
+}
+
+unsigned InputLog::clock() const
+{
+    return cyclesPerSecond;
+}
+
+void InputLog::setLength(uint64_t cycles)
+{
+    cycleCount = cycles;
+}
+
+uint64_t InputLog::length() const
+{
+    return cycleCount;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct InputEvent
+{
+    uint64_t cycle; // emulated instruction count at which the key changes
+    uint8_t key; // 0x0 - 0xF
+    bool pressed;
+};
+
+// Key transitions stamped with emulated cycles. Text format, one event per line:
+// "<cycle> <key in hex> <1 = pressed | 0 = released>"; blank lines and '#' comments are ignored.
+// Optional "seed <n>", "clock <hz>" and "cycles <n>" lines describe the recorded session.
+class InputLog
+{
+public:
+    InputLog();
+
+    bool load(const std::string& fileName);
+    bool save(const std::string& fileName) const;
+
+    void add(const InputEvent& event); // events must be added in cycle order
+    void truncate(uint64_t cycle); // drops the events after cycle
+    const std::vector<InputEvent>& events() const;
+
+    void setSeed(uint32_t seed);
+    bool hasSeed() const;
+    uint32_t seed() const;
+    void setClock(unsigned cyclesPerSecond);
+    unsigned clock() const; // 0 if not recorded
+    void setLength(uint64_t cycles);
+    uint64_t length() const; // cycles covered by the session, 0 if not recorded
+
+private:
+    std::vector<InputEvent> entries;
+    bool seeded;
+    uint32_t seedValue;
+    unsigned cyclesPerSecond;
+    uint64_t cycleCount;
+};
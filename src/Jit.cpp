@@ -0,0 +1,422 @@
+#include "Jit.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+namespace
+{
+    // Minimal x86-64 encoder for the handful of forms the translator needs.
+    // Every memory operand is [rbx + disp32] with rbx holding the CPU pointer.
+    class Assembler
+    {
+    public:
+        std::vector<uint8_t> bytes;
+
+        void byte(uint8_t value) { bytes.push_back(value); }
+        void word(uint16_t value) { byte(value & 0xFF); byte(value >> 8); }
+        void dword(uint32_t value) { word(value & 0xFFFF); word(value >> 16); }
+        void qword(uint64_t value) { dword(value & 0xFFFFFFFF); dword(value >> 32); }
+
+        void modrm(uint8_t reg, int32_t disp) { byte(0x80 | (reg << 3) | 0x3); dword(static_cast<uint32_t>(disp)); }
+
+        void movMemImm8(int32_t disp, uint8_t value) { byte(0xC6); modrm(0, disp); byte(value); }
+        void addMemImm8(int32_t disp, uint8_t value) { byte(0x80); modrm(0, disp); byte(value); }
+        void cmpMemImm8(int32_t disp, uint8_t value) { byte(0x80); modrm(7, disp); byte(value); }
+        void movMemImm16(int32_t disp, uint16_t value) { byte(0x66); byte(0xC7); modrm(0, disp); word(value); }
+        void movAlMem(int32_t disp) { byte(0x8A); modrm(0, disp); }
+        void movMemAl(int32_t disp) { byte(0x88); modrm(0, disp); }
+        void movzxEaxMem8(int32_t disp) { byte(0x0F); byte(0xB6); modrm(0, disp); }
+        void addMem16Ax(int32_t disp) { byte(0x66); byte(0x01); modrm(0, disp); }
+        void aluMemAl(uint8_t opcode, int32_t disp) { byte(opcode); modrm(0, disp); } // or 08, and 20, xor 30
+        void aluAlMem(uint8_t opcode, int32_t disp) { byte(opcode); modrm(0, disp); } // add 02, sub 2A, cmp 3A
+        void shiftMem8(uint8_t ext, int32_t disp) { byte(0xD0); modrm(ext, disp); } // shl 4, shr 5
+        void setccAl(uint8_t condition) { byte(0x0F); byte(condition); byte(0xC0); }
+        void andAlImm8(uint8_t value) { byte(0x24); byte(value); }
+        void shrAlImm8(uint8_t value) { byte(0xC0); byte(0xE8); byte(value); }
+
+        void callHelper(const void* function, const void* argument)
+        {
+            byte(0x48); byte(0x89); byte(0xDF); // mov rdi, rbx
+            byte(0x48); byte(0xBE); qword(reinterpret_cast<uint64_t>(argument)); // mov rsi, imm64
+            byte(0x48); byte(0xB8); qword(reinterpret_cast<uint64_t>(function)); // mov rax, imm64
+            byte(0xFF); byte(0xD0); // call rax
+        }
+
+        void decCounter() { byte(0x41); byte(0xFF); byte(0xCC); } // dec r12d
+        size_t jumpIfZero() { byte(0x0F); byte(0x84); dword(0); return bytes.size() - 4; }
+        size_t jump() { byte(0xE9); dword(0); return bytes.size() - 4; }
+        size_t shortJump(uint8_t opcode) { byte(opcode); byte(0); return bytes.size() - 1; } // je 74, jne 75
+        void bindShort(size_t at) { bytes[at] = static_cast<uint8_t>(bytes.size() - at - 1); }
+        void bind(size_t at, size_t target)
+        {
+            const uint32_t rel = static_cast<uint32_t>(target - (at + 4));
+            std::memcpy(&bytes[at], &rel, sizeof(rel));
+        }
+
+        void prologue()
+        {
+            byte(0x53); // push rbx
+            byte(0x41); byte(0x54); // push r12
+            byte(0x48); byte(0x83); byte(0xEC); byte(0x08); // sub rsp, 8
+            byte(0x48); byte(0x89); byte(0xFB); // mov rbx, rdi
+            byte(0x41); byte(0x89); byte(0xF4); // mov r12d, esi
+        }
+
+        void epilogue()
+        {
+            byte(0x48); byte(0x83); byte(0xC4); byte(0x08); // add rsp, 8
+            byte(0x41); byte(0x5C); // pop r12
+            byte(0x5B); // pop rbx
+            byte(0xC3); // ret
+        }
+    };
+
+    void executeHelper(CPU* cpu, const CPU::Instruction* op)
+    {
+        cpu->execute(*op);
+    }
+
+    template <typename T>
+    int32_t offsetIn(const CPU& cpu, const T& member)
+    {
+        return static_cast<int32_t>(reinterpret_cast<const char*>(&member) - reinterpret_cast<const char*>(&cpu));
+    }
+}
+
+Jit::Jit(CPU& cpu) :
+    cpu{ cpu },
+    cache{ cpu },
+    code{ nullptr },
+    codeUsed{ 0 }
+{
+#if CHIP8_JIT_SUPPORTED
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED)
+    {
+        code = static_cast<uint8_t*>(buffer);
+    }
+#endif
+}
+
+Jit::~Jit()
+{
+#if CHIP8_JIT_SUPPORTED
+    if (code)
+    {
+        munmap(code, CODE_BUFFER_SIZE);
+    }
+#endif
+}
+
+bool Jit::available()
+{
+    return CHIP8_JIT_SUPPORTED != 0;
+}
+
+unsigned Jit::run(unsigned budget)
+{
+    if (!code)
+    {
+        throw std::runtime_error("JIT backend is not available on this host");
+    }
+
+    unsigned executed = 0;
+    while (executed < budget)
+    {
+        executed += shadow ? runChecked() : runBlock(budget - executed);
+    }
+    return executed;
+}
+
+void Jit::clear()
+{
+    flush();
+}
+
+void Jit::setDifferential(bool enabled)
+{
+    shadow.reset(enabled ? new CPU(cpu) : nullptr);
+}
+
+unsigned Jit::runBlock(unsigned budget)
+{
+    cache.invalidateWrites();
+    BlockCache::Block* block = &cache.lookup(cpu.programCounter());
+    if (!block->native)
+    {
+        if (!compile(*block))
+        {
+            flush();
+            block = &cache.lookup(cpu.programCounter());
+            compile(*block);
+        }
+    }
+
+    // compile() stops translating at the first unknown opcode, whose handler throws;
+    // exceptions must not unwind through generated code, so run it here instead
+    if (block->nativeLength == 0)
+    {
+        cpu.execute(block->ops.front());
+        return 1;
+    }
+
+    const unsigned count = std::min<unsigned>(block->nativeLength, budget);
+    reinterpret_cast<BlockFunction>(block->native)(&cpu, count);
+    return count;
+}
+
+unsigned Jit::runChecked()
+{
+    *shadow = cpu;
+    const uint16_t pc = cpu.programCounter();
+    const uint16_t opcode = cpu.fetch(pc);
+
+    shadow->emulateCycle();
+    runBlock(1);
+
+    if (!cpu.sameState(*shadow))
+    {
+        std::ostringstream message;
+        message << std::hex << std::uppercase << "JIT diverged from the interpreter executing opcode 0x"
+            << opcode << " at address 0x" << pc << "\nJIT:\n";
+        cpu.printState(message);
+        message << "interpreter:\n";
+        shadow->printState(message);
+        throw std::runtime_error(message.str());
+    }
+    return 1;
+}
+
+bool Jit::compile(BlockCache::Block& block)
+{
+#if CHIP8_JIT_SUPPORTED
+    const int32_t pcOffset = offsetIn(cpu, cpu.pc);
+    const int32_t iOffset = offsetIn(cpu, cpu.I);
+    const int32_t delayOffset = offsetIn(cpu, cpu.delayTimer);
+    const int32_t soundOffset = offsetIn(cpu, cpu.soundTimer);
+    auto v = [&](uint8_t index) { return offsetIn(cpu, cpu.V[index]); };
+    const Quirks quirks = quirksOf(cpu.quirks()); // instructions a quirk changes go through the handlers
+
+    Assembler a;
+    std::vector<size_t> exits;
+    a.prologue();
+
+    uint16_t address = block.start;
+    uint16_t length = 0;
+    for (const CPU::Instruction& op : block.ops)
+    {
+        if (CPU::isUnknown(op))
+        {
+            break; // unknown opcode, see runBlock
+        }
+
+        const uint16_t next = address + 2;
+        bool native = true;
+        bool setsPc = false;
+        switch (op.opcode >> 12)
+        {
+        case 0x1:
+            a.movMemImm16(pcOffset, op.nnn);
+            setsPc = true;
+            break;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        {
+            if (quirks.longSkips || (quirks.xoChipOpcodes && (op.opcode >> 12) == 0x5 && (op.n == 0x2 || op.n == 0x3)))
+            {
+                native = false; // the skip distance depends on the next instruction; 5XY2/5XY3 are no skips
+                break;
+            }
+            a.movMemImm16(pcOffset, next);
+            if ((op.opcode >> 12) == 0x3 || (op.opcode >> 12) == 0x4)
+            {
+                a.cmpMemImm8(v(op.x), op.nn);
+            }
+            else
+            {
+                a.movAlMem(v(op.x));
+                a.aluAlMem(0x3A, v(op.y));
+            }
+            const bool skipIfEqual = (op.opcode >> 12) == 0x3 || (op.opcode >> 12) == 0x5;
+            const size_t noSkip = a.shortJump(skipIfEqual ? 0x75 : 0x74);
+            a.movMemImm16(pcOffset, next + 2);
+            a.bindShort(noSkip);
+            setsPc = true;
+            break;
+        }
+        case 0x6:
+            a.movMemImm8(v(op.x), op.nn);
+            break;
+        case 0x7:
+            a.addMemImm8(v(op.x), op.nn);
+            break;
+        case 0x8:
+            switch (op.n)
+            {
+            case 0x0:
+                a.movAlMem(v(op.y));
+                a.movMemAl(v(op.x));
+                break;
+            case 0x1:
+            case 0x2:
+            case 0x3:
+                if (quirks.logicClearsVF)
+                {
+                    native = false;
+                    break;
+                }
+                a.movAlMem(v(op.y));
+                a.aluMemAl(op.n == 0x1 ? 0x08 : op.n == 0x2 ? 0x20 : 0x30, v(op.x));
+                break;
+            case 0x4: // VF is written before VX, exactly like the interpreter (matters when X or Y is F)
+            case 0x5:
+            case 0x7:
+                a.movAlMem(v(op.x));
+                if (op.n == 0x4)
+                {
+                    a.aluAlMem(0x02, v(op.y));
+                    a.setccAl(0x92); // setc
+                }
+                else
+                {
+                    a.aluAlMem(0x3A, v(op.y));
+                    a.setccAl(op.n == 0x5 ? 0x93 : 0x96); // setae / setbe
+                }
+                a.movMemAl(v(0xF));
+                a.movAlMem(op.n == 0x7 ? v(op.y) : v(op.x));
+                a.aluAlMem(op.n == 0x4 ? 0x02 : 0x2A, op.n == 0x7 ? v(op.x) : v(op.y));
+                a.movMemAl(v(op.x));
+                break;
+            case 0x6:
+                if (quirks.shiftReadsVY)
+                {
+                    native = false;
+                    break;
+                }
+                a.movAlMem(v(op.x));
+                a.andAlImm8(0x1);
+                a.movMemAl(v(0xF));
+                a.shiftMem8(5, v(op.x));
+                break;
+            case 0xE:
+                if (quirks.shiftReadsVY)
+                {
+                    native = false;
+                    break;
+                }
+                a.movAlMem(v(op.x));
+                a.shrAlImm8(7);
+                a.movMemAl(v(0xF));
+                a.shiftMem8(4, v(op.x));
+                break;
+            default:
+                native = false;
+                break;
+            }
+            break;
+        case 0xA:
+            a.movMemImm16(iOffset, op.nnn);
+            break;
+        case 0xF:
+            switch (op.nn)
+            {
+            case 0x07:
+                a.movAlMem(delayOffset);
+                a.movMemAl(v(op.x));
+                break;
+            case 0x15:
+            case 0x18:
+                a.movAlMem(v(op.x));
+                a.movMemAl(op.nn == 0x15 ? delayOffset : soundOffset);
+                break;
+            case 0x1E:
+                a.movzxEaxMem8(v(op.x));
+                a.addMem16Ax(iOffset);
+                break;
+            default:
+                native = false;
+                break;
+            }
+            break;
+        default:
+            native = false;
+            break;
+        }
+
+        if (!native)
+        {
+            a.movMemImm16(pcOffset, address); // handlers read and advance pc themselves
+            a.callHelper(reinterpret_cast<const void*>(&executeHelper), &op);
+            setsPc = true;
+        }
+
+        if (setsPc)
+        {
+            a.decCounter();
+            exits.push_back(a.jumpIfZero());
+        }
+        else
+        {
+            a.decCounter();
+            const size_t more = a.shortJump(0x75);
+            a.movMemImm16(pcOffset, next);
+            exits.push_back(a.jump());
+            a.bindShort(more);
+        }
+        address = next;
+        ++length;
+    }
+
+    const size_t epilogue = a.bytes.size();
+    a.epilogue();
+    for (size_t exit : exits)
+    {
+        a.bind(exit, epilogue);
+    }
+
+    if (codeUsed + a.bytes.size() > CODE_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    // the buffer is never writable and executable at once; a host that refuses either
+    // switch (e.g. one denying executable mappings) cannot run the JIT at all
+    uint8_t* target = code + codeUsed;
+    if (mprotect(code, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0)
+    {
+        throw std::runtime_error(std::string("JIT cannot make its code buffer writable: ") + std::strerror(errno));
+    }
+    std::memcpy(target, a.bytes.data(), a.bytes.size());
+    if (mprotect(code, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0)
+    {
+        throw std::runtime_error(std::string("JIT cannot make its code buffer executable: ") + std::strerror(errno));
+    }
+    codeUsed += (a.bytes.size() + 15) & ~static_cast<size_t>(15);
+
+    block.native = target;
+    block.nativeLength = length;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::flush()
+{
+    cache.clear();
+    codeUsed = 0;
+}
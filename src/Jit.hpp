@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "BlockCache.hpp"
+#include "CPU.hpp"
+
+// x86-64 dynamic recompiler. Basic blocks found by a BlockCache are translated into
+// native code in an mmap'd buffer; the CPU object itself is the pinned register context
+// (rbx points at it while a block runs). Instructions without a native translation call
+// back into the interpreter handlers. Only available on x86-64 POSIX hosts.
+class Jit
+{
+public:
+    explicit Jit(CPU& cpu);
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static bool available();
+
+    unsigned run(unsigned budget); // executes up to budget (>= 1) instructions, returns how many ran
+    void clear(); // must be called after memory is modified outside of the CPU (e.g. a ROM load)
+
+    // Differential mode: every instruction is also executed by the interpreter on a copy of
+    // the machine and the results are compared; a mismatch throws std::runtime_error.
+    void setDifferential(bool enabled);
+
+private:
+    typedef void (*BlockFunction)(CPU* cpu, unsigned count);
+
+    unsigned runBlock(unsigned budget);
+    unsigned runChecked();
+    bool compile(BlockCache::Block& block); // false if the code buffer is full; throws std::runtime_error if mprotect fails
+    void flush();
+
+private:
+    static const size_t CODE_BUFFER_SIZE = 1 << 20;
+
+    CPU& cpu;
+    BlockCache cache;
+    uint8_t* code;
+    size_t codeUsed;
+    std::unique_ptr<CPU> shadow;
+};
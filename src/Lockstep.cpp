@@ -0,0 +1,515 @@
+#include "Lockstep.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Byte-lane vector helpers. Lanes past the last machine are padding and may hold garbage.
+#if defined(__AVX2__)
+    typedef __m256i Vec;
+    const size_t VECTOR_WIDTH = 32;
+    inline Vec load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void store(uint8_t* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline Vec splat(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    inline Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+    inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+    inline Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    inline Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    inline Vec bitXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+    inline Vec andNot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); } // ~a & b
+    inline Vec max(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+    inline Vec equal(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+    inline Vec shiftRight(Vec a, int bits) { return _mm256_srli_epi16(a, bits); }
+#elif defined(__SSE2__) || defined(_M_X64)
+    typedef __m128i Vec;
+    const size_t VECTOR_WIDTH = 16;
+    inline Vec load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void store(uint8_t* p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline Vec splat(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    inline Vec add(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+    inline Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+    inline Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    inline Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    inline Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+    inline Vec andNot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+    inline Vec max(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+    inline Vec equal(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+    inline Vec shiftRight(Vec a, int bits) { return _mm_srli_epi16(a, bits); }
+#else
+    struct Vec { uint8_t lane[8]; };
+    const size_t VECTOR_WIDTH = 8;
+    template <typename Function>
+    inline Vec map(Vec a, Vec b, Function function)
+    {
+        Vec result;
+        for (size_t i = 0; i < VECTOR_WIDTH; ++i)
+        {
+            result.lane[i] = static_cast<uint8_t>(function(a.lane[i], b.lane[i]));
+        }
+        return result;
+    }
+    inline Vec load(const uint8_t* p) { Vec v; std::copy(p, p + VECTOR_WIDTH, v.lane); return v; }
+    inline void store(uint8_t* p, Vec v) { std::copy(v.lane, v.lane + VECTOR_WIDTH, p); }
+    inline Vec splat(uint8_t value) { Vec v; std::fill(v.lane, v.lane + VECTOR_WIDTH, value); return v; }
+    inline Vec add(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x + y; }); }
+    inline Vec sub(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x - y; }); }
+    inline Vec bitAnd(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x & y; }); }
+    inline Vec bitOr(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x | y; }); }
+    inline Vec bitXor(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x ^ y; }); }
+    inline Vec andNot(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return ~x & y; }); }
+    inline Vec max(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return std::max(x, y); }); }
+    inline Vec equal(Vec a, Vec b) { return map(a, b, [](uint8_t x, uint8_t y) { return x == y ? 0xFF : 0x00; }); }
+    inline Vec shiftRight(Vec a, int bits) // per 16-bit pair, like the SIMD variants
+    {
+        Vec result;
+        for (size_t i = 0; i < VECTOR_WIDTH; i += 2)
+        {
+            const unsigned pair = (a.lane[i] | a.lane[i + 1] << 8) >> bits;
+            result.lane[i] = pair & 0xFF;
+            result.lane[i + 1] = pair >> 8;
+        }
+        return result;
+    }
+#endif
+
+    inline Vec one() { return splat(0x01); }
+    inline Vec greaterOrEqual(Vec a, Vec b) { return bitAnd(equal(max(a, b), a), one()); } // 1 where a >= b
+    inline Vec carry(Vec a, Vec b) { return andNot(equal(max(add(a, b), a), add(a, b)), one()); } // 1 where a + b > 0xFF
+
+    // Applies function(vx, vy) -> new VF for every machine, then reloads both registers
+    // (VF may alias X or Y) and stores result(vx, vy) into VX, mirroring CPU's order of writes.
+    template <typename Flag, typename Result>
+    void flagOp(uint8_t* vx, const uint8_t* vy, uint8_t* vf, size_t stride, Flag flag, Result result)
+    {
+        for (size_t i = 0; i < stride; i += VECTOR_WIDTH)
+        {
+            store(vf + i, flag(load(vx + i), load(vy + i)));
+            store(vx + i, result(load(vx + i), load(vy + i)));
+        }
+    }
+}
+
+LockstepEngine::LockstepEngine(size_t machines) :
+    count{ machines },
+    stride{ (machines + VECTOR_WIDTH - 1) / VECTOR_WIDTH * VECTOR_WIDTH },
+    V(16 * stride, 0),
+    I(stride, 0),
+    pc(stride, PROGRAM_MEMORY_OFFSET),
+    stack(16 * stride, 0),
+    sp(stride, 0),
+    delayTimer(stride, 0),
+    soundTimer(stride, 0),
+    keypad(16 * stride, 0),
+    memory(machines * LOCKSTEP_MEMORY_SIZE, 0),
+    displays(machines),
+    distribution{ 0, 0xFF },
+    writtenBegin{ LOCKSTEP_MEMORY_SIZE },
+    writtenEnd{ 0 },
+    lockstepCount{ 0 },
+    divergentCount{ 0 }
+{
+    std::random_device seed;
+    for (size_t m = 0; m < count; ++m)
+    {
+        engines.emplace_back(seed());
+    }
+}
+
+bool LockstepEngine::loadROM(const std::vector<uint8_t>& image)
+{
+    if (image.size() > LOCKSTEP_MEMORY_SIZE - PROGRAM_MEMORY_OFFSET)
+    {
+        return false;
+    }
+
+    CPU prototype; // provides the font set at the bottom of memory
+    std::copy(std::begin(image), std::end(image), prototype.memory + PROGRAM_MEMORY_OFFSET);
+    for (size_t m = 0; m < count; ++m)
+    {
+        std::copy_n(&prototype.memory[0], LOCKSTEP_MEMORY_SIZE, memory.begin() + m * LOCKSTEP_MEMORY_SIZE);
+    }
+    writtenBegin = LOCKSTEP_MEMORY_SIZE;
+    writtenEnd = 0;
+    return true;
+}
+
+void LockstepEngine::setKey(size_t machine, uint8_t key, bool pressed)
+{
+    keypad[(key & 0xF) * stride + machine] = pressed ? 1 : 0;
+}
+
+void LockstepEngine::step()
+{
+    uint16_t opcode;
+    if (sharedOpcode(opcode))
+    {
+        ++lockstepCount;
+        const CPU::Instruction op = CPU::decode(opcode, QuirkProfile::Default);
+        if (!executeVector(op))
+        {
+            for (size_t m = 0; m < count; ++m)
+            {
+                executeLane(m, op);
+            }
+        }
+        return;
+    }
+
+    ++divergentCount;
+    for (size_t m = 0; m < count; ++m)
+    {
+        const uint8_t* ram = &memory[m * LOCKSTEP_MEMORY_SIZE];
+        const unsigned address = pc[m] % LOCKSTEP_MEMORY_SIZE;
+        executeLane(m, CPU::decode(ram[address] << 8 | ram[(address + 1) % LOCKSTEP_MEMORY_SIZE], QuirkProfile::Default));
+    }
+}
+
+void LockstepEngine::decrementTimers()
+{
+    for (size_t m = 0; m < stride; ++m)
+    {
+        delayTimer[m] -= (delayTimer[m] > 0) ? 1 : 0;
+        soundTimer[m] -= (soundTimer[m] > 0) ? 1 : 0;
+    }
+}
+
+size_t LockstepEngine::size() const
+{
+    return count;
+}
+
+uint16_t LockstepEngine::programCounter(size_t machine) const
+{
+    return pc[machine];
+}
+
+uint16_t LockstepEngine::indexRegister(size_t machine) const
+{
+    return I[machine];
+}
+
+uint8_t LockstepEngine::registerValue(size_t machine, unsigned index) const
+{
+    return V[(index & 0xF) * stride + machine];
+}
+
+const Framebuffer& LockstepEngine::display(size_t machine) const
+{
+    return displays[machine];
+}
+
+uint64_t LockstepEngine::lockstepSteps() const
+{
+    return lockstepCount;
+}
+
+uint64_t LockstepEngine::divergentSteps() const
+{
+    return divergentCount;
+}
+
+uint8_t* LockstepEngine::row(unsigned index)
+{
+    return &V[index * stride];
+}
+
+bool LockstepEngine::sharedOpcode(uint16_t& opcode) const
+{
+    const uint16_t address = pc[0];
+    for (size_t m = 1; m < count; ++m)
+    {
+        if (pc[m] != address)
+        {
+            return false;
+        }
+    }
+
+    const unsigned first = address % LOCKSTEP_MEMORY_SIZE;
+    const unsigned second = (address + 1) % LOCKSTEP_MEMORY_SIZE;
+    opcode = memory[first] << 8 | memory[second];
+
+    const bool written = (first >= writtenBegin && first < writtenEnd) || (second >= writtenBegin && second < writtenEnd);
+    for (size_t m = 1; written && m < count; ++m)
+    {
+        const uint8_t* ram = &memory[m * LOCKSTEP_MEMORY_SIZE];
+        if ((ram[first] << 8 | ram[second]) != opcode)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LockstepEngine::executeVector(const CPU::Instruction& op)
+{
+    uint8_t* vx = row(op.x);
+    uint8_t* vy = row(op.y);
+    uint8_t* vf = row(0xF);
+
+    switch (op.opcode >> 12)
+    {
+    case 0x1:
+        std::fill(pc.begin(), pc.end(), op.nnn);
+        return true;
+    case 0x6:
+        std::fill(vx, vx + stride, op.nn);
+        break;
+    case 0x7:
+        for (size_t i = 0; i < stride; i += VECTOR_WIDTH)
+        {
+            store(vx + i, add(load(vx + i), splat(op.nn)));
+        }
+        break;
+    case 0x8:
+        switch (op.n)
+        {
+        case 0x0:
+            std::copy(vy, vy + stride, vx);
+            break;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            for (size_t i = 0; i < stride; i += VECTOR_WIDTH)
+            {
+                const Vec a = load(vx + i);
+                const Vec b = load(vy + i);
+                store(vx + i, op.n == 0x1 ? bitOr(a, b) : op.n == 0x2 ? bitAnd(a, b) : bitXor(a, b));
+            }
+            break;
+        case 0x4:
+            flagOp(vx, vy, vf, stride, carry, add);
+            break;
+        case 0x5:
+            flagOp(vx, vy, vf, stride, greaterOrEqual, sub);
+            break;
+        case 0x6:
+            flagOp(vx, vy, vf, stride,
+                [](Vec a, Vec) { return bitAnd(a, one()); },
+                [](Vec a, Vec) { return bitAnd(shiftRight(a, 1), splat(0x7F)); });
+            break;
+        case 0x7:
+            flagOp(vx, vy, vf, stride,
+                [](Vec a, Vec b) { return greaterOrEqual(b, a); },
+                [](Vec a, Vec b) { return sub(b, a); });
+            break;
+        case 0xE:
+            flagOp(vx, vy, vf, stride,
+                [](Vec a, Vec) { return bitAnd(shiftRight(a, 7), one()); },
+                [](Vec a, Vec) { return add(a, a); });
+            break;
+        default:
+            return false;
+        }
+        break;
+    case 0xA:
+        std::fill(I.begin(), I.end(), op.nnn);
+        break;
+    case 0xF:
+        switch (op.nn)
+        {
+        case 0x07:
+            std::copy(delayTimer.begin(), delayTimer.end(), vx);
+            break;
+        case 0x15:
+            std::copy(vx, vx + stride, delayTimer.begin());
+            break;
+        case 0x18:
+            std::copy(vx, vx + stride, soundTimer.begin());
+            break;
+        case 0x1E:
+            for (size_t m = 0; m < stride; ++m)
+            {
+                I[m] += vx[m];
+            }
+            break;
+        default:
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    for (size_t m = 0; m < stride; ++m)
+    {
+        pc[m] += 2;
+    }
+    return true;
+}
+
+void LockstepEngine::executeLane(size_t m, const CPU::Instruction& op)
+{
+    uint8_t& vx = V[op.x * stride + m];
+    uint8_t& vy = V[op.y * stride + m];
+    uint8_t& vf = V[0xF * stride + m];
+    uint8_t* ram = &memory[m * LOCKSTEP_MEMORY_SIZE];
+    uint16_t& counter = pc[m];
+    uint16_t& index = I[m];
+
+    switch (op.opcode >> 12)
+    {
+    case 0x0:
+        if (op.n == 0x0)
+        {
+            displays[m].clear();
+            counter += 2;
+        }
+        else if (op.n == 0xE)
+        {
+            --sp[m];
+            counter = stack[(sp[m] & 0xF) * stride + m] + 2;
+        }
+        else
+        {
+            unknownOpcode(m, op);
+        }
+        return;
+    case 0x1:
+        counter = op.nnn;
+        return;
+    case 0x2:
+        stack[(sp[m] & 0xF) * stride + m] = counter;
+        ++sp[m];
+        counter = op.nnn;
+        return;
+    case 0x3:
+        counter += (vx == op.nn) ? 4 : 2;
+        return;
+    case 0x4:
+        counter += (vx != op.nn) ? 4 : 2;
+        return;
+    case 0x5:
+        counter += (vx == vy) ? 4 : 2;
+        return;
+    case 0x6:
+        vx = op.nn;
+        break;
+    case 0x7:
+        vx += op.nn;
+        break;
+    case 0x8:
+        switch (op.n)
+        {
+        case 0x0: vx = vy; break;
+        case 0x1: vx |= vy; break;
+        case 0x2: vx &= vy; break;
+        case 0x3: vx ^= vy; break;
+        case 0x4: vf = (vx > 0xFF - vy) ? 0x01 : 0x00; vx += vy; break;
+        case 0x5: vf = (vx < vy) ? 0x00 : 0x01; vx -= vy; break;
+        case 0x6: vf = vx & 0x1; vx >>= 1; break;
+        case 0x7: vf = (vx > vy) ? 0x00 : 0x01; vx = vy - vx; break;
+        case 0xE: vf = vx >> 7; vx <<= 1; break;
+        default: unknownOpcode(m, op); break;
+        }
+        break;
+    case 0x9:
+        counter += (vx != vy) ? 4 : 2;
+        return;
+    case 0xA:
+        index = op.nnn;
+        break;
+    case 0xB:
+        counter = op.nnn + V[m];
+        return;
+    case 0xC:
+        vx = distribution(engines[m]) & op.nn;
+        break;
+    case 0xD:
+    {
+        uint8_t sprite[15]; // lanes run plain CHIP-8, where DXY0 draws nothing rather than a 16x16 sprite
+        for (unsigned i = 0; i < displays[m].spriteSize(op.n, false); ++i)
+        {
+            sprite[i] = ram[(index + i) % LOCKSTEP_MEMORY_SIZE];
+        }
+        vf = displays[m].drawSprite(vx, vy, sprite, op.n) ? 0x01 : 0x00;
+        break;
+    }
+    case 0xE:
+        if (op.nn == 0x9E)
+        {
+            counter += keypad[(vx & 0xF) * stride + m] ? 4 : 2;
+        }
+        else if (op.nn == 0xA1)
+        {
+            counter += !keypad[(vx & 0xF) * stride + m] ? 4 : 2;
+        }
+        else
+        {
+            unknownOpcode(m, op);
+        }
+        return;
+    case 0xF:
+        switch (op.nn)
+        {
+        case 0x07: vx = delayTimer[m]; break;
+        case 0x0A:
+            for (unsigned key = 0; key < 16; ++key)
+            {
+                if (keypad[key * stride + m])
+                {
+                    vx = key;
+                    counter += 2;
+                }
+            }
+            return;
+        case 0x15: delayTimer[m] = vx; break;
+        case 0x18: soundTimer[m] = vx; break;
+        case 0x1E: index += vx; break;
+        case 0x29: index = vx * 5; break;
+        case 0x33:
+            ram[index % LOCKSTEP_MEMORY_SIZE] = vx / 100;
+            ram[(index + 1) % LOCKSTEP_MEMORY_SIZE] = (vx % 100) / 10;
+            ram[(index + 2) % LOCKSTEP_MEMORY_SIZE] = (vx % 100) % 10;
+            recordWrite(index, 3);
+            break;
+        case 0x55:
+            for (unsigned i = 0; i <= op.x; ++i)
+            {
+                ram[(index + i) % LOCKSTEP_MEMORY_SIZE] = V[i * stride + m];
+            }
+            recordWrite(index, op.x + 1);
+            index += op.x + 1;
+            break;
+        case 0x65:
+            for (unsigned i = 0; i <= op.x; ++i)
+            {
+                V[i * stride + m] = ram[(index + i) % LOCKSTEP_MEMORY_SIZE];
+            }
+            index += op.x + 1;
+            break;
+        default:
+            unknownOpcode(m, op);
+            break;
+        }
+        break;
+    }
+    counter += 2;
+}
+
+void LockstepEngine::unknownOpcode(size_t machine, const CPU::Instruction& op) const
+{
+    std::ostringstream message;
+    message << "Unknown opcode 0x" << std::hex << std::uppercase << std::setfill('0')
+        << std::setw(4) << op.opcode << " at address 0x" << std::setw(3) << pc[machine]
+        << " in machine " << std::dec << machine;
+    throw std::runtime_error(message.str());
+}
+
+void LockstepEngine::recordWrite(unsigned address, unsigned size)
+{
+    if (address + size > LOCKSTEP_MEMORY_SIZE)
+    {
+        writtenBegin = 0; // wrapped around: treat all of memory as written
+        writtenEnd = LOCKSTEP_MEMORY_SIZE;
+        return;
+    }
+    writtenBegin = std::min(writtenBegin, address);
+    writtenEnd = std::max(writtenEnd, address + size);
+}
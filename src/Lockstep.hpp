@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "CPU.hpp"
+#include "Framebuffer.hpp"
+
+const unsigned LOCKSTEP_MEMORY_SIZE = MEMORY_SIZE; // per machine: plain CHIP-8 addresses wrap at 4 KB
+
+// Runs many CHIP-8 machines side by side with their registers stored as structure of arrays
+// (V[register][machine], I[machine], ...). While every machine sits at the same pc and sees the
+// same opcode, ALU/timer/register instructions are executed for all machines at once with
+// SSE2/AVX2 kernels; everything else, and any step where the machines have diverged, runs
+// per machine with the same semantics as CPU under QuirkProfile::Default, which does not
+// decode the SUPER-CHIP and XO-CHIP additions: machines stay in low resolution on plane 0.
+class LockstepEngine
+{
+public:
+    explicit LockstepEngine(size_t machines);
+
+    bool loadROM(const std::vector<uint8_t>& image); // same image into every machine; false if too big
+    void setKey(size_t machine, uint8_t key, bool pressed);
+
+    void step(); // every machine executes one instruction
+    void decrementTimers();
+
+    size_t size() const;
+    uint16_t programCounter(size_t machine) const;
+    uint16_t indexRegister(size_t machine) const;
+    uint8_t registerValue(size_t machine, unsigned index) const;
+    const Framebuffer& display(size_t machine) const;
+
+    uint64_t lockstepSteps() const; // steps executed with one shared opcode
+    uint64_t divergentSteps() const;
+
+private:
+    uint8_t* row(unsigned index);
+    bool sharedOpcode(uint16_t& opcode) const;
+    bool executeVector(const CPU::Instruction& op); // false if op has no vector kernel
+    void executeLane(size_t machine, const CPU::Instruction& op);
+    void unknownOpcode(size_t machine, const CPU::Instruction& op) const; // throws std::runtime_error
+    void recordWrite(unsigned address, unsigned size);
+
+private:
+    size_t count;
+    size_t stride; // count rounded up to a whole number of vectors
+
+    std::vector<uint8_t> V; // V[index * stride + machine]
+    std::vector<uint16_t> I;
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> stack; // stack[level * stride + machine]
+    std::vector<uint8_t> sp;
+    std::vector<uint8_t> delayTimer;
+    std::vector<uint8_t> soundTimer;
+    std::vector<uint8_t> keypad; // keypad[key * stride + machine]
+    std::vector<uint8_t> memory; // memory[machine * LOCKSTEP_MEMORY_SIZE + address]
+    std::vector<Framebuffer> displays;
+
+    std::vector<std::mt19937> engines;
+    std::uniform_int_distribution<> distribution;
+
+    unsigned writtenBegin; // union of the memory ranges written by any machine;
+    unsigned writtenEnd;   // outside of it all machines still share the loaded image
+
+    uint64_t lockstepCount;
+    uint64_t divergentCount;
+};
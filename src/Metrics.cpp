@@ -0,0 +1,260 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace
+{
+    const char* const COUNTER_NAMES[static_cast<size_t>(Counter::Count)] =
+    {
+        "instructions", "ticks", "late_ticks", "dropped_ticks", "sound_events", "presented_frames"
+    };
+
+    const char* const PHASE_NAMES[static_cast<size_t>(Phase::Count)] = { "emulate", "draw", "input" };
+
+    unsigned bucketOf(uint64_t nanoseconds)
+    {
+        unsigned bucket = 0;
+        while (bucket + 1 < HISTOGRAM_BUCKETS && nanoseconds >= (uint64_t(1) << bucket))
+        {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    double seconds(Metrics::Clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    double microseconds(double nanoseconds)
+    {
+        return nanoseconds / 1000.0;
+    }
+
+    void writePhase(std::ostream& out, const HistogramSample& phase)
+    {
+        out << "{\"count\":" << phase.count << ",\"mean_us\":" << microseconds(phase.mean())
+            << ",\"p50_us\":" << microseconds(static_cast<double>(phase.percentile(0.5)))
+            << ",\"p99_us\":" << microseconds(static_cast<double>(phase.percentile(0.99)))
+            << ",\"max_us\":" << microseconds(static_cast<double>(phase.max)) << '}';
+    }
+}
+
+HistogramSample HistogramSample::since(const HistogramSample& earlier) const
+{
+    HistogramSample interval;
+    interval.count = count - earlier.count;
+    interval.total = total - earlier.total;
+    interval.max = 0;
+    for (unsigned bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+    {
+        interval.buckets[bucket] = buckets[bucket] - earlier.buckets[bucket];
+        if (interval.buckets[bucket] != 0)
+        {
+            interval.max = std::min(max, uint64_t(1) << bucket);
+        }
+    }
+    return interval;
+}
+
+double HistogramSample::mean() const
+{
+    return count ? static_cast<double>(total) / count : 0.0;
+}
+
+uint64_t HistogramSample::percentile(double fraction) const
+{
+    const uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen > rank)
+        {
+            return std::min(max, uint64_t(1) << bucket);
+        }
+    }
+    return max;
+}
+
+Metrics::Metrics() :
+    start{ Clock::now() },
+    schedulerLate{ 0 },
+    schedulerDropped{ 0 }
+{
+    for (std::atomic<uint64_t>& counter : counters)
+    {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (Histogram& phase : phases)
+    {
+        for (std::atomic<uint64_t>& bucket : phase.buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        phase.count.store(0, std::memory_order_relaxed);
+        phase.total.store(0, std::memory_order_relaxed);
+        phase.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::record(Phase phase, Clock::duration duration)
+{
+    Histogram& histogram = phases[static_cast<size_t>(phase)];
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    std::atomic<uint64_t>& bucket = histogram.buckets[bucketOf(nanoseconds)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.total.store(histogram.total.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    histogram.max.store(std::max(histogram.max.load(std::memory_order_relaxed), nanoseconds), std::memory_order_relaxed);
+    // the count goes last, so a sample never has more samples counted than bucketed
+    histogram.count.store(histogram.count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Metrics::observe(const FrameScheduler& scheduler)
+{
+    // a scheduler reset starts its statistics over
+    schedulerLate = std::min(schedulerLate, scheduler.overruns());
+    schedulerDropped = std::min(schedulerDropped, scheduler.droppedTicks());
+    add(Counter::LateTicks, scheduler.overruns() - schedulerLate);
+    add(Counter::DroppedTicks, scheduler.droppedTicks() - schedulerDropped);
+    schedulerLate = scheduler.overruns();
+    schedulerDropped = scheduler.droppedTicks();
+}
+
+MetricsSample Metrics::sample() const
+{
+    MetricsSample sample;
+    sample.time = Clock::now();
+    for (size_t counter = 0; counter < static_cast<size_t>(Counter::Count); ++counter)
+    {
+        sample.counters[counter] = counters[counter].load(std::memory_order_relaxed);
+    }
+    for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); ++phase)
+    {
+        const Histogram& histogram = phases[phase];
+        HistogramSample& taken = sample.phases[phase];
+        taken.count = histogram.count.load(std::memory_order_acquire);
+        taken.total = histogram.total.load(std::memory_order_relaxed);
+        taken.max = histogram.max.load(std::memory_order_relaxed);
+        for (unsigned bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+        {
+            taken.buckets[bucket] = histogram.buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    return sample;
+}
+
+Metrics::Clock::time_point Metrics::started() const
+{
+    return start;
+}
+
+void Metrics::writeJson(std::ostream& out, const MetricsSample& current, const MetricsSample& previous, Clock::time_point start)
+{
+    const double elapsed = std::max(seconds(current.time - previous.time), 1e-9);
+    out << std::fixed << std::setprecision(3)
+        << "{\"time\":" << seconds(current.time - start)
+        << ",\"ips\":" << static_cast<uint64_t>((current[Counter::Instructions] - previous[Counter::Instructions]) / elapsed)
+        << ",\"tps\":" << (current[Counter::Ticks] - previous[Counter::Ticks]) / elapsed;
+    for (size_t counter = 0; counter < static_cast<size_t>(Counter::Count); ++counter)
+    {
+        out << ",\"" << COUNTER_NAMES[counter] << "\":" << current.counters[counter];
+    }
+    for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); ++phase)
+    {
+        out << ",\"" << PHASE_NAMES[phase] << "\":";
+        writePhase(out, current.phases[phase].since(previous.phases[phase]));
+    }
+    out << '}' << std::defaultfloat << '\n';
+}
+
+void Metrics::printSummary(std::ostream& out) const
+{
+    const MetricsSample totals = sample();
+    const double elapsed = std::max(seconds(totals.time - start), 1e-9);
+    out << std::fixed << std::setprecision(3)
+        << "metrics: " << totals[Counter::Instructions] << " instructions ("
+        << static_cast<uint64_t>(totals[Counter::Instructions] / elapsed) << "/s), "
+        << totals[Counter::Ticks] << " ticks (" << totals[Counter::Ticks] / elapsed << "/s), "
+        << totals[Counter::LateTicks] << " late, " << totals[Counter::DroppedTicks] << " dropped, "
+        << totals[Counter::SoundEvents] << " sound events\n";
+    for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); ++phase)
+    {
+        const HistogramSample& histogram = totals.phases[phase];
+        if (histogram.count == 0)
+        {
+            continue;
+        }
+        out << "  " << PHASE_NAMES[phase] << ": " << histogram.count << " samples, mean "
+            << microseconds(histogram.mean()) << " us, p50 < " << microseconds(static_cast<double>(histogram.percentile(0.5)))
+            << " us, p99 < " << microseconds(static_cast<double>(histogram.percentile(0.99)))
+            << " us, max " << microseconds(static_cast<double>(histogram.max)) << " us\n";
+    }
+    out << std::defaultfloat << std::flush;
+}
+
+MetricsLog::MetricsLog(const Metrics& metrics) :
+    metrics(metrics),
+    interval{ DEFAULT_METRICS_INTERVAL },
+    stopping{ false }
+{
+}
+
+MetricsLog::~MetricsLog()
+{
+    close();
+}
+
+bool MetricsLog::open(const std::string& fileName, unsigned intervalMilliseconds)
+{
+    close();
+    file.open(fileName.c_str(), std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    interval = std::chrono::milliseconds(std::max(1u, intervalMilliseconds));
+    previous = metrics.sample();
+    stopping = false;
+    writer = std::thread(&MetricsLog::work, this);
+    return true;
+}
+
+bool MetricsLog::close()
+{
+    if (!writer.joinable())
+    {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    writer.join();
+
+    writeLine();
+    const bool ok = !file.fail();
+    file.close();
+    return ok;
+}
+
+void MetricsLog::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeup.wait_for(lock, interval, [this] { return stopping; }))
+    {
+        writeLine();
+    }
+}
+
+void MetricsLog::writeLine()
+{
+    const MetricsSample current = metrics.sample();
+    Metrics::writeJson(file, current, previous, metrics.started());
+    file.flush(); // a line at a time, for whoever tails the file
+    previous = current;
+}
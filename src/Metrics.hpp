@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "FrameScheduler.hpp"
+
+const unsigned HISTOGRAM_BUCKETS = 32; // bucket b: durations below 2^b ns, the last one open ended
+const unsigned DEFAULT_METRICS_INTERVAL = 1000; // milliseconds between two MetricsLog lines
+
+enum class Counter
+{
+    Instructions, // executed or skipped as idle
+    Ticks, // 60 Hz timer ticks
+    LateTicks, // FrameScheduler::wait() calls that found their tick already late
+    DroppedTicks, // ticks the scheduler gave up on after a stall
+    SoundEvents, // sound timer expiries, i.e. beeps
+    PresentedFrames,
+    Count
+};
+
+enum class Phase
+{
+    Emulate, // one Emulator::advance(), at most a frame of instructions
+    Draw, // presenting a frame in the window
+    Input, // polling and posting window events
+    Count
+};
+
+// Fixed power-of-two buckets of nanoseconds. Percentiles are the upper bound of the bucket
+// they fall in, so within a factor of two.
+struct HistogramSample
+{
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total; // ns
+    uint64_t max; // ns
+
+    HistogramSample since(const HistogramSample& earlier) const; // the samples recorded in between; max is a bucket bound
+    double mean() const; // ns
+    uint64_t percentile(double fraction) const; // ns
+};
+
+struct MetricsSample
+{
+    std::chrono::steady_clock::time_point time;
+    uint64_t counters[static_cast<size_t>(Counter::Count)];
+    HistogramSample phases[static_cast<size_t>(Phase::Count)];
+
+    uint64_t operator[](Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const HistogramSample& operator[](Phase phase) const { return phases[static_cast<size_t>(phase)]; }
+};
+
+// Lock-free counters and phase histograms that any thread can sample while others record.
+// Every counter and histogram has a single writing thread (the emulation thread, or the
+// window thread for Draw, Input and PresentedFrames), so recording is a relaxed load and
+// store rather than a locked read-modify-write.
+class Metrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void add(Counter counter, uint64_t amount = 1)
+    {
+        std::atomic<uint64_t>& value = counters[static_cast<size_t>(counter)];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void record(Phase phase, Clock::duration duration);
+    void observe(const FrameScheduler& scheduler); // adds the late and dropped ticks since the previous call
+
+    MetricsSample sample() const;
+    Clock::time_point started() const;
+
+    // "ips" and "tps" are rates between the two samples, the phases only cover what was
+    // recorded in between; totals are since construction
+    static void writeJson(std::ostream& out, const MetricsSample& current, const MetricsSample& previous, Clock::time_point start);
+    void printSummary(std::ostream& out) const;
+
+private:
+    struct Histogram
+    {
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> max;
+    };
+
+    std::atomic<uint64_t> counters[static_cast<size_t>(Counter::Count)];
+    Histogram phases[static_cast<size_t>(Phase::Count)];
+    Clock::time_point start;
+    uint64_t schedulerLate; // as of the last observe()
+    uint64_t schedulerDropped;
+};
+
+// Times a phase from construction to destruction or stop(); a no-op without metrics.
+class PhaseTimer
+{
+public:
+    PhaseTimer(Metrics* metrics, Phase phase) :
+        metrics{ metrics },
+        phase{ phase },
+        begin{ metrics ? Metrics::Clock::now() : Metrics::Clock::time_point() }
+    {
+    }
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    void stop() // records now rather than at destruction
+    {
+        if (metrics)
+        {
+            metrics->record(phase, Metrics::Clock::now() - begin);
+            metrics = nullptr;
+        }
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Metrics* metrics;
+    Phase phase;
+    Metrics::Clock::time_point begin;
+};
+
+// Appends a Metrics::writeJson line to a file every interval from a background thread, and
+// a last one on close().
+class MetricsLog
+{
+public:
+    explicit MetricsLog(const Metrics& metrics);
+    ~MetricsLog();
+
+    MetricsLog(const MetricsLog&) = delete;
+    MetricsLog& operator=(const MetricsLog&) = delete;
+
+    bool open(const std::string& fileName, unsigned intervalMilliseconds = DEFAULT_METRICS_INTERVAL);
+    bool close(); // false if a write failed
+
+private:
+    void work();
+    void writeLine();
+
+private:
+    const Metrics& metrics;
+    std::ofstream file;
+    std::chrono::milliseconds interval;
+    MetricsSample previous;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+};
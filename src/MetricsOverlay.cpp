@@ -0,0 +1,141 @@
+#include "MetricsOverlay.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+namespace
+{
+    const unsigned GLYPH_WIDTH = 3;
+    const unsigned GLYPH_HEIGHT = 5;
+
+    struct Glyph
+    {
+        char character;
+        uint8_t rows[GLYPH_HEIGHT]; // bit 2 is the leftmost pixel
+    };
+
+    // only the characters the overlay prints; anything else is drawn as a space
+    const Glyph FONT[] =
+    {
+        { '0', { 7, 5, 5, 5, 7 } }, { '1', { 2, 6, 2, 2, 7 } }, { '2', { 7, 1, 7, 4, 7 } },
+        { '3', { 7, 1, 7, 1, 7 } }, { '4', { 5, 5, 7, 1, 1 } }, { '5', { 7, 4, 7, 1, 7 } },
+        { '6', { 7, 4, 7, 5, 7 } }, { '7', { 7, 1, 1, 1, 1 } }, { '8', { 7, 5, 7, 5, 7 } },
+        { '9', { 7, 5, 7, 1, 7 } }, { '.', { 0, 0, 0, 0, 2 } }, { '/', { 1, 1, 2, 4, 4 } },
+        { 'A', { 2, 5, 7, 5, 5 } }, { 'D', { 6, 5, 5, 5, 6 } }, { 'E', { 7, 4, 6, 4, 7 } },
+        { 'F', { 7, 4, 6, 4, 4 } }, { 'I', { 7, 2, 2, 2, 7 } }, { 'L', { 4, 4, 4, 4, 7 } },
+        { 'M', { 5, 7, 7, 5, 5 } }, { 'N', { 6, 5, 5, 5, 5 } }, { 'O', { 7, 5, 5, 5, 7 } },
+        { 'P', { 6, 5, 6, 4, 4 } }, { 'R', { 6, 5, 6, 5, 5 } }, { 'S', { 7, 4, 7, 1, 7 } },
+        { 'T', { 7, 2, 2, 2, 2 } }, { 'U', { 5, 5, 5, 5, 7 } }, { 'W', { 5, 5, 7, 7, 5 } }
+    };
+
+    const Glyph* findGlyph(char character)
+    {
+        for (const Glyph& glyph : FONT)
+        {
+            if (glyph.character == character)
+            {
+                return &glyph;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string phaseLine(const char* name, const HistogramSample& phase)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%s %.0f/%.0f US", name, phase.mean() / 1000.0,
+            static_cast<double>(phase.percentile(0.99)) / 1000.0);
+        return line;
+    }
+}
+
+MetricsOverlay::MetricsOverlay(const Metrics& metrics, unsigned scale) :
+    metrics(metrics),
+    pixel{ static_cast<float>(std::max(1u, scale / 4)) },
+    previous(metrics.sample()),
+    quads{ sf::Quads }
+{
+}
+
+bool MetricsOverlay::update()
+{
+    const MetricsSample current = metrics.sample();
+    if (current.time - previous.time < std::chrono::milliseconds(OVERLAY_REFRESH_INTERVAL))
+    {
+        return false;
+    }
+
+    const double elapsed = std::chrono::duration<double>(current.time - previous.time).count();
+    char rates[64];
+    std::snprintf(rates, sizeof(rates), "IPS %llu TPS %.1f",
+        static_cast<unsigned long long>((current[Counter::Instructions] - previous[Counter::Instructions]) / elapsed),
+        (current[Counter::Ticks] - previous[Counter::Ticks]) / elapsed);
+    char presented[64];
+    std::snprintf(presented, sizeof(presented), "FPS %.1f LATE %llu DROP %llu",
+        (current[Counter::PresentedFrames] - previous[Counter::PresentedFrames]) / elapsed,
+        static_cast<unsigned long long>(current[Counter::LateTicks]),
+        static_cast<unsigned long long>(current[Counter::DroppedTicks]));
+
+    // phase timings as mean/p99 over the last interval
+    build({
+        rates,
+        presented,
+        phaseLine("EMU", current[Phase::Emulate].since(previous[Phase::Emulate])),
+        phaseLine("DRAW", current[Phase::Draw].since(previous[Phase::Draw])),
+        phaseLine("INPUT", current[Phase::Input].since(previous[Phase::Input]))
+    });
+    previous = current;
+    return true;
+}
+
+void MetricsOverlay::draw(sf::RenderTarget& target) const
+{
+    target.draw(quads);
+}
+
+void MetricsOverlay::build(const std::vector<std::string>& lines)
+{
+    const float advance = (GLYPH_WIDTH + 1) * pixel;
+    const float lineHeight = (GLYPH_HEIGHT + 2) * pixel;
+
+    size_t longest = 0;
+    for (const std::string& line : lines)
+    {
+        longest = std::max(longest, line.size());
+    }
+
+    quads.clear();
+    addQuad(0, 0, (longest + 1) * advance, (lines.size() + 0.5f) * lineHeight, sf::Color(0, 0, 0, 0xA0)); // backdrop
+    for (size_t row = 0; row < lines.size(); ++row)
+    {
+        const float top = (row + 0.5f) * lineHeight;
+        for (size_t column = 0; column < lines[row].size(); ++column)
+        {
+            const Glyph* glyph = findGlyph(lines[row][column]);
+            if (!glyph)
+            {
+                continue;
+            }
+            const float left = (column + 0.5f) * advance;
+            for (unsigned y = 0; y < GLYPH_HEIGHT; ++y)
+            {
+                for (unsigned x = 0; x < GLYPH_WIDTH; ++x)
+                {
+                    if (glyph->rows[y] & (4 >> x))
+                    {
+                        addQuad(left + x * pixel, top + y * pixel, pixel, pixel, sf::Color(0xFF, 0xFF, 0x60));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void MetricsOverlay::addQuad(float x, float y, float width, float height, const sf::Color& color)
+{
+    quads.append(sf::Vertex(sf::Vector2f(x, y), color));
+    quads.append(sf::Vertex(sf::Vector2f(x + width, y), color));
+    quads.append(sf::Vertex(sf::Vector2f(x + width, y + height), color));
+    quads.append(sf::Vertex(sf::Vector2f(x, y + height), color));
+}
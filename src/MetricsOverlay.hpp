@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "Metrics.hpp"
+
+const unsigned OVERLAY_REFRESH_INTERVAL = 250; // milliseconds between two overlay text updates
+
+// Draws the rates and phase timings of a Metrics over the top left of the window. SFML has
+// no built-in font, so the text is a 3x5 pixel font built into one vertex array of quads.
+class MetricsOverlay
+{
+public:
+    MetricsOverlay(const Metrics& metrics, unsigned scale);
+
+    // once per presented frame; rebuilds the text every OVERLAY_REFRESH_INTERVAL and returns
+    // true when it did, so the window can redraw even if the frame did not change
+    bool update();
+    void draw(sf::RenderTarget& target) const;
+
+private:
+    void build(const std::vector<std::string>& lines);
+    void addQuad(float x, float y, float width, float height, const sf::Color& color);
+
+private:
+    const Metrics& metrics;
+    float pixel; // window pixels per font pixel
+    MetricsSample previous;
+    sf::VertexArray quads;
+};
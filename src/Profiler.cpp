@@ -0,0 +1,185 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <string>
+
+#include "Disassembler.hpp"
+
+namespace
+{
+    bool isSkip(const std::string& pattern)
+    {
+        return pattern == "3XNN" || pattern == "4XNN" || pattern == "5XY0" || pattern == "9XY0"
+            || pattern == "EX9E" || pattern == "EXA1";
+    }
+
+    double percent(uint64_t part, uint64_t whole)
+    {
+        return whole ? 100.0 * part / whole : 0.0;
+    }
+}
+
+Profiler::Profiler() :
+    executions(XO_CHIP_MEMORY_SIZE, 0),
+    taken(XO_CHIP_MEMORY_SIZE, 0),
+    opcodes(XO_CHIP_MEMORY_SIZE, 0),
+    opcodeCounts(0x10000, 0),
+    current{ 0 },
+    depth{ 0 },
+    overflow{ 0 }
+{
+    frames.push_back({ 0, 0, 0, {} });
+}
+
+uint64_t Profiler::instructions() const
+{
+    uint64_t total = 0;
+    for (uint64_t count : executions)
+    {
+        total += count;
+    }
+    return total;
+}
+
+void Profiler::printHotspots(std::ostream& out, size_t limit) const
+{
+    const uint64_t total = instructions();
+    out << "instructions: " << total << '\n';
+
+    std::vector<uint16_t> addresses;
+    for (unsigned address = 0; address < executions.size(); ++address)
+    {
+        if (executions[address] != 0)
+        {
+            addresses.push_back(static_cast<uint16_t>(address));
+        }
+    }
+    std::stable_sort(addresses.begin(), addresses.end(),
+        [this](uint16_t a, uint16_t b) { return executions[a] > executions[b]; });
+    addresses.resize(std::min(addresses.size(), limit));
+
+    out << "\nhottest addresses:\n" << std::fixed << std::setprecision(2);
+    for (uint16_t address : addresses)
+    {
+        const uint16_t opcode = opcodes[address];
+        out << "  0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << address
+            << "  " << std::setw(4) << opcode << std::dec << std::setfill(' ')
+            << "  " << std::setw(12) << executions[address]
+            << "  " << std::setw(6) << percent(executions[address], total) << "%  ";
+        if (isSkip(opcodeClass(opcode)))
+        {
+            out << std::left << std::setw(18) << disassemble(opcode) << std::right
+                << "  taken " << std::setw(6) << percent(taken[address], executions[address]) << '%';
+        }
+        else
+        {
+            out << disassemble(opcode);
+        }
+        out << '\n';
+    }
+
+    std::map<std::string, uint64_t> classes;
+    std::map<std::string, uint64_t> classTaken;
+    for (size_t opcode = 0; opcode < opcodeCounts.size(); ++opcode)
+    {
+        if (opcodeCounts[opcode] != 0)
+        {
+            classes[opcodeClass(static_cast<uint16_t>(opcode))] += opcodeCounts[opcode];
+        }
+    }
+    for (unsigned address = 0; address < taken.size(); ++address)
+    {
+        classTaken[opcodeClass(opcodes[address])] += taken[address];
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> sorted(classes.begin(), classes.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) { return a.second > b.second; });
+
+    out << "\nopcode classes:\n";
+    for (const auto& entry : sorted)
+    {
+        out << "  " << entry.first << "  " << std::setw(12) << entry.second
+            << "  " << std::setw(6) << percent(entry.second, total) << '%';
+        if (isSkip(entry.first))
+        {
+            out << "  taken " << std::setw(6) << percent(classTaken[entry.first], entry.second) << '%';
+        }
+        out << '\n';
+    }
+    out << std::defaultfloat << std::flush;
+}
+
+void Profiler::writeCollapsedStacks(std::ostream& out) const
+{
+    for (uint32_t index = 0; index < frames.size(); ++index)
+    {
+        if (frames[index].samples == 0)
+        {
+            continue;
+        }
+
+        std::vector<uint16_t> path;
+        for (uint32_t frame = index; frame != 0; frame = frames[frame].parent)
+        {
+            path.push_back(frames[frame].function);
+        }
+
+        out << "main";
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+        {
+            out << ";sub_" << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << *it << std::dec;
+        }
+        out << ' ' << frames[index].samples << '\n';
+    }
+    out << std::flush;
+}
+
+void Profiler::reset()
+{
+    std::fill(executions.begin(), executions.end(), 0);
+    std::fill(taken.begin(), taken.end(), 0);
+    std::fill(opcodes.begin(), opcodes.end(), 0);
+    std::fill(opcodeCounts.begin(), opcodeCounts.end(), 0);
+    frames.assign(1, Frame{ 0, 0, 0, {} });
+    current = 0;
+    depth = 0;
+    overflow = 0;
+}
+
+void Profiler::call(uint16_t target)
+{
+    if (depth == MAX_DEPTH)
+    {
+        ++overflow; // calls past the hardware stack depth are charged to the deepest frame
+        return;
+    }
+    ++depth;
+
+    for (const auto& child : frames[current].children)
+    {
+        if (child.first == target)
+        {
+            current = child.second;
+            return;
+        }
+    }
+
+    const uint32_t index = static_cast<uint32_t>(frames.size());
+    frames[current].children.push_back({ target, index });
+    frames.push_back({ target, current, 0, {} });
+    current = index;
+}
+
+void Profiler::ret()
+{
+    if (overflow > 0)
+    {
+        --overflow;
+        return;
+    }
+    depth -= (depth > 0) ? 1 : 0;
+    current = frames[current].parent; // an unmatched return stays at the entry frame
+}
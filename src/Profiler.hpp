@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "CPU.hpp"
+
+// Execution profile fed by CPU::emulateCycle(Profiler&). Counts executions per address and
+// per opcode, taken skips per address, and attributes every instruction to the call stack
+// built from 2NNN/00EE. Only the observing overload of emulateCycle pays for any of this.
+class Profiler
+{
+public:
+    Profiler();
+
+    void retired(const CPU& cpu, uint16_t address, uint16_t opcode) // after every instruction
+    {
+        ++executions[address];
+        ++opcodeCounts[opcode];
+        opcodes[address] = opcode;
+        ++frames[current].samples; // a call belongs to the caller, a return to the callee
+
+        switch (opcode >> 12)
+        {
+        case 0x0:
+            if (opcode == 0x00EE)
+            {
+                ret();
+            }
+            break;
+        case 0x2:
+            call(opcode & 0x0FFF);
+            break;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xE:
+            taken[address] += (cpu.programCounter() != static_cast<uint16_t>(address + 2)) ? 1 : 0; // 4 bytes, or 6 over F000 NNNN
+            break;
+        }
+    }
+
+    uint64_t instructions() const;
+    void printHotspots(std::ostream& out, size_t limit) const; // hottest addresses with disassembly, then opcode classes
+    void writeCollapsedStacks(std::ostream& out) const; // "main;sub_2A4;sub_31C 1234" lines for flamegraph.pl
+    void reset();
+
+private:
+    void call(uint16_t target);
+    void ret();
+
+    struct Frame
+    {
+        uint16_t function;
+        uint32_t parent;
+        uint64_t samples;
+        std::vector<std::pair<uint16_t, uint32_t>> children; // callee address, frame index
+    };
+
+private:
+    static const unsigned MAX_DEPTH = 16; // entries of the CHIP-8 stack
+
+    std::vector<uint64_t> executions; // per address
+    std::vector<uint64_t> taken; // per address, skip instructions only
+    std::vector<uint16_t> opcodes; // opcode last executed at each address
+    std::vector<uint64_t> opcodeCounts; // per opcode
+
+    std::vector<Frame> frames; // call tree, frames[0] is the program entry
+    uint32_t current;
+    unsigned depth;
+    unsigned overflow; // calls made beyond MAX_DEPTH that have not returned
+};
@@ -0,0 +1,24 @@
+#include "Quirks.hpp"
+
+namespace
+{
+    const char* const PROFILE_NAMES[] = { "default", "vip", "chip48", "schip", "xochip" };
+}
+
+bool parseQuirkProfile(const std::string& name, QuirkProfile& profile)
+{
+    for (unsigned i = 0; i < sizeof(PROFILE_NAMES) / sizeof(PROFILE_NAMES[0]); ++i)
+    {
+        if (name == PROFILE_NAMES[i])
+        {
+            profile = static_cast<QuirkProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* quirkProfileName(QuirkProfile profile)
+{
+    return PROFILE_NAMES[static_cast<unsigned>(profile)];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Framebuffer.hpp"
+
+// Interpreters disagree on a handful of instructions and ROMs depend on the one they were
+// written for, so the semantics are chosen per ROM (CPU::setQuirks).
+enum class QuirkProfile : uint8_t
+{
+    Default,   // this emulator's own: shifts VX in place, FX55/FX65 leave I past VX, BNNN adds V0, sprites wrap
+    CosmacVip, // the original VIP interpreter: shifts VY into VX, 8XY1-8XY3 clear VF, sprites clip
+    Chip48,    // HP-48 CHIP-48: FX55/FX65 leave I at VX, BXNN adds VX, sprites clip
+    SuperChip, // SUPER-CHIP 1.1: FX55/FX65 leave I unchanged, BXNN adds VX, sprites clip
+    XoChip     // XO-CHIP (Octo): shifts VY into VX, sprites wrap, skips step over F000 NNNN as a whole
+};
+
+// Where FX55/FX65 leave I after storing or loading V0 to VX.
+enum class IndexAdvance : uint8_t
+{
+    PastLast, // I + X + 1
+    ToLast,   // I + X
+    None      // I
+};
+
+struct Quirks
+{
+    bool shiftReadsVY; // 8XY6/8XYE: VX = VY shifted, instead of shifting VX in place
+    bool logicClearsVF; // 8XY1/8XY2/8XY3: VF = 0 afterwards
+    IndexAdvance indexAdvance;
+    bool jumpAddsVX; // BXNN jumps to XNN + VX instead of NNN + V0
+    SpriteEdge spriteEdge;
+    bool longSkips; // 3XNN/4XNN/5XY0/9XY0/EX9E/EXA1 skip the four bytes of an F000 NNNN, not just two
+    bool superChipOpcodes; // 00CN, 00FB-00FF, FX30, FX75 and FX85 exist; otherwise they are unknown opcodes
+    bool xoChipOpcodes; // 00DN, 5XY2, 5XY3, F000 NNNN and FN01 exist
+};
+
+// constexpr so that the CPU handlers instantiated per profile fold their quirk checks away
+constexpr Quirks quirksOf(QuirkProfile profile)
+{
+    return (profile == QuirkProfile::CosmacVip) ? Quirks{ true, true, IndexAdvance::PastLast, false, SpriteEdge::Clip, false, false, false }
+        : (profile == QuirkProfile::Chip48) ? Quirks{ false, false, IndexAdvance::ToLast, true, SpriteEdge::Clip, false, false, false }
+        : (profile == QuirkProfile::SuperChip) ? Quirks{ false, false, IndexAdvance::None, true, SpriteEdge::Clip, false, true, false }
+        : (profile == QuirkProfile::XoChip) ? Quirks{ true, false, IndexAdvance::PastLast, false, SpriteEdge::Wrap, true, true, true }
+        : Quirks{ false, false, IndexAdvance::PastLast, false, SpriteEdge::Wrap, false, false, false };
+}
+
+constexpr unsigned indexAdvance(IndexAdvance advance, unsigned x)
+{
+    return (advance == IndexAdvance::PastLast) ? x + 1 : (advance == IndexAdvance::ToLast) ? x : 0;
+}
+
+bool parseQuirkProfile(const std::string& name, QuirkProfile& profile); // "default", "vip", "chip48", "schip" or "xochip"
+const char* quirkProfileName(QuirkProfile profile);
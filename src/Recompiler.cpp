@@ -0,0 +1,421 @@
+#include "Recompiler.hpp"
+
+#include <cstdio>
+
+#include "CPU.hpp"
+#include "Disassembler.hpp"
+
+namespace
+{
+    const unsigned MAX_BLOCK_LENGTH = 64; // instructions per generated function
+
+    std::string hex(unsigned value, int digits)
+    {
+        char text[16];
+        std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+        return text;
+    }
+
+    std::string reg(unsigned index)
+    {
+        return "m.V[" + hex(index, 1) + "]";
+    }
+
+    std::string quoted(const std::string& text)
+    {
+        std::string result = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+}
+
+Recompiler::Recompiler(const std::vector<uint8_t>& image, QuirkProfile profile) :
+    image(image),
+    profile{ profile },
+    instructions{ 0 },
+    dynamic{ 0 }
+{
+    analyze();
+}
+
+size_t Recompiler::blockCount() const
+{
+    return blocks.size();
+}
+
+size_t Recompiler::instructionCount() const
+{
+    return instructions;
+}
+
+size_t Recompiler::dynamicJumps() const
+{
+    return dynamic;
+}
+
+bool Recompiler::contains(unsigned address) const
+{
+    return address >= PROGRAM_MEMORY_OFFSET && address + 1 < PROGRAM_MEMORY_OFFSET + image.size();
+}
+
+uint16_t Recompiler::fetch(unsigned address) const
+{
+    const size_t offset = address - PROGRAM_MEMORY_OFFSET;
+    return image[offset] << 8 | image[offset + 1];
+}
+
+void Recompiler::analyze()
+{
+    // every address control can reach, and the ones it can reach other than by falling through
+    const unsigned size = memorySizeOf(profile);
+    std::vector<bool> reached(size + 6);
+    std::vector<bool> leader(size + 6);
+    std::vector<unsigned> pending{ PROGRAM_MEMORY_OFFSET };
+    leader[PROGRAM_MEMORY_OFFSET] = true;
+
+    while (!pending.empty())
+    {
+        const unsigned address = pending.back();
+        pending.pop_back();
+        if (!contains(address) || reached[address])
+        {
+            continue;
+        }
+        reached[address] = true;
+
+        const CPU::Instruction op = CPU::decode(fetch(address), profile);
+        if (CPU::isUnknown(op))
+        {
+            continue;
+        }
+
+        const Quirks quirks = quirksOf(profile);
+        unsigned successors[3];
+        unsigned count = 0;
+        switch ((op.opcode & 0xF000) >> 12)
+        {
+        case 0x0:
+            if (op.opcode == 0x00FD)
+            {
+                successors[count++] = address; // halts by not moving pc
+            }
+            else if (op.opcode != 0x00EE)
+            {
+                successors[count++] = address + 2;
+            }
+            break; // returns land on the sites recorded for 2NNN
+        case 0x1:
+            successors[count++] = op.nnn;
+            break;
+        case 0x2:
+            successors[count++] = op.nnn;
+            successors[count++] = address + 2;
+            break;
+        case 0x5:
+            if (quirks.xoChipOpcodes && (op.n == 0x2 || op.n == 0x3))
+            {
+                successors[count++] = address + 2;
+                break;
+            }
+            // fall through
+        case 0x3:
+        case 0x4:
+        case 0x9:
+        case 0xE:
+            successors[count++] = address + 2;
+            successors[count++] = address + 4;
+            if (quirks.longSkips)
+            {
+                successors[count++] = address + 6; // over an F000 NNNN
+            }
+            break;
+        case 0xB:
+            ++dynamic;
+            break;
+        case 0xF:
+            if (op.nn == 0x0A)
+            {
+                successors[count++] = address; // waits by not moving pc
+            }
+            successors[count++] = address + ((quirks.xoChipOpcodes && op.opcode == 0xF000) ? 4 : 2);
+            break;
+        default:
+            successors[count++] = address + 2;
+            break;
+        }
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            pending.push_back(successors[i]);
+            if (CPU::endsBlock(op))
+            {
+                leader[successors[i]] = true;
+            }
+        }
+    }
+
+    // in address order, so a block cut at MAX_BLOCK_LENGTH can hand its rest to a later leader
+    for (unsigned start = PROGRAM_MEMORY_OFFSET; start < size; ++start)
+    {
+        if (!reached[start] || !leader[start])
+        {
+            continue;
+        }
+
+        Block block{ static_cast<uint16_t>(start), {} };
+        for (unsigned address = start; contains(address); )
+        {
+            const CPU::Instruction op = CPU::decode(fetch(address), profile);
+            if (CPU::isUnknown(op))
+            {
+                break; // the interpreter reports it
+            }
+            block.opcodes.push_back(op.opcode);
+            if (CPU::endsBlock(op))
+            {
+                break;
+            }
+            address += 2;
+            if (block.opcodes.size() == MAX_BLOCK_LENGTH)
+            {
+                leader[address] = true;
+            }
+            if (leader[address])
+            {
+                break;
+            }
+        }
+
+        if (!block.opcodes.empty())
+        {
+            instructions += block.opcodes.size();
+            blocks.push_back(block);
+        }
+    }
+}
+
+void Recompiler::write(std::ostream& out, const std::string& name) const
+{
+    out << "// Generated by --recompile from " << name << " (" << quirkProfileName(profile) << " quirks): "
+        << instructions << " instructions in " << blocks.size() << " blocks. Do not edit.\n"
+        << "// Linked into the emulator, it runs this ROM natively with --backend aot.\n"
+        << "#include \"Aot.hpp\"\n"
+        << "\n"
+        << "namespace\n"
+        << "{\n"
+        << "    const uint8_t image[] = {";
+    for (size_t i = 0; i < image.size(); ++i)
+    {
+        out << ((i % 16 == 0) ? "\n        " : " ") << hex(image[i], 2) << ',';
+    }
+    out << "\n    };\n";
+
+    for (const Block& block : blocks)
+    {
+        const size_t length = block.opcodes.size();
+        out << "\n    void block_" << hex(block.start, 3).substr(2) << "(AotMachine& m, unsigned"
+            << ((length > 1) ? " count" : "") << ")\n    {\n";
+
+        uint16_t address = block.start;
+        for (size_t i = 0; i < length; ++i, address += 2)
+        {
+            const uint16_t opcode = block.opcodes[i];
+            out << "        // " << hex(address, 3) << ": " << hex(opcode, 4).substr(2) << "  " << disassemble(opcode) << '\n';
+            writeInstruction(out, address, opcode);
+            if (i + 1 < length)
+            {
+                out << "        if (--count == 0) { m.pc = " << hex(address + 2, 3) << "; return; }\n";
+            }
+            else if (!CPU::endsBlock(CPU::decode(opcode, profile)))
+            {
+                out << "        m.pc = " << hex(address + 2, 3) << ";\n";
+            }
+        }
+        out << "    }\n";
+    }
+
+    if (blocks.empty())
+    {
+        out << "\n    const AotBlock* const blocks = nullptr;\n";
+    }
+    else
+    {
+        out << "\n    const AotBlock blocks[] = {\n";
+        for (const Block& block : blocks)
+        {
+            out << "        { " << hex(block.start, 3) << ", " << hex(block.start + 2 * block.opcodes.size(), 3)
+                << ", " << block.opcodes.size() << ", block_" << hex(block.start, 3).substr(2) << " },\n";
+        }
+        out << "    };\n";
+    }
+
+    const char* const profiles[] = { "Default", "CosmacVip", "Chip48", "SuperChip", "XoChip" };
+    out << "\n    const AotProgram program{ " << quoted(name) << ", image, sizeof(image), blocks, "
+        << blocks.size() << ", QuirkProfile::" << profiles[static_cast<unsigned>(profile)] << " };\n"
+        << "    const AotRegistration registration{ program };\n"
+        << "}\n";
+}
+
+// Mirrors the CPU handlers statement for statement; instructions that draw, scroll, draw random
+// numbers, write memory or wait for a key go through the handlers themselves, and so do skips
+// when Quirks::longSkips makes their distance depend on the instruction skipped.
+void Recompiler::writeInstruction(std::ostream& out, uint16_t address, uint16_t opcode) const
+{
+    const Quirks quirks = quirksOf(profile);
+    const CPU::Instruction op = CPU::decode(opcode, profile);
+    const std::string vx = reg(op.x);
+    const std::string vy = reg(op.y);
+    const std::string vf = reg(0xF);
+    const std::string nn = hex(op.nn, 2);
+    const std::string nnn = hex(op.nnn, 3);
+    const std::string skip = " ? " + hex(address + 4, 3) + " : " + hex(address + 2, 3) + ";\n";
+    const char* indent = "        ";
+
+    auto interpret = [&]() { out << indent << "m.interpret(" << hex(address, 3) << ", " << hex(opcode, 4) << ");\n"; };
+
+    const unsigned group = (opcode & 0xF000) >> 12;
+    const bool isSkip = group == 0x3 || group == 0x4 || group == 0x9 || group == 0xE
+        || (group == 0x5 && !(quirks.xoChipOpcodes && (op.n == 0x2 || op.n == 0x3)));
+    if (isSkip && quirks.longSkips)
+    {
+        interpret();
+        return;
+    }
+
+    switch (group)
+    {
+    case 0x0:
+        if (opcode == 0x00E0)
+        {
+            out << indent << "m.display.clear();\n";
+        }
+        else if (opcode == 0x00EE)
+        {
+            out << indent << "--m.sp;\n" << indent << "m.pc = static_cast<uint16_t>(m.stack[m.sp] + 2);\n";
+        }
+        else
+        {
+            interpret();
+        }
+        break;
+    case 0x1:
+        out << indent << "m.pc = " << nnn << ";\n";
+        break;
+    case 0x2:
+        out << indent << "m.stack[m.sp] = " << hex(address, 3) << ";\n"
+            << indent << "++m.sp;\n"
+            << indent << "m.pc = " << nnn << ";\n";
+        break;
+    case 0x3:
+        out << indent << "m.pc = (" << vx << " == " << nn << ")" << skip;
+        break;
+    case 0x4:
+        out << indent << "m.pc = (" << vx << " != " << nn << ")" << skip;
+        break;
+    case 0x5:
+        if (isSkip)
+        {
+            out << indent << "m.pc = (" << vx << " == " << vy << ")" << skip;
+        }
+        else
+        {
+            interpret(); // 5XY2, 5XY3
+        }
+        break;
+    case 0x6:
+        out << indent << vx << " = " << nn << ";\n";
+        break;
+    case 0x7:
+        out << indent << vx << " += " << nn << ";\n";
+        break;
+    case 0x8:
+        switch (op.n)
+        {
+        case 0x0: out << indent << vx << " = " << vy << ";\n"; break;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            out << indent << vx << ((op.n == 0x1) ? " |= " : (op.n == 0x2) ? " &= " : " ^= ") << vy << ";\n";
+            if (quirks.logicClearsVF)
+            {
+                out << indent << vf << " = 0x00;\n";
+            }
+            break;
+        case 0x4:
+            out << indent << vf << " = (" << vx << " > 0xFF - " << vy << ") ? 0x01 : 0x00;\n"
+                << indent << vx << " += " << vy << ";\n";
+            break;
+        case 0x5:
+            out << indent << vf << " = (" << vx << " < " << vy << ") ? 0x00 : 0x01;\n"
+                << indent << vx << " -= " << vy << ";\n";
+            break;
+        case 0x6:
+            if (quirks.shiftReadsVY)
+            {
+                out << indent << vx << " = " << vy << ";\n";
+            }
+            out << indent << vf << " = " << vx << " & 0x1;\n"
+                << indent << vx << " >>= 1;\n";
+            break;
+        case 0x7:
+            out << indent << vf << " = (" << vx << " > " << vy << ") ? 0x00 : 0x01;\n"
+                << indent << vx << " = " << vy << " - " << vx << ";\n";
+            break;
+        case 0xE:
+            if (quirks.shiftReadsVY)
+            {
+                out << indent << vx << " = " << vy << ";\n";
+            }
+            out << indent << vf << " = " << vx << " >> 7;\n"
+                << indent << vx << " <<= 1;\n";
+            break;
+        }
+        break;
+    case 0x9:
+        out << indent << "m.pc = (" << vx << " != " << vy << ")" << skip;
+        break;
+    case 0xA:
+        out << indent << "m.I = " << nnn << ";\n";
+        break;
+    case 0xB:
+        out << indent << "m.pc = " << nnn << " + " << reg(quirks.jumpAddsVX ? op.x : 0x0) << ";\n";
+        break;
+    case 0xC:
+    case 0xD:
+        interpret();
+        break;
+    case 0xE:
+        out << indent << "m.pc = " << ((op.nn == 0x9E) ? "" : "!") << "m.keypad[" << vx << " & 0xF]" << skip;
+        break;
+    case 0xF:
+        switch (op.nn)
+        {
+        case 0x07: out << indent << vx << " = m.delayTimer;\n"; break;
+        case 0x15: out << indent << "m.delayTimer = " << vx << ";\n"; break;
+        case 0x18: out << indent << "m.soundTimer = " << vx << ";\n"; break;
+        case 0x1E: out << indent << "m.I += " << vx << ";\n"; break;
+        case 0x29: out << indent << "m.I = " << vx << " * 5;\n"; break;
+        case 0x65:
+            for (unsigned i = 0; i <= op.x; ++i)
+            {
+                out << indent << reg(i) << " = m.memory[(m.I + " << i << ") % " << memorySizeOf(profile) << "];\n";
+            }
+            if (indexAdvance(quirks.indexAdvance, op.x) != 0)
+            {
+                out << indent << "m.I += " << indexAdvance(quirks.indexAdvance, op.x) << ";\n";
+            }
+            break;
+        default: // F000, FN01, FX0A, FX30, FX33, FX55, FX75, FX85
+            interpret();
+            break;
+        }
+        break;
+    }
+}
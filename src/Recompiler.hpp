@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Quirks.hpp"
+
+// Ahead-of-time translator behind --recompile. Follows every 1NNN, 2NNN and skip edge from
+// PROGRAM_MEMORY_OFFSET, splits the reachable code into basic blocks and writes them out as a
+// C++ translation unit that registers itself with the Aot backend when linked in. Jumps only
+// resolved at run time (BNNN) are left to the interpreter, as is any code the ROM writes.
+class Recompiler
+{
+public:
+    // a ROM of at most memorySizeOf(profile) - PROGRAM_MEMORY_OFFSET bytes, translated for one quirk profile
+    Recompiler(const std::vector<uint8_t>& image, QuirkProfile profile);
+
+    void write(std::ostream& out, const std::string& name) const;
+
+    size_t blockCount() const;
+    size_t instructionCount() const; // reachable instructions translated
+    size_t dynamicJumps() const; // reachable BNNN instructions
+
+private:
+    struct Block
+    {
+        uint16_t start;
+        std::vector<uint16_t> opcodes;
+    };
+
+    bool contains(unsigned address) const; // both bytes of an instruction at address lie in the image
+    uint16_t fetch(unsigned address) const;
+    void analyze();
+    void writeInstruction(std::ostream& out, uint16_t address, uint16_t opcode) const;
+
+private:
+    std::vector<uint8_t> image;
+    QuirkProfile profile;
+    std::vector<Block> blocks;
+    size_t instructions;
+    size_t dynamic;
+};
@@ -0,0 +1,117 @@
+#include "Renderer.hpp"
+
+#include <algorithm>
+
+Renderer::Renderer(unsigned scale) :
+    pixels(HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT * 4, 0),
+    intensity(HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT, 0),
+    colors(HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT, 0),
+    fadingRows{ 0 },
+    persistence{ 0 },
+    initialized{ false },
+    hires{ false }
+{
+    texture.create(HIRES_DISPLAY_WIDTH, HIRES_DISPLAY_HEIGHT);
+    texture.setSmooth(false);
+    sprite.setTexture(texture, true);
+    setScale(scale);
+}
+
+void Renderer::setScale(unsigned scale)
+{
+    const float texel = static_cast<float>(scale) * DISPLAY_WIDTH / HIRES_DISPLAY_WIDTH;
+    sprite.setScale(texel, texel);
+}
+
+void Renderer::setFade(float persistence)
+{
+    this->persistence = static_cast<unsigned>(std::min(std::max(persistence, 0.0f), 1.0f) * 256.0f);
+}
+
+bool Renderer::update(const Framebuffer& framebuffer, uint64_t changedRows)
+{
+    uint64_t dirtyRows = changedRows | fadingRows;
+    if (!initialized || framebuffer.hires() != hires)
+    {
+        // rows now mean something else; nothing of the old picture is left to fade out
+        std::fill(intensity.begin(), intensity.end(), 0);
+        fadingRows = 0;
+        dirtyRows = ~uint64_t(0) >> (64 - framebuffer.height());
+        initialized = true;
+        hires = framebuffer.hires();
+    }
+
+    if (dirtyRows == 0)
+    {
+        return false;
+    }
+
+    unsigned first = framebuffer.height();
+    unsigned last = 0;
+    for (unsigned y = 0; y < framebuffer.height(); ++y)
+    {
+        if (dirtyRows & (uint64_t(1) << y))
+        {
+            convertRow(framebuffer, y);
+            first = std::min(first, y);
+            last = y;
+        }
+    }
+
+    // one upload covering the band of changed rows
+    const unsigned texels = HIRES_DISPLAY_HEIGHT / framebuffer.height(); // per row
+    texture.update(&pixels[first * texels * HIRES_DISPLAY_WIDTH * 4], HIRES_DISPLAY_WIDTH,
+        (last - first + 1) * texels, 0, first * texels);
+    return true;
+}
+
+void Renderer::draw(sf::RenderTarget& target) const
+{
+    target.draw(sprite);
+}
+
+void Renderer::convertRow(const Framebuffer& framebuffer, unsigned y)
+{
+    const unsigned size = HIRES_DISPLAY_WIDTH / framebuffer.width(); // texels per pixel side
+
+    bool fading = false;
+    for (unsigned x = 0; x < framebuffer.width(); ++x)
+    {
+        // the top left texel of each pixel keeps its fading state
+        const unsigned texel = (y * HIRES_DISPLAY_WIDTH + x) * size;
+        uint8_t& level = intensity[texel];
+        const unsigned color = framebuffer.color(x, y);
+        if (color != 0)
+        {
+            level = 0xFF;
+            colors[texel] = static_cast<uint8_t>(color);
+        }
+        else
+        {
+            level = static_cast<uint8_t>((level * persistence) >> 8);
+            fading = fading || level != 0;
+        }
+
+        const uint8_t* rgb = DISPLAY_PALETTE[colors[texel]];
+        for (unsigned dy = 0; dy < size; ++dy)
+        {
+            for (unsigned dx = 0; dx < size; ++dx)
+            {
+                sf::Uint8* pixel = &pixels[(texel + dy * HIRES_DISPLAY_WIDTH + dx) * 4];
+                pixel[0] = static_cast<sf::Uint8>(rgb[0] * level / 0xFF);
+                pixel[1] = static_cast<sf::Uint8>(rgb[1] * level / 0xFF);
+                pixel[2] = static_cast<sf::Uint8>(rgb[2] * level / 0xFF);
+                pixel[3] = 0xFF;
+            }
+        }
+    }
+
+    if (fading)
+    {
+        fadingRows |= uint64_t(1) << y;
+    }
+    else
+    {
+        fadingRows &= ~(uint64_t(1) << y);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "Framebuffer.hpp"
+
+// Presents a Framebuffer as a single scaled sprite backed by a HIRES_DISPLAY_WIDTH x
+// HIRES_DISPLAY_HEIGHT texture, so switching resolution never recreates it: a low resolution
+// pixel covers 2x2 texels. Only rows that changed (or are still fading out) are converted and
+// uploaded, as one band per frame.
+class Renderer
+{
+public:
+    explicit Renderer(unsigned scale);
+
+    void setScale(unsigned scale); // window pixels per low resolution pixel
+    void setFade(float persistence); // share of a pixel's brightness kept per frame after it turns off; 0 disables fading
+
+    // once per presented frame with the rows that differ from the previous one
+    // (Framebuffer::rowsDifferingFrom); returns true if the texture changed
+    bool update(const Framebuffer& framebuffer, uint64_t changedRows);
+    void draw(sf::RenderTarget& target) const;
+
+private:
+    void convertRow(const Framebuffer& framebuffer, unsigned y);
+
+private:
+    sf::Texture texture;
+    sf::Sprite sprite;
+    std::vector<sf::Uint8> pixels; // RGBA
+    std::vector<uint8_t> intensity; // per texel brightness used for fading
+    std::vector<uint8_t> colors; // per texel DISPLAY_PALETTE index it was last lit with
+    uint64_t fadingRows; // bit y set while framebuffer row y still has pixels fading out
+    unsigned persistence; // fixed point, 0..256
+    bool initialized;
+    bool hires; // resolution of the last update
+};
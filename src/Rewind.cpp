@@ -0,0 +1,290 @@
+#include "Rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+namespace
+{
+    static_assert(std::is_trivially_copyable<std::mt19937>::value, "the RNG state is stored as raw bytes");
+
+    // memory comes last, its size depends on the quirk profile
+    const size_t DISPLAY_OFFSET = 0;
+    const size_t MODE_OFFSET = DISPLAY_OFFSET + sizeof(DisplayState::rows); // hires, selected planes
+    const size_t FLAGS_OFFSET = MODE_OFFSET + 2;
+    const size_t ENGINE_OFFSET = FLAGS_OFFSET + sizeof(Snapshot::flags);
+    const size_t MEMORY_OFFSET = ENGINE_OFFSET + sizeof(std::mt19937);
+
+    void putLength(std::vector<uint8_t>& out, size_t length) // LEB128
+    {
+        while (length >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(length | 0x80));
+            length >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(length));
+    }
+
+    size_t getLength(const uint8_t*& in)
+    {
+        size_t length = 0;
+        for (unsigned shift = 0; ; shift += 7)
+        {
+            const uint8_t byte = *in++;
+            length |= static_cast<size_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return length;
+            }
+        }
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t capacity, unsigned keyframeInterval) :
+    capacity{ std::max<size_t>(capacity, 2) },
+    keyframeInterval{ static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(keyframeInterval, capacity / 2))) },
+    deltaBytes{ 0 },
+    sinceKeyframe{ 0 },
+    nextSerial{ 1 },
+    keySerial{ 0 }
+{
+    resize(MEMORY_SIZE);
+}
+
+void RewindBuffer::record(const std::shared_ptr<const Snapshot>& snapshot)
+{
+    const size_t memoryBytes = snapshot->memory.size() * Snapshot::PAGE_SIZE;
+    if (MEMORY_OFFSET + memoryBytes != zeros.size())
+    {
+        clear(); // another quirk profile; the entries recorded so far do not apply to it
+        resize(memoryBytes);
+    }
+    flatten(*snapshot, image);
+
+    Entry entry;
+    entry.serial = nextSerial++;
+    entry.keyframe = entries.empty() || sinceKeyframe + 1 >= keyframeInterval;
+    if (entry.keyframe)
+    {
+        encode(image, zeros, encoded);
+        keyImage.swap(image);
+        keySerial = entry.serial;
+        sinceKeyframe = 0;
+    }
+    else
+    {
+        encode(image, keyframeImage(), encoded);
+        ++sinceKeyframe;
+    }
+    entry.delta.assign(encoded.begin(), encoded.end());
+
+    std::copy(std::begin(snapshot->keypad), std::end(snapshot->keypad), std::begin(entry.keypad));
+    std::copy(std::begin(snapshot->V), std::end(snapshot->V), std::begin(entry.V));
+    entry.I = snapshot->I;
+    entry.pc = snapshot->pc;
+    std::copy(std::begin(snapshot->stack), std::end(snapshot->stack), std::begin(entry.stack));
+    entry.sp = snapshot->sp;
+    entry.delayTimer = snapshot->delayTimer;
+    entry.soundTimer = snapshot->soundTimer;
+    entry.frameCycle = snapshot->frameCycle;
+    entry.randomDraws = snapshot->randomDraws;
+    entry.cycles = snapshot->cycles;
+    entry.frames = snapshot->frames;
+
+    deltaBytes += entry.delta.size();
+    entries.push_back(std::move(entry));
+
+    // deltas are useless without their keyframe, so the oldest one goes as a whole group
+    while (entries.size() > capacity)
+    {
+        do
+        {
+            deltaBytes -= entries.front().delta.size();
+            entries.pop_front();
+        } while (!entries.empty() && !entries.front().keyframe);
+    }
+
+    last = snapshot;
+}
+
+bool RewindBuffer::stepBack(std::shared_ptr<const Snapshot>& snapshot)
+{
+    if (entries.empty())
+    {
+        return false;
+    }
+
+    const Entry& entry = entries.back();
+    decode(entry.delta, entry.keyframe ? zeros : keyframeImage(), image);
+
+    std::shared_ptr<Snapshot> result = std::make_shared<Snapshot>();
+    result->memory.resize((image.size() - MEMORY_OFFSET) / Snapshot::PAGE_SIZE);
+    for (unsigned page = 0; page < result->memory.size(); ++page)
+    {
+        // unchanged pages keep the pointer the CPU already holds, so restoring them costs nothing
+        const uint8_t* bytes = image.data() + MEMORY_OFFSET + page * Snapshot::PAGE_SIZE;
+        if (last && page < last->memory.size() && std::equal(bytes, bytes + Snapshot::PAGE_SIZE, last->memory[page]->begin()))
+        {
+            result->memory[page] = last->memory[page];
+            continue;
+        }
+        std::shared_ptr<Snapshot::Page> copy = std::make_shared<Snapshot::Page>();
+        std::copy_n(bytes, Snapshot::PAGE_SIZE, copy->begin());
+        result->memory[page] = copy;
+    }
+
+    std::memcpy(result->display.rows, image.data() + DISPLAY_OFFSET, sizeof(result->display.rows));
+    result->display.hires = image[MODE_OFFSET] != 0;
+    result->display.planes = image[MODE_OFFSET + 1];
+    std::memcpy(result->flags, image.data() + FLAGS_OFFSET, sizeof(result->flags));
+
+    if (last && last->engine && std::memcmp(last->engine.get(), image.data() + ENGINE_OFFSET, sizeof(std::mt19937)) == 0)
+    {
+        result->engine = last->engine;
+    }
+    else
+    {
+        std::shared_ptr<std::mt19937> engine = std::make_shared<std::mt19937>();
+        std::memcpy(engine.get(), image.data() + ENGINE_OFFSET, sizeof(std::mt19937));
+        result->engine = engine;
+    }
+
+    std::copy(std::begin(entry.keypad), std::end(entry.keypad), std::begin(result->keypad));
+    std::copy(std::begin(entry.V), std::end(entry.V), std::begin(result->V));
+    result->I = entry.I;
+    result->pc = entry.pc;
+    std::copy(std::begin(entry.stack), std::end(entry.stack), std::begin(result->stack));
+    result->sp = entry.sp;
+    result->delayTimer = entry.delayTimer;
+    result->soundTimer = entry.soundTimer;
+    result->frameCycle = entry.frameCycle;
+    result->randomDraws = entry.randomDraws;
+    result->cycles = entry.cycles;
+    result->frames = entry.frames;
+
+    const bool keyframe = entry.keyframe;
+    deltaBytes -= entry.delta.size();
+    entries.pop_back();
+
+    if (keyframe)
+    {
+        sinceKeyframe = 0;
+        for (auto it = entries.rbegin(); it != entries.rend() && !it->keyframe; ++it)
+        {
+            ++sinceKeyframe;
+        }
+    }
+    else
+    {
+        --sinceKeyframe;
+    }
+
+    last = result;
+    snapshot = result;
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    entries.clear();
+    deltaBytes = 0;
+    sinceKeyframe = 0;
+    keySerial = 0;
+    last.reset();
+}
+
+size_t RewindBuffer::size() const
+{
+    return entries.size();
+}
+
+size_t RewindBuffer::bytes() const
+{
+    return deltaBytes + entries.size() * sizeof(Entry) + 2 * zeros.size();
+}
+
+void RewindBuffer::resize(size_t memoryBytes)
+{
+    image.assign(MEMORY_OFFSET + memoryBytes, 0);
+    keyImage.assign(MEMORY_OFFSET + memoryBytes, 0);
+    zeros.assign(MEMORY_OFFSET + memoryBytes, 0);
+}
+
+void RewindBuffer::encode(const std::vector<uint8_t>& image, const std::vector<uint8_t>& base, std::vector<uint8_t>& delta)
+{
+    // (zero run, literal run, literals)*: long runs of unchanged bytes cost a byte or two
+    delta.clear();
+    size_t i = 0;
+    while (i < image.size())
+    {
+        const size_t zeroStart = i;
+        while (i < image.size() && image[i] == base[i])
+        {
+            ++i;
+        }
+        if (i == image.size())
+        {
+            break; // trailing zeros are implied
+        }
+
+        // a literal run only ends at two unchanged bytes in a row, a single one is cheaper inline
+        const size_t literalStart = i;
+        while (i < image.size() && (image[i] != base[i] || (i + 1 < image.size() && image[i + 1] != base[i + 1])))
+        {
+            ++i;
+        }
+
+        putLength(delta, literalStart - zeroStart);
+        putLength(delta, i - literalStart);
+        for (size_t j = literalStart; j < i; ++j)
+        {
+            delta.push_back(image[j] ^ base[j]);
+        }
+    }
+}
+
+void RewindBuffer::decode(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& base, std::vector<uint8_t>& image)
+{
+    image.assign(base.begin(), base.end());
+    const uint8_t* in = delta.data();
+    const uint8_t* end = in + delta.size();
+    size_t position = 0;
+    while (in < end)
+    {
+        position += getLength(in);
+        for (size_t literals = getLength(in); literals > 0; --literals)
+        {
+            image[position++] ^= *in++;
+        }
+    }
+}
+
+void RewindBuffer::flatten(const Snapshot& snapshot, std::vector<uint8_t>& image)
+{
+    image.resize(MEMORY_OFFSET + snapshot.memory.size() * Snapshot::PAGE_SIZE);
+    for (unsigned page = 0; page < snapshot.memory.size(); ++page)
+    {
+        std::copy(snapshot.memory[page]->begin(), snapshot.memory[page]->end(), image.begin() + MEMORY_OFFSET + page * Snapshot::PAGE_SIZE);
+    }
+    std::memcpy(image.data() + DISPLAY_OFFSET, snapshot.display.rows, sizeof(snapshot.display.rows));
+    image[MODE_OFFSET] = snapshot.display.hires ? 1 : 0;
+    image[MODE_OFFSET + 1] = snapshot.display.planes;
+    std::memcpy(image.data() + FLAGS_OFFSET, snapshot.flags, sizeof(snapshot.flags));
+    std::memcpy(image.data() + ENGINE_OFFSET, snapshot.engine.get(), sizeof(std::mt19937));
+}
+
+const std::vector<uint8_t>& RewindBuffer::keyframeImage()
+{
+    auto key = entries.rbegin();
+    while (!key->keyframe)
+    {
+        ++key;
+    }
+    if (key->serial != keySerial)
+    {
+        decode(key->delta, zeros, keyImage);
+        keySerial = key->serial;
+    }
+    return keyImage;
+}
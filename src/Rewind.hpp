@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Snapshot.hpp"
+
+const size_t DEFAULT_REWIND_FRAMES = 3 * 60 * 60; // three minutes of 60 Hz frames
+const unsigned DEFAULT_KEYFRAME_INTERVAL = 120;
+
+// Bounded per-frame history for rewinding. Memory, display, RPL flags and RNG state of every
+// entry are stored as a run-length encoded XOR against the newest keyframe before it, and a
+// full keyframe (run-length encoded as well) starts every keyframeInterval entries; registers
+// are kept as they are. When full, the oldest keyframe is dropped together with its deltas.
+class RewindBuffer
+{
+public:
+    explicit RewindBuffer(size_t capacity = DEFAULT_REWIND_FRAMES, unsigned keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+    void record(const std::shared_ptr<const Snapshot>& snapshot);
+    bool stepBack(std::shared_ptr<const Snapshot>& snapshot); // removes the newest entry and returns its state; false if empty
+    void clear();
+
+    size_t size() const;
+    size_t bytes() const; // approximate memory held by the history
+
+private:
+    struct Entry
+    {
+        uint64_t serial;
+        std::vector<uint8_t> delta;
+        bool keyframe;
+
+        uint8_t keypad[16];
+        uint8_t V[16];
+        uint16_t I;
+        uint16_t pc;
+        uint16_t stack[16];
+        uint8_t sp;
+        uint8_t delayTimer;
+        uint8_t soundTimer;
+        uint32_t frameCycle;
+        uint64_t randomDraws;
+        uint64_t cycles;
+        uint64_t frames;
+    };
+
+    static void encode(const std::vector<uint8_t>& image, const std::vector<uint8_t>& base, std::vector<uint8_t>& delta);
+    static void decode(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& base, std::vector<uint8_t>& image);
+    static void flatten(const Snapshot& snapshot, std::vector<uint8_t>& image);
+    void resize(size_t memoryBytes); // sizes the scratch images for snapshots of that much memory
+    const std::vector<uint8_t>& keyframeImage(); // decoded keyframe of the newest entry
+
+private:
+    size_t capacity;
+    unsigned keyframeInterval;
+    std::deque<Entry> entries;
+    size_t deltaBytes;
+    unsigned sinceKeyframe; // entries recorded after the newest keyframe
+
+    uint64_t nextSerial;
+
+    std::vector<uint8_t> image; // scratch: display, flags, RNG state and memory of one entry
+    std::vector<uint8_t> encoded; // scratch for record()
+    std::vector<uint8_t> keyImage;
+    uint64_t keySerial; // entry keyImage was decoded from, 0 = none
+    std::vector<uint8_t> zeros;
+    std::shared_ptr<const Snapshot> last; // latest state recorded or returned, lends its unchanged pages to stepBack
+};
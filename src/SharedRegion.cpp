@@ -0,0 +1,205 @@
+#include "SharedRegion.hpp"
+
+#include <climits>
+#include <thread>
+
+#if defined(__linux__)
+#define CHIP8_SHARED_REGION 1
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define CHIP8_SHARED_REGION 0
+#endif
+
+namespace
+{
+    const unsigned SPIN_LIMIT = 4096; // polls before sleeping: a short step finishes well within them
+
+    unsigned spinLimit()
+    {
+        // on a single core the other side cannot make progress while this one spins
+        static const unsigned limit = (std::thread::hardware_concurrency() > 1) ? SPIN_LIMIT : 0;
+        return limit;
+    }
+
+    std::string objectName(const std::string& name)
+    {
+        return (!name.empty() && name[0] == '/') ? name : '/' + name;
+    }
+}
+
+SharedRegion::SharedRegion() :
+    owner{ false },
+    address{ nullptr },
+    length{ 0 }
+{
+}
+
+SharedRegion::~SharedRegion()
+{
+    close();
+}
+
+bool SharedRegion::available()
+{
+    return CHIP8_SHARED_REGION != 0;
+}
+
+bool SharedRegion::create(const std::string& name, size_t size)
+{
+    close();
+#if CHIP8_SHARED_REGION
+    const std::string object = objectName(name);
+    ::shm_unlink(object.c_str()); // left behind by a server that did not exit cleanly
+    const int descriptor = ::shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    void* mapping = (::ftruncate(descriptor, static_cast<off_t>(size)) == 0)
+        ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+    ::close(descriptor);
+    if (mapping == MAP_FAILED)
+    {
+        ::shm_unlink(object.c_str());
+        return false;
+    }
+
+    this->name = object;
+    owner = true;
+    address = mapping;
+    length = size;
+    return true;
+#else
+    (void)name;
+    (void)size;
+    return false;
+#endif
+}
+
+bool SharedRegion::open(const std::string& name, size_t size)
+{
+    close();
+#if CHIP8_SHARED_REGION
+    const std::string object = objectName(name);
+    const int descriptor = ::shm_open(object.c_str(), O_RDWR, 0);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    void* mapping = (::fstat(descriptor, &status) == 0 && static_cast<size_t>(status.st_size) >= size)
+        ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+    ::close(descriptor);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    this->name = object;
+    owner = false;
+    address = mapping;
+    length = size;
+    return true;
+#else
+    (void)name;
+    (void)size;
+    return false;
+#endif
+}
+
+void SharedRegion::close()
+{
+#if CHIP8_SHARED_REGION
+    if (address)
+    {
+        ::munmap(address, length);
+    }
+    if (owner)
+    {
+        ::shm_unlink(name.c_str());
+    }
+#endif
+    name.clear();
+    owner = false;
+    address = nullptr;
+    length = 0;
+}
+
+void* SharedRegion::data() const
+{
+    return address;
+}
+
+uint32_t SharedRegion::waitWhile(uint32_t* word, uint32_t value, uint32_t* sleepers)
+{
+#if CHIP8_SHARED_REGION
+    const unsigned spins = spinLimit();
+    for (unsigned spin = 0; spin < spins; ++spin)
+    {
+        const uint32_t current = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (current != value)
+        {
+            return current;
+        }
+    }
+
+    for (;;)
+    {
+        // the sequentially consistent increment and reload pair with publish()'s store and
+        // sleepers check: either publish() sees the sleeper or the reload sees the new value
+        __atomic_add_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+        uint32_t current = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+        if (current == value)
+        {
+            // not FUTEX_PRIVATE_FLAG: the waker usually is another process
+            ::syscall(SYS_futex, word, FUTEX_WAIT, value, nullptr, nullptr, 0);
+            current = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        }
+        __atomic_sub_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+        if (current != value)
+        {
+            return current;
+        }
+    }
+#else
+    (void)sleepers;
+    return *word;
+#endif
+}
+
+void SharedRegion::publish(uint32_t* word, uint32_t value, uint32_t* sleepers)
+{
+#if CHIP8_SHARED_REGION
+    __atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleepers, __ATOMIC_SEQ_CST) != 0)
+    {
+        ::syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#else
+    *word = value;
+    (void)sleepers;
+#endif
+}
+
+uint32_t SharedRegion::load(const uint32_t* word)
+{
+#if CHIP8_SHARED_REGION
+    return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+#else
+    return *word;
+#endif
+}
+
+void SharedRegion::store(uint32_t* word, uint32_t value)
+{
+#if CHIP8_SHARED_REGION
+    __atomic_store_n(word, value, __ATOMIC_RELEASE);
+#else
+    *word = value;
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A named POSIX shared memory object mapped into this process, plus the futex handshake the
+// agent interface hands steps over with. Names get a leading '/' if they lack one. Only
+// available on Linux; elsewhere create/open fail.
+class SharedRegion
+{
+public:
+    SharedRegion();
+    ~SharedRegion();
+
+    SharedRegion(const SharedRegion&) = delete;
+    SharedRegion& operator=(const SharedRegion&) = delete;
+
+    static bool available();
+
+    bool create(const std::string& name, size_t size); // zero filled, replacing any object of that name; unlinked by close()
+    bool open(const std::string& name, size_t size); // an existing object of at least size bytes
+    void close();
+
+    void* data() const; // nullptr while closed
+
+    // A word in the region that one side publishes and the other waits on. The waiter spins
+    // for a while before it sleeps on a futex, counted in *sleepers, so that publish() only
+    // makes a system call when the other side is actually asleep.
+    static uint32_t waitWhile(uint32_t* word, uint32_t value, uint32_t* sleepers); // returns the new value
+    static void publish(uint32_t* word, uint32_t value, uint32_t* sleepers); // release: writes before it are seen first
+
+    // A word in the region that is written once and only polled, like chip8_agent_region::magic.
+    static uint32_t load(const uint32_t* word); // acquire: writes before the matching store() are seen
+    static void store(uint32_t* word, uint32_t value); // release
+
+private:
+    std::string name;
+    bool owner;
+    void* address;
+    size_t length;
+};
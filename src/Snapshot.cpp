@@ -0,0 +1,255 @@
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    const char MAGIC[4] = { 'C', '8', 'S', 'S' };
+
+    // version 2 files flag memory in 64 blocks of 1 KB, one bit each, and store the flagged ones whole
+    const unsigned BLOCK_SIZE = 1024;
+    const unsigned PAGES_PER_BLOCK = BLOCK_SIZE / Snapshot::PAGE_SIZE;
+    static_assert(XO_CHIP_MEMORY_SIZE / BLOCK_SIZE == 64, "one presence bit per block");
+
+    class Writer
+    {
+    public:
+        explicit Writer(std::ostream& out) : out(out) {}
+
+        template <typename T>
+        void put(T value) // little-endian regardless of the host
+        {
+            for (unsigned i = 0; i < sizeof(T); ++i)
+            {
+                out.put(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+            }
+        }
+
+        void bytes(const uint8_t* data, size_t size)
+        {
+            out.write(reinterpret_cast<const char*>(data), size);
+        }
+
+    private:
+        std::ostream& out;
+    };
+
+    class Reader
+    {
+    public:
+        explicit Reader(std::istream& in) : in(in) {}
+
+        template <typename T>
+        T get()
+        {
+            uint64_t value = 0;
+            for (unsigned i = 0; i < sizeof(T); ++i)
+            {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(in.get())) << (8 * i);
+            }
+            return static_cast<T>(value);
+        }
+
+        void bytes(uint8_t* data, size_t size)
+        {
+            in.read(reinterpret_cast<char*>(data), size);
+        }
+
+        bool good() const
+        {
+            return static_cast<bool>(in);
+        }
+
+    private:
+        std::istream& in;
+    };
+}
+
+bool writeSnapshot(std::ostream& out, const Snapshot& snapshot)
+{
+    Writer writer(out);
+    writer.bytes(reinterpret_cast<const uint8_t*>(MAGIC), sizeof(MAGIC));
+    writer.put(SNAPSHOT_VERSION);
+
+    writer.put(snapshot.cycles);
+    writer.put(snapshot.frames);
+    writer.put(snapshot.frameCycle);
+
+    writer.bytes(snapshot.V, sizeof(snapshot.V));
+    writer.put(snapshot.I);
+    writer.put(snapshot.pc);
+    for (uint16_t address : snapshot.stack)
+    {
+        writer.put(address);
+    }
+    writer.put(snapshot.sp);
+    writer.put(snapshot.delayTimer);
+    writer.put(snapshot.soundTimer);
+    writer.bytes(snapshot.keypad, sizeof(snapshot.keypad));
+    writer.bytes(snapshot.flags, sizeof(snapshot.flags));
+
+    writer.put(static_cast<uint8_t>(snapshot.display.hires));
+    writer.put(snapshot.display.planes);
+    for (const auto& plane : snapshot.display.rows)
+    {
+        for (const auto& row : plane)
+        {
+            for (uint64_t word : row)
+            {
+                writer.put(word);
+            }
+        }
+    }
+
+    // most of the address space is usually zero, so only blocks with content are stored
+    uint64_t present = 0;
+    for (unsigned page = 0; page < snapshot.memory.size(); ++page)
+    {
+        const Snapshot::Page& bytes = *snapshot.memory[page];
+        if (std::any_of(bytes.begin(), bytes.end(), [](uint8_t value) { return value != 0; }))
+        {
+            present |= uint64_t(1) << (page / PAGES_PER_BLOCK);
+        }
+    }
+    writer.put(present);
+    for (unsigned page = 0; page < snapshot.memory.size(); ++page)
+    {
+        if (present & (uint64_t(1) << (page / PAGES_PER_BLOCK)))
+        {
+            writer.bytes(snapshot.memory[page]->data(), Snapshot::PAGE_SIZE);
+        }
+    }
+
+    // the engine only exposes its state as text; store the words in binary instead
+    std::stringstream text;
+    text << *snapshot.engine;
+    std::vector<uint32_t> words;
+    uint32_t word;
+    while (text >> word)
+    {
+        words.push_back(word);
+    }
+    writer.put(snapshot.randomDraws);
+    writer.put(static_cast<uint16_t>(words.size()));
+    for (uint32_t value : words)
+    {
+        writer.put(value);
+    }
+
+    return static_cast<bool>(out);
+}
+
+bool readSnapshot(std::istream& in, Snapshot& snapshot)
+{
+    Reader reader(in);
+    char magic[sizeof(MAGIC)];
+    reader.bytes(reinterpret_cast<uint8_t*>(magic), sizeof(magic));
+    if (!reader.good() || !std::equal(std::begin(magic), std::end(magic), std::begin(MAGIC)))
+    {
+        return false;
+    }
+    const uint16_t version = reader.get<uint16_t>();
+    if (version == 0 || version > SNAPSHOT_VERSION)
+    {
+        return false;
+    }
+
+    Snapshot result;
+    result.cycles = reader.get<uint64_t>();
+    result.frames = reader.get<uint64_t>();
+    result.frameCycle = reader.get<uint32_t>();
+
+    reader.bytes(result.V, sizeof(result.V));
+    result.I = reader.get<uint16_t>();
+    result.pc = reader.get<uint16_t>();
+    for (uint16_t& address : result.stack)
+    {
+        address = reader.get<uint16_t>();
+    }
+    result.sp = reader.get<uint8_t>();
+    result.delayTimer = reader.get<uint8_t>();
+    result.soundTimer = reader.get<uint8_t>();
+    reader.bytes(result.keypad, sizeof(result.keypad));
+
+    const std::shared_ptr<const Snapshot::Page> zero = std::make_shared<Snapshot::Page>();
+    if (version >= 2)
+    {
+        reader.bytes(result.flags, sizeof(result.flags));
+        result.display.hires = reader.get<uint8_t>() != 0;
+        result.display.planes = reader.get<uint8_t>();
+        for (auto& plane : result.display.rows)
+        {
+            for (auto& row : plane)
+            {
+                for (uint64_t& word : row)
+                {
+                    word = reader.get<uint64_t>();
+                }
+            }
+        }
+
+        // memory beyond the first 4 KB only exists for XO-CHIP, so it sizes the page table
+        const uint64_t present = reader.get<uint64_t>();
+        const bool extended = (present >> (MEMORY_SIZE / BLOCK_SIZE)) != 0;
+        result.memory.resize((extended ? XO_CHIP_MEMORY_SIZE : MEMORY_SIZE) / Snapshot::PAGE_SIZE);
+        for (unsigned page = 0; page < result.memory.size(); ++page)
+        {
+            if (present & (uint64_t(1) << (page / PAGES_PER_BLOCK)))
+            {
+                std::shared_ptr<Snapshot::Page> bytes = std::make_shared<Snapshot::Page>();
+                reader.bytes(bytes->data(), Snapshot::PAGE_SIZE);
+                result.memory[page] = bytes;
+            }
+            else
+            {
+                result.memory[page] = zero;
+            }
+        }
+    }
+    else
+    {
+        // 64x32, one plane, and 16 pages of 256 bytes covering 4 KB of memory
+        result.display.planes = 0x1;
+        for (unsigned y = 0; y < DISPLAY_HEIGHT; ++y)
+        {
+            result.display.rows[0][y][0] = reader.get<uint64_t>();
+        }
+
+        const uint16_t present = reader.get<uint16_t>();
+        result.memory.resize(MEMORY_SIZE / Snapshot::PAGE_SIZE);
+        for (unsigned page = 0; page < result.memory.size(); ++page)
+        {
+            if (present & (1u << page))
+            {
+                std::shared_ptr<Snapshot::Page> bytes = std::make_shared<Snapshot::Page>();
+                reader.bytes(bytes->data(), Snapshot::PAGE_SIZE);
+                result.memory[page] = bytes;
+            }
+            else
+            {
+                result.memory[page] = zero;
+            }
+        }
+    }
+
+    result.randomDraws = reader.get<uint64_t>();
+    const uint16_t count = reader.get<uint16_t>();
+    std::stringstream text;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        text << reader.get<uint32_t>() << ' ';
+    }
+    std::shared_ptr<std::mt19937> engine = std::make_shared<std::mt19937>();
+    text >> *engine;
+    if (!reader.good() || text.fail() || result.sp >= 16)
+    {
+        return false;
+    }
+    result.engine = engine;
+
+    snapshot = result;
+    return true;
+}
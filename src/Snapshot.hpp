@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "CPU.hpp"
+
+const uint16_t SNAPSHOT_VERSION = 2;
+
+// Complete machine state, taken with CPU::snapshot() and applied with CPU::restore().
+// Memory is split into immutable pages shared between snapshots: a snapshot only copies the
+// pages written since the previous snapshot (or restore) of the same CPU, so keeping many of
+// them around, or taking one every frame, costs little more than the registers.
+struct Snapshot
+{
+    static const unsigned PAGE_SIZE = SNAPSHOT_PAGE_SIZE;
+    typedef std::array<uint8_t, PAGE_SIZE> Page;
+
+    std::vector<std::shared_ptr<const Page>> memory; // covers the memory of the CPU's quirk profile
+    std::shared_ptr<const std::mt19937> engine; // shared as well, CXNN is rare
+    uint64_t randomDraws = 0; // CXNN draws and reseeds so far, tells whether engine changed
+
+    DisplayState display = {};
+    uint8_t keypad[16] = {};
+    uint8_t V[16] = {};
+    uint16_t I = 0;
+    uint16_t pc = 0;
+    uint16_t stack[16] = {};
+    uint8_t sp = 0;
+    uint8_t flags[16] = {};
+    uint8_t delayTimer = 0;
+    uint8_t soundTimer = 0;
+
+    // filled in by Emulator, left at 0 by CPU::snapshot()
+    uint64_t cycles = 0;
+    uint64_t frames = 0;
+    uint32_t frameCycle = 0;
+};
+
+// Versioned little-endian binary format: "C8SS", version, registers, display, the non-zero
+// memory pages and the RNG state. Version 1 files, from before high resolution, RPL flags and
+// 64 KB of memory, are still read. The RNG state is stored as the words of the mt19937 textual
+// representation, which the C++ standard defines, so files are portable between standard libraries.
+bool writeSnapshot(std::ostream& out, const Snapshot& snapshot);
+bool readSnapshot(std::istream& in, Snapshot& snapshot); // false on a malformed or newer file
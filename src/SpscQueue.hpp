@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free FIFO between exactly one producer thread and one consumer thread.
+// Capacity must be a power of two; push() fails instead of blocking when the queue is full.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() :
+        head{ 0 },
+        tail{ 0 }
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T& item) // producer only
+    {
+        const size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        items[position & (Capacity - 1)] = item;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) // consumer only
+    {
+        const size_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[position & (Capacity - 1)];
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[Capacity];
+    alignas(64) std::atomic<size_t> head; // next slot to write
+    alignas(64) std::atomic<size_t> tail; // next slot to read
+};
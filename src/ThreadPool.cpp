@@ -0,0 +1,119 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) :
+    queued{ 0 },
+    unfinished{ 0 },
+    nextQueue{ 0 },
+    stopping{ false }
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        queues.emplace_back(new Queue);
+    }
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    Queue& queue = *queues[nextQueue];
+    nextQueue = (nextQueue + 1) % queues.size();
+    ++unfinished;
+    {
+        std::lock_guard<std::mutex> queueLock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    ++queued;
+    lock.unlock();
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+unsigned ThreadPool::size() const
+{
+    return static_cast<unsigned>(workers.size());
+}
+
+bool ThreadPool::take(unsigned worker, std::function<void()>& task)
+{
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(unsigned worker)
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        if (take(worker, task))
+        {
+            task();
+
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (--unfinished == 0)
+            {
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskAvailable.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
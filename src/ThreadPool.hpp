@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool: every worker owns a deque, takes its newest task first
+// and steals the oldest task of another worker when its own deque runs dry.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = 0); // 0 = one worker per hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task); // tasks must not throw
+    void wait(); // blocks until every submitted task has finished
+    unsigned size() const;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(unsigned worker, std::function<void()>& task);
+    void work(unsigned worker);
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+    std::atomic<size_t> queued;
+    size_t unfinished;
+    unsigned nextQueue;
+    bool stopping;
+};
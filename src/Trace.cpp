@@ -0,0 +1,274 @@
+#include "Trace.hpp"
+#include "Disassembler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_TRACE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0 // Linux only: fault the segment in up front instead of a page at a time
+#endif
+#else
+#define CHIP8_TRACE_MMAP 0
+#endif
+
+namespace
+{
+    const char MAGIC[4] = { 'C', '8', 'T', 'R' };
+    const uint16_t TRACE_VERSION = 1;
+
+    struct TraceHeader
+    {
+        char magic[4];
+        uint16_t version;
+        uint16_t recordSize;
+        uint64_t records;
+    };
+    static_assert(sizeof(TraceHeader) == 16, "the header is written as is");
+
+    TraceHeader makeHeader(uint64_t records)
+    {
+        TraceHeader header;
+        std::copy(std::begin(MAGIC), std::end(MAGIC), std::begin(header.magic));
+        header.version = TRACE_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        header.records = records;
+        return header;
+    }
+}
+
+TraceWriter::TraceWriter() :
+    cursor{ nullptr },
+    limit{ nullptr },
+    segment{ nullptr },
+    written{ 0 },
+    cycle{ 0 },
+    discarding{ false },
+    descriptor{ -1 },
+    mapping{ nullptr },
+    mappingLength{ 0 }
+{
+    std::fill(std::begin(registers), std::end(registers), 0);
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const std::string& fileName)
+{
+    close();
+    written = 0;
+    discarding = false;
+    const TraceHeader header = makeHeader(0);
+
+#if CHIP8_TRACE_MMAP
+    descriptor = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    if (::pwrite(descriptor, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+    {
+        ::close(descriptor);
+        descriptor = -1;
+        return false;
+    }
+#else
+    stream.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.resize(SEGMENT_RECORDS);
+#endif
+    nextSegment();
+    return true;
+}
+
+bool TraceWriter::close()
+{
+    if (!segment)
+    {
+        return true;
+    }
+
+    const uint64_t total = records();
+    releaseSegment();
+    const TraceHeader header = makeHeader(total);
+
+#if CHIP8_TRACE_MMAP
+    const bool ok = ::ftruncate(descriptor, sizeof(header) + total * sizeof(TraceRecord)) == 0
+        && ::pwrite(descriptor, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ::close(descriptor);
+    descriptor = -1;
+    return ok && !discarding;
+#else
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.close();
+    return !stream.fail();
+#endif
+}
+
+void TraceWriter::resume(const CPU& cpu, uint64_t cycle)
+{
+    this->cycle = cycle;
+    std::memcpy(registers, cpu.V, sizeof(registers));
+}
+
+uint64_t TraceWriter::records() const
+{
+    return written + (discarding ? 0 : cursor - segment);
+}
+
+unsigned TraceWriter::lowestBit(uint16_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(value);
+#else
+    unsigned count = 0;
+    for (unsigned bit = 1; (value & bit) == 0; bit <<= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+void TraceWriter::nextSegment()
+{
+    releaseSegment();
+
+#if CHIP8_TRACE_MMAP
+    if (!discarding)
+    {
+        // mmap offsets must be page aligned, so the mapping starts at the page holding the segment
+        const uint64_t begin = sizeof(TraceHeader) + written * sizeof(TraceRecord);
+        const uint64_t end = begin + SEGMENT_RECORDS * sizeof(TraceRecord);
+        const uint64_t pageSize = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        const uint64_t mapBegin = begin / pageSize * pageSize;
+
+        if (::ftruncate(descriptor, end) == 0)
+        {
+            mappingLength = end - mapBegin;
+            mapping = ::mmap(nullptr, mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descriptor, mapBegin);
+            if (mapping != MAP_FAILED)
+            {
+                segment = reinterpret_cast<TraceRecord*>(static_cast<uint8_t*>(mapping) + (begin - mapBegin));
+                cursor = segment;
+                limit = segment + SEGMENT_RECORDS;
+                return;
+            }
+            mapping = nullptr;
+        }
+        discarding = true; // out of disk or address space: keep what was recorded so far
+    }
+    buffer.resize(SEGMENT_RECORDS);
+#endif
+    segment = buffer.data();
+    cursor = segment;
+    limit = segment + SEGMENT_RECORDS;
+}
+
+void TraceWriter::releaseSegment()
+{
+    if (!segment)
+    {
+        return;
+    }
+    if (!discarding)
+    {
+        written += cursor - segment;
+    }
+
+#if CHIP8_TRACE_MMAP
+    if (mapping)
+    {
+        ::munmap(mapping, mappingLength);
+        mapping = nullptr;
+    }
+#else
+    stream.write(reinterpret_cast<const char*>(segment), (cursor - segment) * sizeof(TraceRecord));
+#endif
+    cursor = limit = segment = nullptr;
+}
+
+bool TraceReader::open(const std::string& fileName)
+{
+    file.open(fileName.c_str(), std::ios::binary);
+    TraceHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || !std::equal(std::begin(MAGIC), std::end(MAGIC), std::begin(header.magic))
+        || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+    {
+        return false;
+    }
+    count = header.records;
+    position = 0;
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+    if (position == count || !file.read(reinterpret_cast<char*>(&record), sizeof(record)))
+    {
+        return false;
+    }
+    ++position;
+    return true;
+}
+
+uint64_t TraceReader::records() const
+{
+    return count;
+}
+
+void printRecord(std::ostream& out, const TraceRecord& record)
+{
+    const std::ios::fmtflags flags = out.flags();
+    const char fill = out.fill();
+
+    out << std::setw(12) << record.cycle << std::hex << std::uppercase << std::setfill('0')
+        << "  " << std::setw(3) << record.pc << "  " << std::setw(4) << record.opcode << "  "
+        << std::left << std::setfill(' ') << std::setw(16) << disassemble(record.opcode) << std::right
+        << std::setfill('0') << " I=" << std::setw(3) << record.I
+        << " SP=" << static_cast<unsigned>(record.sp)
+        << " DT=" << std::setw(2) << static_cast<unsigned>(record.delayTimer)
+        << " VF=" << std::setw(2) << static_cast<unsigned>(record.flag);
+    if (record.changed)
+    {
+        unsigned lowest = 0;
+        while (!(record.changed & (1u << lowest)))
+        {
+            ++lowest;
+        }
+        if (lowest != 0xF) // VF is always shown
+        {
+            out << " V" << lowest << '=' << std::setw(2) << static_cast<unsigned>(record.value);
+        }
+        if (record.changed & ~(1u << lowest))
+        {
+            out << " changed=" << std::setw(4) << record.changed;
+        }
+    }
+    out << '\n';
+
+    out.flags(flags);
+    out.fill(fill);
+}
+
+bool sameRecord(const TraceRecord& a, const TraceRecord& b)
+{
+    return a.cycle == b.cycle && a.pc == b.pc && a.opcode == b.opcode && a.I == b.I
+        && a.changed == b.changed && a.value == b.value && a.flag == b.flag
+        && a.sp == b.sp && a.delayTimer == b.delayTimer;
+}
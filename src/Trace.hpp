@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CPU.hpp"
+
+// One executed instruction; the state fields are taken after it ran.
+struct TraceRecord
+{
+    uint64_t cycle; // instructions executed before this one
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint16_t changed; // bit r: Vr was modified
+    uint8_t value; // new value of the lowest modified register
+    uint8_t flag; // VF
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint32_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 24, "trace files store TraceRecord as is");
+
+// Appends a TraceRecord per instruction to a file: a 16 byte header ("C8TR", version,
+// record size, record count) followed by the records in host byte order. The file grows in
+// memory-mapped segments, so recording is a store per field rather than a stream write.
+class TraceWriter
+{
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool open(const std::string& fileName);
+    bool close(); // writes the record count and trims the file; false if that failed
+
+    // call before every run of instructions: sets the cycle of the next record and takes the
+    // registers as they are, so changes made outside of traced execution are not reported
+    void resume(const CPU& cpu, uint64_t cycle);
+
+    void retired(const CPU& cpu, uint16_t address, uint16_t opcode) // see CPU::emulateCycle(Observer&)
+    {
+        if (cursor == limit)
+        {
+            nextSegment();
+        }
+
+        TraceRecord& record = *cursor++;
+        record.cycle = cycle++;
+        record.pc = address;
+        record.opcode = opcode;
+        record.I = cpu.I;
+
+        uint64_t now[2];
+        std::memcpy(now, cpu.V, sizeof(now));
+        const uint16_t changed = changedBytes(now[0] ^ registers[0]) | changedBytes(now[1] ^ registers[1]) << 8;
+        registers[0] = now[0];
+        registers[1] = now[1];
+        record.changed = changed;
+        record.value = changed ? cpu.V[lowestBit(changed)] : 0;
+        record.flag = cpu.V[0xF];
+        record.sp = cpu.sp;
+        record.delayTimer = cpu.delayTimer;
+        record.reserved = 0;
+    }
+
+    uint64_t records() const;
+
+private:
+    static unsigned lowestBit(uint16_t value);
+
+    static unsigned changedBytes(uint64_t difference) // bit i set if byte i in memory order is not 0
+    {
+        // set the top bit of every non-zero byte, then gather those bits into the low byte
+        const uint64_t low = 0x7F7F7F7F7F7F7F7Full;
+        const uint64_t top = (((difference & low) + low) | difference) & ~low;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return static_cast<unsigned>(((top >> 7) * 0x8040201008040201ull) >> 56);
+#else
+        return static_cast<unsigned>(((top >> 7) * 0x0102040810204080ull) >> 56);
+#endif
+    }
+    void nextSegment();
+    void releaseSegment();
+
+private:
+    static const size_t SEGMENT_RECORDS = 1 << 20; // 24 MB per segment
+
+    TraceRecord* cursor;
+    TraceRecord* limit;
+    TraceRecord* segment;
+    uint64_t written; // records in the segments before the current one
+    uint64_t cycle;
+    uint64_t registers[2]; // V0-VF after the previous record
+    bool discarding; // the file could not grow; records go to buffer and are dropped
+
+    int descriptor; // mapped output
+    void* mapping;
+    size_t mappingLength;
+    std::ofstream stream; // buffered output where mmap is not available
+    std::vector<TraceRecord> buffer;
+};
+
+// Sequential reader for TraceWriter files.
+class TraceReader
+{
+public:
+    bool open(const std::string& fileName); // false if the file is missing or not a trace
+    bool next(TraceRecord& record);
+    uint64_t records() const;
+
+private:
+    std::ifstream file;
+    uint64_t count = 0;
+    uint64_t position = 0;
+};
+
+// "cycle pc opcode disassembly I sp DT VF [Vr=value ...]" on one line
+void printRecord(std::ostream& out, const TraceRecord& record);
+bool sameRecord(const TraceRecord& a, const TraceRecord& b); // ignores the reserved field
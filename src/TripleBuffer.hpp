@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the newest value from one producer thread to one consumer thread without locks.
+// The producer fills back() and publish()es it; the consumer's acquire() picks up the most
+// recently published value into front(). Neither side ever waits for the other: values the
+// consumer was too slow to pick up are simply replaced by newer ones.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+        middle{ 1 },
+        backIndex{ 2 },
+        frontIndex{ 0 }
+    {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    T& back() // producer only
+    {
+        return slots[backIndex];
+    }
+
+    void publish() // producer only; back() is a different slot afterwards
+    {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    bool acquire() // consumer only; returns true if front() now holds a newer value
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+        {
+            return false;
+        }
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& front() const // consumer only
+    {
+        return slots[frontIndex];
+    }
+
+private:
+    static const unsigned INDEX = 3;
+    static const unsigned FRESH = 4; // set in middle while it holds a value the consumer has not seen
+
+    T slots[3];
+    alignas(64) std::atomic<unsigned> middle;
+    alignas(64) unsigned backIndex;
+    alignas(64) unsigned frontIndex;
+};
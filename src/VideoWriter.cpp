@@ -0,0 +1,168 @@
+#include "VideoWriter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+
+VideoWriter::VideoWriter() :
+    stopping{ false },
+    format{ VideoFormat::Y4M },
+    scale{ DEFAULT_VIDEO_SCALE },
+    hasPrevious{ false },
+    frameCount{ 0 },
+    convertedCount{ 0 },
+    stallCount{ 0 }
+{
+}
+
+VideoWriter::~VideoWriter()
+{
+    close();
+}
+
+bool VideoWriter::open(const std::string& fileName, VideoFormat format, unsigned scale)
+{
+    close();
+    file.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    this->format = format;
+    this->scale = std::max(1u, scale);
+    const unsigned bytesPerPixel = (format == VideoFormat::Rgb) ? 3 : 1;
+    image.assign(HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT * this->scale * this->scale * bytesPerPixel, 0);
+    hasPrevious = false;
+    frameCount = 0;
+    convertedCount = 0;
+    stallCount = 0;
+
+    if (format == VideoFormat::Y4M)
+    {
+        std::ostringstream header;
+        header << "YUV4MPEG2 W" << HIRES_DISPLAY_WIDTH * this->scale << " H" << HIRES_DISPLAY_HEIGHT * this->scale
+            << " F60:1 Ip A1:1 Cmono\n";
+        file << header.str();
+    }
+
+    stopping = false;
+    writer = std::thread{ &VideoWriter::work, this };
+    return true;
+}
+
+bool VideoWriter::close()
+{
+    if (!file.is_open())
+    {
+        return true;
+    }
+
+    stopping = true;
+    writer.join();
+    file.close();
+    return !file.fail();
+}
+
+void VideoWriter::capture(const Framebuffer& display)
+{
+    Frame frame;
+    frame.display = display.state();
+
+    if (!queue.push(frame))
+    {
+        ++stallCount;
+        while (!queue.push(frame))
+        {
+            std::this_thread::yield();
+        }
+    }
+    ++frameCount;
+}
+
+uint64_t VideoWriter::frames() const
+{
+    return frameCount;
+}
+
+uint64_t VideoWriter::converted() const
+{
+    return convertedCount;
+}
+
+uint64_t VideoWriter::stalls() const
+{
+    return stallCount;
+}
+
+void VideoWriter::work()
+{
+    Frame frame;
+    for (;;)
+    {
+        if (!queue.pop(frame))
+        {
+            if (stopping.load(std::memory_order_acquire) && queue.empty())
+            {
+                break; // capture() is no longer called once close() has begun
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        if (!hasPrevious || frame.display != previous.display)
+        {
+            convert(frame);
+            previous = frame;
+            hasPrevious = true;
+            ++convertedCount;
+        }
+
+        if (format == VideoFormat::Y4M)
+        {
+            file.write("FRAME\n", 6);
+        }
+        file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+    file.flush();
+}
+
+void VideoWriter::convert(const Frame& frame)
+{
+    const unsigned bytesPerPixel = (format == VideoFormat::Rgb) ? 3 : 1;
+    const size_t rowBytes = HIRES_DISPLAY_WIDTH * scale * bytesPerPixel;
+    const DisplayState& display = frame.display;
+    const unsigned width = display.hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+    const unsigned height = display.hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+    const unsigned size = scale * HIRES_DISPLAY_WIDTH / width; // video pixels per CHIP-8 pixel side
+
+    for (unsigned y = 0; y < height; ++y)
+    {
+        // build the first scaled line of the row, then copy it for the remaining size - 1 lines
+        uint8_t* line = image.data() + y * size * rowBytes;
+        uint8_t* out = line;
+        for (unsigned x = 0; x < width; ++x)
+        {
+            const unsigned shift = 63 - x % 64;
+            const unsigned color = ((display.rows[0][y][x / 64] >> shift) & 1) | ((display.rows[1][y][x / 64] >> shift) & 1) << 1;
+            if (format == VideoFormat::Rgb)
+            {
+                for (unsigned i = 0; i < size; ++i, out += 3)
+                {
+                    std::memcpy(out, DISPLAY_PALETTE[color], 3);
+                }
+            }
+            else
+            {
+                std::memset(out, DISPLAY_PALETTE[color][0], size); // the palette is gray, red is the luma
+                out += size;
+            }
+        }
+        for (unsigned copy = 1; copy < size; ++copy)
+        {
+            std::memcpy(line + copy * rowBytes, line, rowBytes);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Framebuffer.hpp"
+#include "SpscQueue.hpp"
+
+const unsigned DEFAULT_VIDEO_SCALE = 2; // per high resolution pixel, so 4 per low resolution one
+
+enum class VideoFormat
+{
+    Y4M, // YUV4MPEG2, monochrome (Cmono), 60 fps; what ffmpeg and most players read directly
+    Rgb  // headerless rgb24 frames of HIRES_DISPLAY_WIDTH * scale by HIRES_DISPLAY_HEIGHT * scale pixels
+};
+
+// Streams one frame per 60 Hz tick to a file or named pipe. The emulation thread only copies
+// the framebuffer's DisplayState into a bounded queue; a background thread scales and writes
+// it. The video has the size of the high resolution screen, low resolution frames are doubled.
+// Frames identical to the previous one are written again from the already converted image,
+// since neither format can refer back to an earlier frame. capture() waits only when the
+// writer has fallen a full queue behind, i.e. when the disk or the pipe's reader is the limit.
+class VideoWriter
+{
+public:
+    VideoWriter();
+    ~VideoWriter();
+
+    VideoWriter(const VideoWriter&) = delete;
+    VideoWriter& operator=(const VideoWriter&) = delete;
+
+    bool open(const std::string& fileName, VideoFormat format, unsigned scale);
+    bool close(); // writes every captured frame; false if a write failed
+
+    void capture(const Framebuffer& display); // emulation thread
+
+    uint64_t frames() const; // captured so far
+    uint64_t converted() const; // of those, frames that differed from their predecessor; valid after close()
+    uint64_t stalls() const; // capture() calls that had to wait for the writer
+
+private:
+    struct Frame
+    {
+        DisplayState display;
+    };
+
+    void work();
+    void convert(const Frame& frame);
+
+private:
+    SpscQueue<Frame, 512> queue;
+    std::thread writer;
+    std::atomic<bool> stopping;
+    std::ofstream file;
+
+    VideoFormat format;
+    unsigned scale;
+    std::vector<uint8_t> image; // converted frame, ready to write
+    Frame previous;
+    bool hasPrevious;
+
+    uint64_t frameCount;
+    uint64_t convertedCount;
+    uint64_t stallCount;
+};
@@ -1,20 +1,963 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "AgentApi.h"
+#include "AgentServer.hpp"
+#include "Audio.hpp"
+#include "BatchRunner.hpp"
 #include "Chip8.hpp"
+#include "Emulator.hpp"
+#include "Lockstep.hpp"
+#include "Metrics.hpp"
+#include "Profiler.hpp"
+#include "Recompiler.hpp"
+#include "Rewind.hpp"
+#include "Trace.hpp"
 
-int main(int argc, char* argv[])
+namespace
 {
-    Chip8 chip;
+    struct Options
+    {
+        std::string romPath;
+        std::string batchPath;
+        std::string loadStatePath;
+        std::string saveStatePath;
+        std::string profilePath;
+        std::string flamegraphPath;
+        std::string recordPath;
+        std::string replayPath;
+        std::string tracePath;
+        std::string wavPath;
+        std::string videoPath;
+        unsigned videoScale = DEFAULT_VIDEO_SCALE;
+        std::string traceDumpPath;
+        std::string recompilePath;
+        std::string serveName;
+        std::string metricsPath;
+        unsigned metricsInterval = DEFAULT_METRICS_INTERVAL;
+        bool overlay = false;
+        std::string traceDiffPaths[2];
+        uint16_t traceLow = 0;
+        uint16_t traceHigh = 0xFFFF;
+        bool seeded = false;
+        uint32_t seed = 0;
+        unsigned threads = 0;
+        size_t lockstepMachines = 0;
+        size_t agentInstances = 0;
+        unsigned stepFrames = 1;
+        bool headless = false;
+        bool realtime = false;
+        bool latency = false;
+        unsigned turbo = 0;
+        unsigned audioLatency = DEFAULT_AUDIO_LATENCY;
+        bool idleSkipping = true;
+        uint64_t cycles = 0;
+        uint64_t frames = 0;
+        uint64_t rewindFrames = 0;
+        unsigned clock = DEFAULT_CYCLES_PER_SECOND;
+        Backend backend = Backend::Interpreter;
+        bool differential = false;
+        QuirkProfile quirks = QuirkProfile::Default;
+        bool spriteEdgeSet = false;
+        SpriteEdge spriteEdge = SpriteEdge::Wrap;
+        unsigned scale = 10;
+        float fade = 0.0f;
+    };
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: ./" << program << " [options] pathToROM\n"
+            << "       ./" << program << " [options] --batch manifest\n"
+            << "       ./" << program << " --trace-dump trace [--pc-range LO-HI]\n"
+            << "       ./" << program << " --trace-diff traceA traceB\n"
+            << "       ./" << program << " --recompile OUT.cpp pathToROM\n"
+            << "  --headless       run without a window and print the final machine state\n"
+            << "  --cycles N       headless: stop after N instructions\n"
+            << "  --frames N       headless: stop after N frames (60 Hz timer ticks)\n"
+            << "  --clock HZ       instructions per second, " << MIN_CYCLES_PER_SECOND << " to " << UNLIMITED_CYCLES_PER_SECOND
+            << " or unlimited (default " << DEFAULT_CYCLES_PER_SECOND << ")\n"
+            << "  --realtime       headless: pace emulation to the clock instead of running flat out; reports timing\n"
+            << "  --rewind N       headless: record every frame, then step back N frames before stopping\n"
+            << "  --load-state F   resume from a state file after loading the ROM\n"
+            << "  --save-state F   write the final machine state to F\n"
+            << "  --profile F      interpret with the profiler and write the hotspot report to F\n"
+            << "  --flamegraph F   interpret with the profiler and write collapsed call stacks to F\n"
+            << "  --trace F        interpret and write a binary record of every instruction to F\n"
+            << "  --pc-range LO-HI trace-dump: only show records with LO <= pc <= HI (hex)\n"
+            << "  --seed N         seed the CXNN random number generator; batch: job i gets N + i\n"
+            << "  --record F       log key changes with their cycle, plus seed and clock, to F\n"
+            << "  --replay F       feed the keys logged in F; headless runs to the end of the log by default\n"
+            << "  --batch FILE     run every '<rom> <input log or -> <cycles>' line of FILE headless in parallel\n"
+            << "  --threads N      batch: worker threads (default: one per hardware thread)\n"
+            << "  --bench-lockstep N  run N copies of the ROM for --cycles steps, as N CPUs and in lockstep\n"
+            << "  --serve NAME     let an agent drive the ROM through the shared memory object NAME (see AgentApi.h)\n"
+            << "  --bench-agent N  serve N copies of the ROM and step them all through the agent API for --frames frames\n"
+            << "  --step-frames K  bench-agent: frames advanced per step (default 1)\n"
+            << "  --backend NAME   interpreter (default), cached, jit or aot\n"
+            << "  --jit-check      jit/aot backend: compare all native code against the interpreter\n"
+            << "  --recompile F    translate the ROM to a C++ file F; built into the emulator, it runs with --backend aot\n"
+            << "  --no-idle-skip   execute wait loops (FX0A, delay timer polls) instead of skipping to the next frame\n"
+            << "  --quirks NAME    instruction semantics: default, vip (COSMAC VIP), chip48, schip (SUPER-CHIP)\n"
+            << "                   or xochip\n"
+            << "  --sprite-edge M  wrap or clip sprite pixels crossing the screen edge (default: as the quirks say)\n"
+            << "  --scale N        window pixels per low resolution (64x32) pixel (default 10)\n"
+            << "  --fade F         phosphor persistence per frame, 0 (off, default) to 1\n"
+            << "  --turbo N        window: start in turbo mode (Tab toggles it), unpaced and showing every Nth frame\n"
+            << "  --audio-latency MS  window: sound buffering, " << MIN_AUDIO_LATENCY << " ms and up (default "
+            << DEFAULT_AUDIO_LATENCY << "); 0 mutes\n"
+            << "  --wav F          headless: write the sound to F as a 16-bit mono WAV file\n"
+            << "  --video F        headless: write a frame per timer tick to F (file or named pipe); YUV4MPEG2 if F\n"
+            << "                   ends in .y4m, else raw rgb24 at 60 fps\n"
+            << "  --video-scale N  video pixels per high resolution pixel (default " << DEFAULT_VIDEO_SCALE << ")\n"
+            << "  --latency        window: print input-to-photon latency and presented frames on exit\n"
+            << "  --metrics F      write instruction and tick rates, late ticks and phase timings to F as a JSON\n"
+            << "                   line every interval; headless runs also print a summary\n"
+            << "  --metrics-interval MS  metrics: milliseconds between two lines (default " << DEFAULT_METRICS_INTERVAL << ")\n"
+            << "  --overlay        window: show the metrics over the screen (F1 toggles it)"
+            << std::endl;
+    }
+
+    bool parseOptions(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (arg == "--headless")
+            {
+                options.headless = true;
+            }
+            else if (arg == "--realtime")
+            {
+                options.realtime = true;
+            }
+            else if (arg == "--latency")
+            {
+                options.latency = true;
+            }
+            else if (arg == "--overlay")
+            {
+                options.overlay = true;
+            }
+            else if (arg == "--no-idle-skip")
+            {
+                options.idleSkipping = false;
+            }
+            else if (arg == "--jit-check")
+            {
+                options.differential = true;
+            }
+            else if (arg == "--cycles" && hasValue)
+            {
+                options.cycles = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--frames" && hasValue)
+            {
+                options.frames = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--rewind" && hasValue)
+            {
+                options.rewindFrames = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--profile" && hasValue)
+            {
+                options.profilePath = argv[++i];
+            }
+            else if (arg == "--flamegraph" && hasValue)
+            {
+                options.flamegraphPath = argv[++i];
+            }
+            else if (arg == "--trace" && hasValue)
+            {
+                options.tracePath = argv[++i];
+            }
+            else if (arg == "--trace-dump" && hasValue)
+            {
+                options.traceDumpPath = argv[++i];
+            }
+            else if (arg == "--trace-diff" && i + 2 < argc)
+            {
+                options.traceDiffPaths[0] = argv[++i];
+                options.traceDiffPaths[1] = argv[++i];
+            }
+            else if (arg == "--recompile" && hasValue)
+            {
+                options.recompilePath = argv[++i];
+            }
+            else if (arg == "--pc-range" && hasValue)
+            {
+                char* separator = nullptr;
+                options.traceLow = static_cast<uint16_t>(std::strtoul(argv[++i], &separator, 16));
+                if (*separator != '-')
+                {
+                    return false;
+                }
+                options.traceHigh = static_cast<uint16_t>(std::strtoul(separator + 1, nullptr, 16));
+            }
+            else if (arg == "--seed" && hasValue)
+            {
+                options.seeded = true;
+                options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--record" && hasValue)
+            {
+                options.recordPath = argv[++i];
+            }
+            else if (arg == "--replay" && hasValue)
+            {
+                options.replayPath = argv[++i];
+            }
+            else if (arg == "--load-state" && hasValue)
+            {
+                options.loadStatePath = argv[++i];
+            }
+            else if (arg == "--save-state" && hasValue)
+            {
+                options.saveStatePath = argv[++i];
+            }
+            else if (arg == "--batch" && hasValue)
+            {
+                options.batchPath = argv[++i];
+            }
+            else if (arg == "--bench-lockstep" && hasValue)
+            {
+                options.lockstepMachines = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--serve" && hasValue)
+            {
+                options.serveName = argv[++i];
+            }
+            else if (arg == "--bench-agent" && hasValue)
+            {
+                options.agentInstances = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--step-frames" && hasValue)
+            {
+                options.stepFrames = std::max(1u, static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)));
+            }
+            else if (arg == "--threads" && hasValue)
+            {
+                options.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--clock" && hasValue)
+            {
+                const std::string value = argv[++i];
+                const unsigned long clock = (value == "unlimited") ? UNLIMITED_CYCLES_PER_SECOND : std::strtoul(value.c_str(), nullptr, 10);
+                if (clock < MIN_CYCLES_PER_SECOND || clock > UNLIMITED_CYCLES_PER_SECOND)
+                {
+                    return false;
+                }
+                options.clock = static_cast<unsigned>(clock);
+            }
+            else if (arg == "--audio-latency" && hasValue)
+            {
+                options.audioLatency = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--wav" && hasValue)
+            {
+                options.wavPath = argv[++i];
+            }
+            else if (arg == "--video" && hasValue)
+            {
+                options.videoPath = argv[++i];
+            }
+            else if (arg == "--video-scale" && hasValue)
+            {
+                options.videoScale = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--metrics" && hasValue)
+            {
+                options.metricsPath = argv[++i];
+            }
+            else if (arg == "--metrics-interval" && hasValue)
+            {
+                options.metricsInterval = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--turbo" && hasValue)
+            {
+                options.turbo = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (arg == "--backend" && hasValue)
+            {
+                const std::string name = argv[++i];
+                if (name == "interpreter")
+                {
+                    options.backend = Backend::Interpreter;
+                }
+                else if (name == "cached")
+                {
+                    options.backend = Backend::Cached;
+                }
+                else if (name == "jit")
+                {
+                    options.backend = Backend::Jit;
+                }
+                else if (name == "aot")
+                {
+                    options.backend = Backend::Aot;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            else if (arg == "--scale" && hasValue)
+            {
+                options.scale = std::max(1u, static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)));
+            }
+            else if (arg == "--fade" && hasValue)
+            {
+                options.fade = std::strtof(argv[++i], nullptr);
+            }
+            else if (arg == "--quirks" && hasValue)
+            {
+                if (!parseQuirkProfile(argv[++i], options.quirks))
+                {
+                    return false;
+                }
+            }
+            else if (arg == "--sprite-edge" && hasValue)
+            {
+                options.spriteEdgeSet = true;
+                const std::string mode = argv[++i];
+                if (mode == "wrap")
+                {
+                    options.spriteEdge = SpriteEdge::Wrap;
+                }
+                else if (mode == "clip")
+                {
+                    options.spriteEdge = SpriteEdge::Clip;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            else if (arg.compare(0, 2, "--") != 0 && options.romPath.empty())
+            {
+                options.romPath = arg;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        const int modes = !options.romPath.empty() + !options.batchPath.empty()
+            + !options.traceDumpPath.empty() + !options.traceDiffPaths[0].empty();
+        return modes == 1;
+    }
+
+    void runHeadless(Emulator& emulator, const Options& options)
+    {
+        emulator.setRealtime(options.realtime);
+
+        const auto start = std::chrono::steady_clock::now();
+        if (options.cycles > 0)
+        {
+            emulator.runCycles(options.cycles);
+        }
+        if (options.frames > 0 && options.rewindFrames == 0)
+        {
+            emulator.runFrames(options.frames);
+        }
+        else if (options.frames > 0)
+        {
+            RewindBuffer history{ std::max<uint64_t>(options.rewindFrames, DEFAULT_REWIND_FRAMES) };
+            for (uint64_t frame = 0; frame < options.frames; ++frame)
+            {
+                history.record(emulator.snapshot());
+                emulator.runFrame();
+            }
+            const size_t recorded = history.size();
+            const size_t bytes = history.bytes();
+
+            std::shared_ptr<const Snapshot> state;
+            for (uint64_t frame = 0; frame < options.rewindFrames && history.stepBack(state); ++frame)
+            {
+                emulator.restore(state);
+            }
+            std::cout << "rewind history: " << recorded << " frames in " << bytes << " bytes" << std::endl;
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        emulator.cpu().printState(std::cout);
+        std::cout << "cycles: " << emulator.cycles() << " frames: " << emulator.frames()
+            << " time: " << elapsed.count() << " s"
+            << " IPS: " << static_cast<uint64_t>(emulator.cycles() / std::max(elapsed.count(), 1e-9))
+            << " idle: " << emulator.idleCycles()
+            << std::endl;
+        if (options.realtime)
+        {
+            emulator.scheduler().printReport(std::cout);
+        }
+    }
+
+    int runLockstepBenchmark(const Options& options)
+    {
+        std::ifstream rom(options.romPath.c_str(), std::ios::binary);
+        const std::vector<uint8_t> image{ std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>() };
+        const size_t machines = options.lockstepMachines;
+        const uint64_t steps = (options.cycles > 0) ? options.cycles : 100000;
+        const unsigned cyclesPerFrame = std::max(1u, options.clock / TIMER_FREQUENCY);
+
+        LockstepEngine lockstep{ machines };
+        std::vector<CPU> cpus(machines);
+        if (!rom.is_open() || !lockstep.loadROM(image))
+        {
+            std::cerr << "Unable to load ROM: " << options.romPath << std::endl;
+            return 1;
+        }
+        for (CPU& cpu : cpus)
+        {
+            std::copy(image.begin(), image.end(), cpu.memory + PROGRAM_MEMORY_OFFSET);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t step = 1; step <= steps; ++step)
+        {
+            for (CPU& cpu : cpus)
+            {
+                cpu.emulateCycle();
+            }
+            if (step % cyclesPerFrame == 0)
+            {
+                for (CPU& cpu : cpus)
+                {
+                    cpu.decrementTimers();
+                }
+            }
+        }
+        const std::chrono::duration<double> scalarTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (uint64_t step = 1; step <= steps; ++step)
+        {
+            lockstep.step();
+            if (step % cyclesPerFrame == 0)
+            {
+                lockstep.decrementTimers();
+            }
+        }
+        const std::chrono::duration<double> lockstepTime = std::chrono::steady_clock::now() - start;
+
+        size_t matching = 0;
+        for (size_t m = 0; m < machines; ++m)
+        {
+            bool same = cpus[m].programCounter() == lockstep.programCounter(m)
+                && cpus[m].indexRegister() == lockstep.indexRegister(m);
+            for (unsigned i = 0; i < 16; ++i)
+            {
+                same = same && cpus[m].registerValue(i) == lockstep.registerValue(m, i);
+            }
+            same = same && cpus[m].display.state() == lockstep.display(m).state();
+            matching += same ? 1 : 0;
+        }
+
+        const double total = static_cast<double>(steps) * machines;
+        std::cout << "machines: " << machines << " steps: " << steps << '\n'
+            << "independent CPUs: " << static_cast<uint64_t>(total / scalarTime.count()) << " steps/s\n"
+            << "lockstep engine:  " << static_cast<uint64_t>(total / lockstepTime.count()) << " steps/s ("
+            << lockstep.lockstepSteps() << " shared, " << lockstep.divergentSteps() << " divergent)\n"
+            << "speedup: " << scalarTime.count() / lockstepTime.count()
+            << " machines with identical final state: " << matching << '/' << machines
+            << " (CXNN makes machines differ)" << std::endl;
+        return 0;
+    }
+
+    int runAgentBenchmark(const Options& options)
+    {
+        std::ifstream rom(options.romPath.c_str(), std::ios::binary);
+        const std::vector<uint8_t> image{ std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>() };
+        const size_t instances = options.agentInstances;
+        const uint64_t steps = std::max<uint64_t>(1, ((options.frames > 0) ? options.frames : 10000) / options.stepFrames);
+        if (!SharedRegion::available())
+        {
+            std::cerr << "The agent interface is not available on this host" << std::endl;
+            return 1;
+        }
+
+        // servers are set up here, so that their regions exist before the agents open them
+        const std::string prefix = "chip8-bench-" + std::to_string(std::random_device()()) + '-';
+        std::vector<std::unique_ptr<Emulator>> emulators;
+        std::vector<std::unique_ptr<AgentServer>> servers;
+        for (size_t i = 0; i < instances; ++i)
+        {
+            emulators.emplace_back(new Emulator{ options.clock });
+            Emulator& emulator = *emulators.back();
+            emulator.setQuirks(options.quirks);
+            if (!rom.is_open() || !emulator.loadROM(image))
+            {
+                std::cerr << "Unable to load ROM: " << options.romPath << std::endl;
+                return 1;
+            }
+            emulator.setBackend(options.backend);
+            if (options.seeded)
+            {
+                emulator.setSeed(options.seed);
+            }
+            servers.emplace_back(new AgentServer{ emulator });
+            if (!servers.back()->open(prefix + std::to_string(i)))
+            {
+                std::cerr << "Unable to create shared memory: " << prefix << i << std::endl;
+                return 1;
+            }
+        }
+
+        std::vector<std::thread> threads;
+        std::vector<chip8_agent*> agents;
+        for (size_t i = 0; i < instances; ++i)
+        {
+            threads.emplace_back(&AgentServer::serve, servers[i].get());
+            agents.push_back(chip8_agent_open((prefix + std::to_string(i)).c_str()));
+        }
+
+        // a random action per step and instance, as an exploring agent would take
+        std::mt19937 actions{ 1 };
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t step = 0; step < steps; ++step)
+        {
+            for (chip8_agent* agent : agents)
+            {
+                const uint32_t keys = actions();
+                for (unsigned key = 0; key < 16; ++key)
+                {
+                    chip8_agent_state(agent)->keypad[key] = (keys >> (2 * key)) % 4 == 0;
+                }
+                chip8_agent_submit(agent, CHIP8_AGENT_STEP, options.stepFrames);
+            }
+            for (chip8_agent* agent : agents)
+            {
+                chip8_agent_wait(agent);
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        uint64_t cycles = 0;
+        for (chip8_agent* agent : agents)
+        {
+            cycles += chip8_agent_state(agent)->cycles;
+            chip8_agent_quit(agent);
+            chip8_agent_close(agent);
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        const double total = static_cast<double>(steps) * instances;
+        std::cout << "instances: " << instances << " steps: " << steps << " frames per step: " << options.stepFrames << '\n'
+            << "agent steps/s: " << static_cast<uint64_t>(total / elapsed.count())
+            << " (" << static_cast<uint64_t>(total / elapsed.count() / instances) << " per instance)\n"
+            << "frames/s: " << static_cast<uint64_t>(total * options.stepFrames / elapsed.count())
+            << " instructions/s: " << static_cast<uint64_t>(cycles / elapsed.count()) << std::endl;
+        return 0;
+    }
+
+    int runTraceDump(const Options& options)
+    {
+        TraceReader trace;
+        if (!trace.open(options.traceDumpPath))
+        {
+            std::cerr << "Unable to read trace: " << options.traceDumpPath << std::endl;
+            return 1;
+        }
+
+        TraceRecord record;
+        while (trace.next(record))
+        {
+            if (record.pc >= options.traceLow && record.pc <= options.traceHigh)
+            {
+                printRecord(std::cout, record);
+            }
+        }
+        std::cout << std::flush;
+        return 0;
+    }
+
+    int runTraceDiff(const Options& options)
+    {
+        TraceReader traces[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            if (!traces[i].open(options.traceDiffPaths[i]))
+            {
+                std::cerr << "Unable to read trace: " << options.traceDiffPaths[i] << std::endl;
+                return 1;
+            }
+        }
+
+        const size_t CONTEXT = 8;
+        std::deque<TraceRecord> context;
+        TraceRecord a;
+        TraceRecord b;
+        uint64_t index = 0;
+        for (;; ++index)
+        {
+            const bool hasA = traces[0].next(a);
+            const bool hasB = traces[1].next(b);
+            if (!hasA || !hasB)
+            {
+                if (hasA == hasB)
+                {
+                    std::cout << "traces are identical: " << index << " records" << std::endl;
+                    return 0;
+                }
+                std::cout << "traces agree for " << index << " records, then "
+                    << options.traceDiffPaths[hasA ? 1 : 0] << " ends" << std::endl;
+                return 2;
+            }
+            if (!sameRecord(a, b))
+            {
+                break;
+            }
+            context.push_back(a);
+            if (context.size() > CONTEXT)
+            {
+                context.pop_front();
+            }
+        }
+
+        std::cout << "first divergence at record " << index << ", cycle " << a.cycle << "\n";
+        for (const TraceRecord& record : context)
+        {
+            std::cout << "  ";
+            printRecord(std::cout, record);
+        }
+        std::cout << "< ";
+        printRecord(std::cout, a);
+        std::cout << "> ";
+        printRecord(std::cout, b);
+        std::cout << std::flush;
+        return 2;
+    }
 
-    if (argc != 2)
+    int runRecompiler(const Options& options)
     {
-        std::cerr << "Usage: ./" << argv[0] << " pathToROM" << std::endl;
+        std::ifstream rom(options.romPath.c_str(), std::ios::binary);
+        const std::vector<uint8_t> image{ std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>() };
+        if (!rom.is_open() || image.empty() || image.size() > memorySizeOf(options.quirks) - PROGRAM_MEMORY_OFFSET)
+        {
+            std::cerr << "Unable to load ROM: " << options.romPath << std::endl;
+            return 1;
+        }
+
+        const Recompiler recompiler{ image, options.quirks };
+        std::ofstream out(options.recompilePath.c_str());
+        const size_t slash = options.romPath.find_last_of("/\\");
+        recompiler.write(out, options.romPath.substr(slash == std::string::npos ? 0 : slash + 1));
+        if (!out.flush())
+        {
+            std::cerr << "Unable to write: " << options.recompilePath << std::endl;
+            return 1;
+        }
+
+        std::cout << "recompiled " << recompiler.instructionCount() << " instructions into "
+            << recompiler.blockCount() << " blocks; " << recompiler.dynamicJumps()
+            << " BNNN jumps left to the interpreter" << std::endl;
         return 0;
     }
 
-    if (chip.loadROM(argv[1]))
+    int runBatch(const Options& options)
+    {
+        BatchRunner batch{ options.backend, options.clock };
+        if (!batch.loadManifest(options.batchPath))
+        {
+            std::cerr << "Unable to read batch manifest: " << options.batchPath << std::endl;
+            return 1;
+        }
+
+        if (options.seeded)
+        {
+            batch.setSeed(options.seed);
+        }
+        batch.run(options.threads);
+        batch.printResults(std::cout);
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    if (!options.batchPath.empty())
+    {
+        return runBatch(options);
+    }
+    if (!options.traceDumpPath.empty())
+    {
+        return runTraceDump(options);
+    }
+    if (!options.traceDiffPaths[0].empty())
+    {
+        return runTraceDiff(options);
+    }
+    if (options.lockstepMachines > 0)
+    {
+        try
+        {
+            return runLockstepBenchmark(options);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+    if (options.agentInstances > 0)
+    {
+        try
+        {
+            return runAgentBenchmark(options);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+    if (!options.recompilePath.empty())
+    {
+        return runRecompiler(options);
+    }
+
+    InputLog replay;
+    if (!options.replayPath.empty())
     {
-        chip.run();
+        if (!replay.load(options.replayPath))
+        {
+            std::cerr << "Unable to read input log: " << options.replayPath << std::endl;
+            return 1;
+        }
+        // the session is reproduced under the conditions it was recorded with
+        options.clock = replay.clock() ? replay.clock() : options.clock;
+        options.seeded = options.seeded || replay.hasSeed();
+        options.seed = replay.hasSeed() ? replay.seed() : options.seed;
+    }
+
+    InputLog recording;
+    if (!options.recordPath.empty())
+    {
+        if (!options.seeded)
+        {
+            options.seeded = true;
+            options.seed = std::random_device()();
+        }
+        recording.setSeed(options.seed);
+        recording.setClock(options.clock);
+    }
+
+    Emulator emulator{ options.clock };
+    emulator.setQuirks(options.quirks);
+    if (options.spriteEdgeSet)
+    {
+        emulator.cpu().display.setSpriteEdge(options.spriteEdge);
+    }
+    if (emulator.loadROM(options.romPath))
+    {
+        try
+        {
+            emulator.setBackend(options.backend);
+            emulator.setDifferential(options.differential);
+            if (options.backend == Backend::Aot && !emulator.recompiledProgram())
+            {
+                std::cerr << "No recompiled program matches this ROM; it will be interpreted" << std::endl;
+            }
+            emulator.setIdleSkipping(options.idleSkipping);
+            if (options.seeded)
+            {
+                emulator.setSeed(options.seed);
+            }
+            if (!options.loadStatePath.empty() && !emulator.loadState(options.loadStatePath))
+            {
+                std::cerr << "Unable to read state: " << options.loadStatePath << std::endl;
+                return 1;
+            }
+            if (!options.replayPath.empty())
+            {
+                emulator.setReplay(&replay);
+                if (options.cycles == 0 && options.frames == 0)
+                {
+                    options.cycles = replay.length() - std::min(replay.length(), emulator.cycles());
+                }
+            }
+            if (!options.recordPath.empty())
+            {
+                emulator.setRecorder(&recording);
+            }
+            TraceWriter trace;
+            if (!options.tracePath.empty())
+            {
+                if (!trace.open(options.tracePath))
+                {
+                    std::cerr << "Unable to write trace: " << options.tracePath << std::endl;
+                    return 1;
+                }
+                emulator.setTracer(&trace);
+            }
+            std::unique_ptr<Profiler> profiler;
+            if (!options.profilePath.empty() || !options.flamegraphPath.empty())
+            {
+                profiler.reset(new Profiler);
+                emulator.setProfiler(profiler.get());
+            }
+
+            std::unique_ptr<SoundChannel> sound;
+            std::unique_ptr<WavWriter> wav;
+            if (options.headless && !options.wavPath.empty())
+            {
+                sound.reset(new SoundChannel{ emulator.clock() });
+                wav.reset(new WavWriter{ *sound });
+                if (!wav->open(options.wavPath))
+                {
+                    std::cerr << "Unable to write audio: " << options.wavPath << std::endl;
+                    return 1;
+                }
+                emulator.setSound(sound.get());
+            }
+
+            VideoWriter video;
+            if (options.headless && !options.videoPath.empty())
+            {
+                const bool y4m = options.videoPath.size() >= 4
+                    && options.videoPath.compare(options.videoPath.size() - 4, 4, ".y4m") == 0;
+                if (!video.open(options.videoPath, y4m ? VideoFormat::Y4M : VideoFormat::Rgb, options.videoScale))
+                {
+                    std::cerr << "Unable to write video: " << options.videoPath << std::endl;
+                    return 1;
+                }
+                emulator.setVideo(&video);
+            }
+
+            std::unique_ptr<Metrics> metrics;
+            std::unique_ptr<MetricsLog> metricsLog;
+            if (!options.metricsPath.empty() || (options.overlay && !options.headless))
+            {
+                metrics.reset(new Metrics);
+                emulator.setMetrics(metrics.get());
+            }
+            if (!options.metricsPath.empty())
+            {
+                metricsLog.reset(new MetricsLog{ *metrics });
+                if (!metricsLog->open(options.metricsPath, options.metricsInterval))
+                {
+                    std::cerr << "Unable to write metrics: " << options.metricsPath << std::endl;
+                    return 1;
+                }
+            }
+
+            if (!options.serveName.empty())
+            {
+                AgentServer server{ emulator };
+                if (!server.open(options.serveName))
+                {
+                    std::cerr << "Unable to create shared memory: " << options.serveName << std::endl;
+                    return 1;
+                }
+                std::cout << "serving " << options.serveName << std::endl;
+                server.serve();
+                std::cout << "agent quit after " << server.steps() << " steps, cycles: " << emulator.cycles()
+                    << " frames: " << emulator.frames() << std::endl;
+            }
+            else if (options.headless)
+            {
+                runHeadless(emulator, options);
+                if (metrics)
+                {
+                    metrics->printSummary(std::cout);
+                }
+            }
+            else
+            {
+                Chip8 chip{ emulator, options.scale, options.fade };
+                chip.setTurbo(options.turbo);
+                chip.setAudioLatency(options.audioLatency);
+                chip.setMetrics(metrics.get(), options.overlay);
+                chip.run();
+                if (options.latency)
+                {
+                    chip.printStats(std::cout);
+                }
+            }
+
+            if (metricsLog && !metricsLog->close())
+            {
+                std::cerr << "Metrics incomplete: " << options.metricsPath << std::endl;
+            }
+            emulator.setMetrics(nullptr);
+
+            if (!options.saveStatePath.empty() && !emulator.saveState(options.saveStatePath))
+            {
+                std::cerr << "Unable to write state: " << options.saveStatePath << std::endl;
+            }
+            if (!options.videoPath.empty() && options.headless)
+            {
+                emulator.setVideo(nullptr);
+                const bool written = video.close();
+                std::cout << "video: " << video.frames() << " frames, " << video.converted() << " converted, "
+                    << video.stalls() << " writer stalls" << std::endl;
+                if (!written)
+                {
+                    std::cerr << "Video incomplete: " << options.videoPath << std::endl;
+                }
+            }
+            if (wav)
+            {
+                emulator.setSound(nullptr);
+                if (!wav->close())
+                {
+                    std::cerr << "Audio incomplete: " << options.wavPath << std::endl;
+                }
+            }
+            if (!options.tracePath.empty())
+            {
+                emulator.setTracer(nullptr);
+                if (!trace.close())
+                {
+                    std::cerr << "Trace incomplete: " << options.tracePath << std::endl;
+                }
+            }
+            if (profiler && !options.profilePath.empty())
+            {
+                std::ofstream report(options.profilePath.c_str());
+                profiler->printHotspots(report, 32);
+            }
+            if (profiler && !options.flamegraphPath.empty())
+            {
+                std::ofstream stacks(options.flamegraphPath.c_str());
+                profiler->writeCollapsedStacks(stacks);
+            }
+            if (!options.recordPath.empty())
+            {
+                recording.setLength(emulator.cycles());
+                if (!recording.save(options.recordPath))
+                {
+                    std::cerr << "Unable to write input log: " << options.recordPath << std::endl;
+                }
+            }
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
     }
 
     return 0;
@@ -0,0 +1,93 @@
+#include "Test.hpp"
+#include "Emulator.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+    const uint64_t FRAMES = 600;
+
+    // false if the backend is not available on this host
+    bool run(Emulator& emulator, Backend backend, const std::vector<uint8_t>& image)
+    {
+        try
+        {
+            emulator.setBackend(backend);
+        }
+        catch (const std::runtime_error& error)
+        {
+            reportSkip(error.what());
+            return false;
+        }
+        emulator.setSeed(1);
+        CHECK(emulator.loadROM(image));
+        emulator.runFrames(FRAMES);
+        return true;
+    }
+
+    void checkBackendsAgree(const std::vector<uint8_t>& image)
+    {
+        Emulator reference;
+        run(reference, Backend::Interpreter, image);
+        CHECK(reference.cycles() == FRAMES * DEFAULT_CYCLES_PER_SECOND / TIMER_FREQUENCY);
+
+        for (Backend backend : { Backend::Cached, Backend::Jit })
+        {
+            Emulator emulator;
+            if (run(emulator, backend, image))
+            {
+                CHECK(emulator.cpu().sameState(reference.cpu()));
+                CHECK(emulator.cycles() == reference.cycles());
+                CHECK(emulator.frames() == reference.frames());
+            }
+        }
+    }
+}
+
+TEST(backendsAgreeOnMixedWorkload)
+{
+    checkBackendsAgree(mixedWorkload());
+}
+
+TEST(backendsAgreeOnSelfModifyingCode)
+{
+    // counts V0 to 5, then rewrites the 7001 at 0x200 into 7101 and starts over
+    const std::vector<uint8_t> image = assemble({ 0x7001, 0x3005, 0x1200, 0x6071, 0x6101, 0xA200, 0xF155, 0x6000, 0x1200 });
+    checkBackendsAgree(image);
+
+    Emulator emulator;
+    run(emulator, Backend::Interpreter, image);
+    CHECK(emulator.cpu().registerValue(1) > 1);
+}
+
+TEST(backendsSeeWritesWrappingAroundMemory)
+{
+    // writes 6001 00EE to 0x000 and calls it, then rewrites it into 6002 with an FX55 starting
+    // at 0xFFF, the last byte of memory, and calls it again
+    const std::vector<uint8_t> image = assemble({ 0x6060, 0x6101, 0x6200, 0x63EE, 0xA000, 0xF355, 0x2000,
+        0x6160, 0x6202, 0xAFFF, 0xF255, 0x2000, 0x1218 });
+    checkBackendsAgree(image);
+
+    Emulator emulator;
+    run(emulator, Backend::Interpreter, image);
+    CHECK(emulator.cpu().registerValue(0) == 2);
+}
+
+TEST(jitPassesDifferentialCheck)
+{
+    Emulator emulator;
+    try
+    {
+        emulator.setBackend(Backend::Jit);
+    }
+    catch (const std::runtime_error& error)
+    {
+        reportSkip(error.what());
+        return;
+    }
+    emulator.setDifferential(true); // throws on the first instruction the JIT gets wrong
+    emulator.setSeed(1);
+    CHECK(emulator.loadROM(mixedWorkload()));
+    emulator.runFrames(60);
+    CHECK(emulator.cycles() == 60 * DEFAULT_CYCLES_PER_SECOND / TIMER_FREQUENCY);
+}
@@ -0,0 +1,55 @@
+#include "Test.hpp"
+#include "BatchRunner.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // three jobs of the same ROM
+    std::vector<BatchResult> runRandomJobs(const std::string& romPath, const uint32_t* seed)
+    {
+        BatchRunner batch{ Backend::Interpreter, DEFAULT_CYCLES_PER_SECOND };
+        if (seed)
+        {
+            batch.setSeed(*seed);
+        }
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            batch.addJob({ romPath, "", 100 });
+        }
+        batch.run(2);
+        return batch.results();
+    }
+
+    uint16_t randomBytes(const BatchResult& result)
+    {
+        return static_cast<uint16_t>(result.V[0] << 8 | result.V[1]);
+    }
+}
+
+TEST(batchJobsAreSeededFromBatchSeed)
+{
+    const std::string romPath = (std::filesystem::temp_directory_path() / "chip8_tests_batch.ch8").string();
+    {
+        const std::vector<uint8_t> image = assemble({ 0xC0FF, 0xC1FF, 0x1204 }); // two random bytes into V0 and V1
+        std::ofstream rom(romPath.c_str(), std::ios::binary);
+        rom.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+
+    const uint32_t seed = 7;
+    const std::vector<BatchResult> first = runRandomJobs(romPath, nullptr);
+    const std::vector<BatchResult> again = runRandomJobs(romPath, nullptr);
+    const std::vector<BatchResult> seeded = runRandomJobs(romPath, &seed);
+    std::remove(romPath.c_str());
+
+    CHECK(first.size() == 3 && again.size() == 3 && seeded.size() == 3);
+    for (size_t i = 0; i < first.size() && i < again.size() && i < seeded.size(); ++i)
+    {
+        CHECK(first[i].ok && seeded[i].ok);
+        CHECK(randomBytes(first[i]) == randomBytes(again[i])); // DEFAULT_BATCH_SEED every time
+        CHECK(randomBytes(first[i]) != randomBytes(seeded[i]));
+        CHECK(i == 0 || randomBytes(first[i]) != randomBytes(first[i - 1])); // seed + i
+    }
+}
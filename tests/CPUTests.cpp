@@ -0,0 +1,58 @@
+#include "Test.hpp"
+
+TEST(addSetsCarry)
+{
+    CPU cpu;
+    load(cpu, { 0x60FF, 0x6102, 0x8014 });
+    step(cpu, 3);
+    CHECK(cpu.registerValue(0) == 0x01);
+    CHECK(cpu.registerValue(0xF) == 0x01);
+}
+
+TEST(subtractClearsVFOnBorrow)
+{
+    CPU cpu;
+    load(cpu, { 0x6003, 0x6105, 0x8015, 0x6205, 0x6303, 0x8235 });
+    step(cpu, 3);
+    CHECK(cpu.registerValue(0) == 0xFE);
+    CHECK(cpu.registerValue(0xF) == 0x00);
+    step(cpu, 3);
+    CHECK(cpu.registerValue(2) == 0x02);
+    CHECK(cpu.registerValue(0xF) == 0x01);
+}
+
+TEST(storesBinaryCodedDecimal)
+{
+    CPU cpu;
+    load(cpu, { 0x60FE, 0xA300, 0xF033 });
+    step(cpu, 3);
+    CHECK(cpu.memory[0x300] == 2);
+    CHECK(cpu.memory[0x301] == 5);
+    CHECK(cpu.memory[0x302] == 4);
+}
+
+TEST(callsAndReturns)
+{
+    CPU cpu;
+    load(cpu, { 0x2206, 0x6001, 0x1204, 0x6002, 0x00EE });
+    step(cpu, 1);
+    CHECK(cpu.programCounter() == 0x206);
+    step(cpu, 1);
+    CHECK(cpu.registerValue(0) == 0x02);
+    step(cpu, 1);
+    CHECK(cpu.programCounter() == 0x202);
+    step(cpu, 1);
+    CHECK(cpu.registerValue(0) == 0x01);
+}
+
+TEST(drawReportsCollision)
+{
+    CPU cpu;
+    load(cpu, { 0xA000, 0xD005, 0xD005 }); // the digit 0 at (V0, V0) = (0, 0), twice
+    step(cpu, 2);
+    CHECK(cpu.registerValue(0xF) == 0x00);
+    CHECK(cpu.display.pixel(0, 0));
+    step(cpu, 1);
+    CHECK(cpu.registerValue(0xF) == 0x01);
+    CHECK(!cpu.display.pixel(0, 0));
+}
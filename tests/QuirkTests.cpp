@@ -0,0 +1,33 @@
+#include "Test.hpp"
+
+TEST(shiftFollowsQuirkProfile)
+{
+    CPU plain;
+    load(plain, { 0x6005, 0x6103, 0x8016 });
+    step(plain, 3);
+    CHECK(plain.registerValue(0) == 0x02);
+    CHECK(plain.registerValue(0xF) == 0x01);
+
+    CPU vip;
+    vip.setQuirks(QuirkProfile::CosmacVip);
+    load(vip, { 0x6005, 0x6103, 0x8016 });
+    step(vip, 3);
+    CHECK(vip.registerValue(0) == 0x01);
+    CHECK(vip.registerValue(0xF) == 0x01);
+}
+
+TEST(storeAdvancesIndexPerProfile)
+{
+    const QuirkProfile profiles[] = { QuirkProfile::Default, QuirkProfile::Chip48, QuirkProfile::SuperChip };
+    const uint16_t expected[] = { 0x303, 0x302, 0x300 };
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        CPU cpu;
+        cpu.setQuirks(profiles[i]);
+        load(cpu, { 0xA300, 0x6101, 0x6202, 0xF255 });
+        step(cpu, 4);
+        CHECK(cpu.indexRegister() == expected[i]);
+        CHECK(cpu.memory[0x301] == 0x01);
+        CHECK(cpu.memory[0x302] == 0x02);
+    }
+}
@@ -0,0 +1,160 @@
+#include "Test.hpp"
+#include "Emulator.hpp"
+
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace
+{
+    template <typename T>
+    void put(std::ostream& out, T value)
+    {
+        for (unsigned i = 0; i < sizeof(T); ++i)
+        {
+            out.put(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+    }
+
+    bool sameMachine(const Emulator& first, const Emulator& second)
+    {
+        return first.cpu().sameState(second.cpu()) && first.cycles() == second.cycles();
+    }
+
+    // a version 1 save state with the stack pointer given, page 2 holding 00..FF and pixel (0, 3) lit
+    std::string version1File(uint8_t sp)
+    {
+        std::stringstream file;
+        file.write("C8SS", 4);
+        put<uint16_t>(file, 1);
+        put<uint64_t>(file, 1234); // cycles
+        put<uint64_t>(file, 102); // frames
+        put<uint32_t>(file, 7); // frameCycle
+        for (uint8_t v = 0; v < 16; ++v)
+        {
+            put<uint8_t>(file, v * 3);
+        }
+        put<uint16_t>(file, 0x345); // I
+        put<uint16_t>(file, 0x20A); // pc
+        for (uint16_t level = 0; level < 16; ++level)
+        {
+            put<uint16_t>(file, (level == 0) ? 0x204 : 0);
+        }
+        put<uint8_t>(file, sp);
+        put<uint8_t>(file, 9); // delay timer
+        put<uint8_t>(file, 4); // sound timer
+        for (unsigned key = 0; key < 16; ++key)
+        {
+            put<uint8_t>(file, key == 0xA);
+        }
+        for (unsigned y = 0; y < 32; ++y)
+        {
+            put<uint64_t>(file, (y == 3) ? uint64_t(1) << 63 : 0); // pixel (0, 3)
+        }
+        put<uint16_t>(file, 1 << 2); // only page 2, 0x200-0x2FF
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            put<uint8_t>(file, static_cast<uint8_t>(i));
+        }
+        put<uint64_t>(file, 0); // randomDraws
+
+        std::stringstream engineText;
+        engineText << std::mt19937{ 42 };
+        std::vector<uint32_t> words;
+        for (uint32_t word; engineText >> word; )
+        {
+            words.push_back(word);
+        }
+        put<uint16_t>(file, static_cast<uint16_t>(words.size()));
+        for (uint32_t word : words)
+        {
+            put<uint32_t>(file, word);
+        }
+        return file.str();
+    }
+}
+
+TEST(snapshotSurvivesFileRoundTrip)
+{
+    Emulator original;
+    original.setSeed(5);
+    CHECK(original.loadROM(mixedWorkload()));
+    original.runFrames(120);
+
+    std::stringstream file;
+    CHECK(writeSnapshot(file, *original.snapshot()));
+    std::shared_ptr<Snapshot> read = std::make_shared<Snapshot>();
+    CHECK(readSnapshot(file, *read));
+
+    Emulator restored;
+    CHECK(restored.loadROM(mixedWorkload()));
+    restored.restore(read);
+    CHECK(sameMachine(restored, original));
+    CHECK(restored.frames() == original.frames());
+
+    // the RNG state travels with the snapshot, so both keep drawing the same numbers
+    original.runFrames(120);
+    restored.runFrames(120);
+    CHECK(sameMachine(restored, original));
+}
+
+TEST(snapshotsShareUnwrittenPages)
+{
+    CPU cpu;
+    load(cpu, { 0xA300, 0x6007, 0xF033, 0x1206 });
+    const std::shared_ptr<const Snapshot> before = cpu.snapshot();
+    step(cpu, 4);
+    const std::shared_ptr<const Snapshot> after = cpu.snapshot();
+
+    const unsigned written = 0x300 / Snapshot::PAGE_SIZE;
+    for (unsigned page = 0; page < after->memory.size(); ++page)
+    {
+        CHECK((before->memory[page] == after->memory[page]) == (page != written));
+    }
+    CHECK((*after->memory[written])[0x302 % Snapshot::PAGE_SIZE] == 7);
+
+    cpu.restore(before);
+    CHECK(cpu.memory[0x302] == 0);
+    CHECK(cpu.programCounter() == PROGRAM_MEMORY_OFFSET);
+
+    // the restored snapshot itself is the baseline, so the next one shares all of its pages
+    const std::shared_ptr<const Snapshot> again = cpu.snapshot();
+    CHECK(again->memory == before->memory);
+}
+
+TEST(readsVersion1Snapshot)
+{
+    std::stringstream file{ version1File(1) };
+    std::shared_ptr<Snapshot> read = std::make_shared<Snapshot>();
+    CHECK(readSnapshot(file, *read));
+    const Snapshot& snapshot = *read;
+    CHECK(snapshot.cycles == 1234);
+    CHECK(snapshot.frames == 102);
+    CHECK(snapshot.frameCycle == 7);
+    CHECK(snapshot.V[5] == 15);
+    CHECK(snapshot.I == 0x345);
+    CHECK(snapshot.pc == 0x20A);
+    CHECK(snapshot.stack[0] == 0x204);
+    CHECK(snapshot.sp == 1);
+    CHECK(snapshot.delayTimer == 9);
+    CHECK(snapshot.soundTimer == 4);
+    CHECK(snapshot.keypad[0xA] == 1);
+    CHECK(!snapshot.display.hires);
+
+    CPU cpu;
+    cpu.restore(read);
+    CHECK(cpu.display.pixel(0, 3));
+    CHECK(!cpu.display.pixel(1, 3));
+    CHECK(cpu.memory[0x200] == 0x00);
+    CHECK(cpu.memory[0x2FF] == 0xFF);
+    CHECK(cpu.memory[0x300] == 0x00);
+    CHECK(*snapshot.engine == std::mt19937{ 42 });
+}
+
+TEST(rejectsSnapshotWithFullStack)
+{
+    std::stringstream file{ version1File(16) }; // the next 2NNN would write past the stack
+    Snapshot snapshot;
+    CHECK(!readSnapshot(file, snapshot));
+}
@@ -0,0 +1,99 @@
+#include "Test.hpp"
+#include "Emulator.hpp"
+
+#include <stdexcept>
+
+TEST(skipsStepOverLongOpcodeOnXoChip)
+{
+    CPU xo;
+    xo.setQuirks(QuirkProfile::XoChip);
+    load(xo, { 0x6001, 0x3001, 0xF000, 0x1234 });
+    step(xo, 2);
+    CHECK(xo.programCounter() == 0x208);
+
+    CPU plain;
+    load(plain, { 0x6001, 0x3001, 0xF000, 0x1234 });
+    step(plain, 2);
+    CHECK(plain.programCounter() == 0x206);
+}
+
+TEST(superChipOpcodesNeedTheirProfile)
+{
+    CPU plain;
+    load(plain, { 0x00FF });
+    CHECK_THROWS(step(plain, 1), std::runtime_error);
+
+    CPU schip;
+    schip.setQuirks(QuirkProfile::SuperChip);
+    load(schip, { 0x00FF });
+    step(schip, 1);
+    CHECK(schip.display.hires());
+}
+
+TEST(plainProfileSkipsOn5XYN)
+{
+    CPU cpu;
+    load(cpu, { 0x5012, 0x6005, 0x6006 }); // V0 == V1 == 0
+    step(cpu, 2);
+    CHECK(cpu.registerValue(0) == 0x06);
+    CHECK(cpu.programCounter() == 0x206);
+}
+
+TEST(spriteOfHeightZeroNeedsSuperChip)
+{
+    CPU plain;
+    load(plain, { 0x6F00, 0xA000, 0xD000 }); // the font, if a 16x16 sprite were drawn
+    step(plain, 3);
+    CHECK(!plain.display.pixel(0, 0));
+    CHECK(plain.registerValue(0xF) == 0x00);
+
+    CPU schip;
+    schip.setQuirks(QuirkProfile::SuperChip);
+    load(schip, { 0x6F00, 0xA000, 0xD000 });
+    step(schip, 3);
+    CHECK(schip.display.pixel(0, 0));
+}
+
+TEST(memorySizeFollowsProfile)
+{
+    const std::vector<uint8_t> large(MEMORY_SIZE - PROGRAM_MEMORY_OFFSET + 1, 0x12);
+
+    Emulator plain;
+    CHECK(plain.cpu().memory.size() == MEMORY_SIZE);
+    CHECK(!plain.loadROM(large));
+
+    Emulator xo;
+    xo.setQuirks(QuirkProfile::XoChip);
+    CHECK(xo.cpu().memory.size() == XO_CHIP_MEMORY_SIZE);
+    CHECK(xo.loadROM(large));
+    CHECK(xo.cpu().memory[MEMORY_SIZE] == 0x12);
+}
+
+TEST(addressesWrapAtEndOfMemory)
+{
+    CPU plain;
+    load(plain, { 0x60FE, 0xAFFF, 0xF033 }); // 2, 5, 4 at 0xFFF, 0x000 and 0x001
+    step(plain, 3);
+    CHECK(plain.memory[0xFFF] == 2);
+    CHECK(plain.memory[0x000] == 5);
+    CHECK(plain.memory[0x001] == 4);
+
+    CPU xo;
+    xo.setQuirks(QuirkProfile::XoChip);
+    load(xo, { 0x60FE, 0xAFFF, 0xF033 });
+    step(xo, 3);
+    CHECK(xo.memory[0x1000] == 5);
+    CHECK(xo.memory[0x000] == 0xF0); // the font is untouched
+}
+
+TEST(profileChangeKeepsLoadedBytes)
+{
+    CPU cpu;
+    load(cpu, { 0x1234 });
+    cpu.setQuirks(QuirkProfile::XoChip);
+    CHECK(cpu.fetch(PROGRAM_MEMORY_OFFSET) == 0x1234);
+    cpu.setQuirks(QuirkProfile::SuperChip);
+    CHECK(cpu.memory.size() == MEMORY_SIZE);
+    CHECK(cpu.fetch(PROGRAM_MEMORY_OFFSET) == 0x1234);
+    CHECK(cpu.fetch(BIG_FONT_ADDRESS) == 0xFFFF);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CPU.hpp"
+
+// Headless regression tests: one executable built from the files in tests/ and every source in
+// src/ except main.cpp and the SFML frontend (Chip8, Renderer, AudioStream, MetricsOverlay), e.g.
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc tests/*.cpp $(ls src/*.cpp | grep -Ev 'main|Chip8|Renderer|AudioStream|MetricsOverlay') -o chip8_tests
+//
+// Run it without arguments for every test, or with names to run only those. It exits with 1 if
+// any test failed.
+
+struct TestCase
+{
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& testRegistry();
+
+struct TestRegistration
+{
+    TestRegistration(const char* name, void (*run)());
+};
+
+void reportFailure(const char* file, int line, const char* expression);
+void reportSkip(const char* reason); // the test could not run here, e.g. no JIT on this host
+
+#define TEST(name) \
+    static void name(); \
+    static const TestRegistration name##Registration{ #name, &name }; \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) reportFailure(__FILE__, __LINE__, #condition); } while (false)
+
+#define CHECK_THROWS(statement, exception) \
+    do \
+    { \
+        bool thrown = false; \
+        try { statement; } catch (const exception&) { thrown = true; } \
+        if (!thrown) reportFailure(__FILE__, __LINE__, #statement " throws " #exception); \
+    } while (false)
+
+// big-endian opcodes from PROGRAM_MEMORY_OFFSET on
+std::vector<uint8_t> assemble(const std::vector<uint16_t>& program);
+void load(CPU& cpu, const std::vector<uint16_t>& program);
+void step(CPU& cpu, unsigned count);
+
+
+// A few hundred instructions exercising ALU, skips, calls, keys, timers, random numbers, draws
+// and memory writes in a loop, generated from a fixed seed so every run sees the same ROM.
+std::vector<uint8_t> mixedWorkload();
@@ -0,0 +1,72 @@
+#include "Test.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    unsigned failures; // of the running test
+    bool skipped;
+}
+
+std::vector<TestCase>& testRegistry()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+TestRegistration::TestRegistration(const char* name, void (*run)())
+{
+    testRegistry().push_back({ name, run });
+}
+
+void reportFailure(const char* file, int line, const char* expression)
+{
+    std::cout << "\n  " << file << ':' << line << ": CHECK(" << expression << ") failed";
+    ++failures;
+}
+
+void reportSkip(const char* reason)
+{
+    std::cout << " skipped: " << reason;
+    skipped = true;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned run = 0;
+    unsigned failed = 0;
+    for (const TestCase& test : testRegistry())
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+        {
+            selected = selected || std::strcmp(argv[i], test.name) == 0;
+        }
+        if (!selected)
+        {
+            continue;
+        }
+
+        std::cout << test.name << ':';
+        failures = 0;
+        skipped = false;
+        try
+        {
+            test.run();
+        }
+        catch (const std::exception& error)
+        {
+            std::cout << "\n  unexpected exception: " << error.what();
+            ++failures;
+        }
+        std::cout << ((failures > 0) ? "\n  FAILED" : skipped ? "" : " ok") << std::endl;
+
+        ++run;
+        failed += (failures > 0) ? 1 : 0;
+    }
+
+    std::cout << run - failed << " of " << run << " tests passed" << std::endl;
+    return (failed > 0) ? 1 : 0;
+}
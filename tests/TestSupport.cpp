@@ -0,0 +1,98 @@
+#include "Test.hpp"
+
+#include <algorithm>
+#include <random>
+
+std::vector<uint8_t> assemble(const std::vector<uint16_t>& program)
+{
+    std::vector<uint8_t> image;
+    for (uint16_t opcode : program)
+    {
+        image.push_back(static_cast<uint8_t>(opcode >> 8));
+        image.push_back(static_cast<uint8_t>(opcode));
+    }
+    return image;
+}
+
+void load(CPU& cpu, const std::vector<uint16_t>& program)
+{
+    const std::vector<uint8_t> image = assemble(program);
+    std::copy(image.begin(), image.end(), cpu.memory + PROGRAM_MEMORY_OFFSET);
+    cpu.recordMemoryWrite(PROGRAM_MEMORY_OFFSET, static_cast<unsigned>(image.size()));
+}
+
+void step(CPU& cpu, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        cpu.emulateCycle();
+    }
+}
+
+std::vector<uint8_t> mixedWorkload()
+{
+    const uint16_t DATA = 0x800; // FX33/FX55 only ever write to DATA..DATA + 0x10F
+    const uint16_t SUBROUTINE = 0x600;
+
+    std::mt19937 random{ 8 };
+    auto pick = [&](unsigned count) { return static_cast<uint16_t>(random() % count); };
+    auto reg = [&]() { return pick(15); }; // V0-VE; VF only receives flags
+
+    std::vector<uint16_t> program;
+    for (uint16_t x = 0; x < 15; ++x)
+    {
+        program.push_back(0x6000 | x << 8 | pick(0x100));
+    }
+    const uint16_t loop = static_cast<uint16_t>(PROGRAM_MEMORY_OFFSET + program.size() * 2);
+
+    const uint16_t ALU[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+    while (program.size() < 300)
+    {
+        const uint16_t x = reg();
+        const uint16_t y = reg();
+        switch (pick(12))
+        {
+        case 0: program.push_back(0x6000 | x << 8 | pick(0x100)); break;
+        case 1: program.push_back(0x7000 | x << 8 | pick(0x100)); break;
+        case 2:
+        case 3: program.push_back(0x8000 | x << 8 | y << 4 | ALU[pick(9)]); break;
+        case 4: program.push_back(0xC000 | x << 8 | pick(0x100)); break;
+        case 5: // skip over an instruction that shows whether it ran
+        {
+            const uint16_t skips[] = { uint16_t(0x3000 | x << 8 | pick(4)), uint16_t(0x4000 | x << 8 | pick(4)),
+                uint16_t(0x5000 | x << 8 | y << 4), uint16_t(0x9000 | x << 8 | y << 4),
+                uint16_t(0xE09E | x << 8), uint16_t(0xE0A1 | x << 8) };
+            program.push_back(skips[pick(6)]);
+            program.push_back(0x7001 | y << 8);
+            break;
+        }
+        case 6: // a sprite from the font or from the data area
+            program.push_back(pick(2) ? (0xF029 | x << 8) : (0xA000 | (DATA + pick(0x100))));
+            program.push_back(0xD000 | x << 8 | y << 4 | (1 + pick(15)));
+            break;
+        case 7:
+            program.push_back(0xA000 | (DATA + pick(0x100)));
+            program.push_back(pick(2) ? (0xF033 | x << 8) : (0xF055 | pick(16) << 8));
+            break;
+        case 8:
+            program.push_back(0xA000 | (DATA + pick(0x100)));
+            program.push_back(pick(2) ? (0xF01E | x << 8) : (0xF065 | pick(15) << 8));
+            break;
+        case 9:
+        {
+            const uint16_t timers[] = { 0xF015, 0xF018, 0xF007 };
+            program.push_back(timers[pick(3)] | x << 8);
+            break;
+        }
+        case 10: program.push_back(0x2000 | SUBROUTINE); break;
+        case 11: program.push_back(pick(8) ? (0x8000 | x << 8 | y << 4) : 0x00E0); break;
+        }
+    }
+    program.push_back(0x1000 | loop);
+
+    std::vector<uint8_t> image = assemble(program);
+    image.resize(SUBROUTINE - PROGRAM_MEMORY_OFFSET, 0);
+    const std::vector<uint8_t> subroutine = assemble({ 0x8014, 0x8126, 0xC2FF, 0x00EE });
+    image.insert(image.end(), subroutine.begin(), subroutine.end());
+    return image;
+}